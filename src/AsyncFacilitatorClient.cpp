@@ -0,0 +1,610 @@
+#include "AsyncFacilitatorClient.h"
+#include <HTTPClient.h>
+#include "stackmonitor.h"
+
+// Default deadlines: verify is a quick signature check, settle waits for the chain
+static const FacilitatorDeadlines kDefaultVerifyDeadlines = {10000, 15000, 30000};
+static const FacilitatorDeadlines kDefaultSettleDeadlines = {10000, 50000, 60000};
+
+static bool startsWithIgnoreCaseC(const char *s, const char *prefix)
+{
+    return strncasecmp(s, prefix, strlen(prefix)) == 0;
+}
+
+AsyncFacilitatorRequest::AsyncFacilitatorRequest()
+    : transport_(nullptr), port_(0), https_(false), lastUsedMs_(0), state_(Idle),
+      deadlines_(kDefaultVerifyDeadlines), startedMs_(0), phaseMs_(0), reused_(false), retried_(false),
+      idempotent_(false), receivedAny_(false), body_(nullptr), headSent_(0), outLen_(0), outPos_(0),
+      statusCode_(0), lineLen_(0), statusLineSeen_(false), keepAlive_(false), bodyMode_(BodyUntilClose),
+      chunkState_(ChunkSize), remaining_(0)
+{
+}
+
+void AsyncFacilitatorRequest::setCACert(const char *rootCA)
+{
+    if (rootCA)
+        secure_.setCACert(rootCA);
+    else
+        secure_.setInsecure();
+    // A new trust anchor only applies to new handshakes
+    if (transport_ == &secure_)
+        close();
+}
+
+bool AsyncFacilitatorRequest::canReuse(const String &url) const
+{
+    if (!transport_ || origin_.length() == 0)
+        return false;
+    if (!url.startsWith(origin_))
+        return false;
+    if (url.length() > origin_.length() && url[origin_.length()] != '/')
+        return false;
+    if ((millis() - lastUsedMs_) > X4PAY_FACILITATOR_IDLE_TIMEOUT_MS)
+        return false;
+    return transport_->connected();
+}
+
+bool AsyncFacilitatorRequest::start(const String &url, SegmentedBodyStream &body, const String &customHeaders,
+                                    const FacilitatorDeadlines &deadlines, bool idempotent)
+{
+    if (state_ != Idle)
+        return false;
+
+    // Split scheme://host[:port]/path
+    int hostStart = url.indexOf("://");
+    if (hostStart < 0)
+        return false;
+    bool https = url.startsWith("https://");
+    hostStart += 3;
+    int pathStart = url.indexOf('/', hostStart);
+    int hostEnd = pathStart >= 0 ? pathStart : url.length();
+    const char *path = pathStart >= 0 ? url.c_str() + pathStart : "/";
+
+    reused_ = canReuse(url);
+    if (!reused_)
+    {
+        close();
+        https_ = https;
+        origin_ = url.substring(0, hostEnd);
+        int colon = url.indexOf(':', hostStart);
+        if (colon >= 0 && colon < hostEnd)
+        {
+            host_ = url.substring(hostStart, colon);
+            port_ = (uint16_t)atoi(url.c_str() + colon + 1);
+        }
+        else
+        {
+            host_ = url.substring(hostStart, hostEnd);
+            port_ = https ? 443 : 80;
+        }
+    }
+
+    // Request head is rebuilt in place; the String keeps its capacity across requests
+    char contentLength[16];
+    snprintf(contentLength, sizeof(contentLength), "%u", (unsigned)body.size());
+    head_ = "POST ";
+    head_ += path;
+    head_ += " HTTP/1.1\r\nHost: ";
+    head_.concat(url.c_str() + hostStart, hostEnd - hostStart);
+    head_ += "\r\nContent-Type: application/json\r\nContent-Length: ";
+    head_ += contentLength;
+    head_ += "\r\nConnection: keep-alive\r\n";
+
+    // Same "Name: Value\n" format addCustomHeaders accepts
+    const char *p = customHeaders.c_str();
+    while (*p)
+    {
+        const char *end = strchr(p, '\n');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        size_t trimmed = len;
+        while (trimmed > 0 && (p[trimmed - 1] == '\r' || p[trimmed - 1] == ' '))
+            trimmed--;
+        if (trimmed > 0 && memchr(p, ':', trimmed))
+        {
+            head_.concat(p, trimmed);
+            head_ += "\r\n";
+        }
+        p += len + (end ? 1 : 0);
+    }
+    head_ += "\r\n";
+
+    body_ = &body;
+    body_->rewind();
+    headSent_ = 0;
+    outLen_ = 0;
+    outPos_ = 0;
+
+    parser_.reset();
+    statusCode_ = 0;
+    lineLen_ = 0;
+    statusLineSeen_ = false;
+    keepAlive_ = false;
+    bodyMode_ = BodyUntilClose;
+    chunkState_ = ChunkSize;
+    remaining_ = 0;
+    receivedAny_ = false;
+    retried_ = false;
+    idempotent_ = idempotent;
+
+    deadlines_ = deadlines;
+    startedMs_ = millis();
+    phaseMs_ = startedMs_;
+    state_ = reused_ ? Sending : Connecting;
+    return true;
+}
+
+AsyncFacilitatorRequest::State AsyncFacilitatorRequest::poll()
+{
+    switch (state_)
+    {
+    case Connecting:
+    case Handshaking:
+        connect();
+        break;
+    case Sending:
+        send();
+        break;
+    case AwaitingFirstByte:
+    case ReadingHeaders:
+    case ReadingBody:
+        receive();
+        break;
+    default:
+        return state_;
+    }
+
+    if (!finished())
+        checkDeadlines();
+    return state_;
+}
+
+void AsyncFacilitatorRequest::checkDeadlines()
+{
+    uint32_t now = millis();
+    if ((now - startedMs_) > deadlines_.totalMs)
+    {
+        fail(X4PAY_HTTP_ERROR_TOTAL_TIMEOUT);
+        return;
+    }
+    if ((state_ == Connecting || state_ == Handshaking) && (now - phaseMs_) > deadlines_.connectMs)
+    {
+        fail(X4PAY_HTTP_ERROR_CONNECT_TIMEOUT);
+        return;
+    }
+    if (state_ == AwaitingFirstByte && (now - phaseMs_) > deadlines_.firstByteMs)
+        fail(X4PAY_HTTP_ERROR_FIRST_BYTE_TIMEOUT);
+}
+
+void AsyncFacilitatorRequest::connect()
+{
+    if (state_ == Connecting)
+    {
+        STACK_CHECKPOINT("AsyncFacilitatorRequest::connect");
+
+        // The TCP connect itself is bounded by connectMs; the TLS handshake is stepped below
+        int32_t timeout = (int32_t)deadlines_.connectMs;
+        if (https_)
+        {
+            if (!secure_.beginConnect(host_.c_str(), port_, timeout))
+            {
+                fail(HTTPC_ERROR_CONNECTION_REFUSED);
+                return;
+            }
+            transport_ = &secure_;
+            state_ = Handshaking;
+        }
+        else
+        {
+            if (!plain_.connect(host_.c_str(), port_, timeout))
+            {
+                fail(HTTPC_ERROR_CONNECTION_REFUSED);
+                return;
+            }
+            transport_ = &plain_;
+            state_ = Sending;
+            phaseMs_ = millis();
+            return;
+        }
+    }
+
+    int ret = secure_.handshakeStep();
+    if (ret < 0)
+    {
+        fail(HTTPC_ERROR_CONNECTION_REFUSED);
+    }
+    else if (ret > 0)
+    {
+        state_ = Sending;
+        phaseMs_ = millis();
+    }
+}
+
+void AsyncFacilitatorRequest::send()
+{
+    // Head first, then the body segments staged through out_
+    while (headSent_ < head_.length())
+    {
+        size_t n = transport_->write((const uint8_t *)head_.c_str() + headSent_, head_.length() - headSent_);
+        if (n == 0)
+        {
+            if (!transport_->connected() && !retryOnFreshConnection(false))
+                fail(HTTPC_ERROR_SEND_HEADER_FAILED);
+            return;
+        }
+        headSent_ += n;
+    }
+
+    for (;;)
+    {
+        if (outPos_ == outLen_)
+        {
+            outLen_ = body_->readBytes((char *)out_, sizeof(out_));
+            outPos_ = 0;
+            if (outLen_ == 0)
+            {
+                state_ = AwaitingFirstByte;
+                phaseMs_ = millis();
+                return;
+            }
+        }
+        size_t n = transport_->write(out_ + outPos_, outLen_ - outPos_);
+        if (n == 0)
+        {
+            if (!transport_->connected() && !retryOnFreshConnection(false))
+                fail(HTTPC_ERROR_SEND_PAYLOAD_FAILED);
+            return;
+        }
+        outPos_ += n;
+    }
+}
+
+void AsyncFacilitatorRequest::receive()
+{
+    uint8_t buf[256];
+
+    // Drain what has arrived, but never wait for more
+    for (int reads = 0; reads < 8 && !finished(); ++reads)
+    {
+        int avail = transport_->available();
+        if (avail <= 0)
+        {
+            if (!transport_->connected())
+            {
+                if (state_ == ReadingBody && bodyMode_ == BodyUntilClose)
+                    complete();
+                else if (!retryOnFreshConnection(true))
+                    fail(HTTPC_ERROR_CONNECTION_LOST);
+            }
+            return;
+        }
+
+        int n = transport_->read(buf, (size_t)avail < sizeof(buf) ? (size_t)avail : sizeof(buf));
+        if (n <= 0)
+            return;
+
+        receivedAny_ = true;
+        if (state_ == AwaitingFirstByte)
+            state_ = ReadingHeaders;
+        if (!consume(buf, n))
+            return;
+    }
+}
+
+// Feed received bytes through the header/body state machine; false once the request finished
+bool AsyncFacilitatorRequest::consume(const uint8_t *data, size_t len)
+{
+    size_t i = 0;
+    while (i < len && !finished())
+    {
+        if (state_ == ReadingHeaders)
+        {
+            char c = (char)data[i++];
+            if (c == '\n')
+            {
+                if (lineLen_ > 0 && line_[lineLen_ - 1] == '\r')
+                    lineLen_--;
+                line_[lineLen_] = '\0';
+                if (!headerLine())
+                    return false;
+                lineLen_ = 0;
+            }
+            else if (lineLen_ < sizeof(line_) - 1)
+            {
+                line_[lineLen_++] = c; // longer header lines are truncated - only short ones matter
+            }
+        }
+        else
+        {
+            size_t used = 0;
+            if (!bodyBytes(data + i, len - i, used))
+                return false;
+            i += used;
+        }
+    }
+    return !finished();
+}
+
+bool AsyncFacilitatorRequest::headerLine()
+{
+    if (!statusLineSeen_)
+    {
+        const char *space = strchr(line_, ' ');
+        if (strncmp(line_, "HTTP/", 5) != 0 || !space)
+        {
+            fail(X4PAY_HTTP_ERROR_PROTOCOL);
+            return false;
+        }
+        statusCode_ = atoi(space + 1);
+        keepAlive_ = strncmp(line_, "HTTP/1.1", 8) == 0;
+        statusLineSeen_ = true;
+        return true;
+    }
+
+    if (lineLen_ == 0)
+    {
+        // Interim 1xx response - the real status line follows
+        if (statusCode_ >= 100 && statusCode_ < 200)
+        {
+            statusLineSeen_ = false;
+            return true;
+        }
+        if (statusCode_ == 204 || statusCode_ == 304 || (bodyMode_ == BodyLength && remaining_ == 0))
+        {
+            complete();
+            return false;
+        }
+        if (bodyMode_ == BodyUntilClose)
+            keepAlive_ = false;
+        state_ = ReadingBody;
+        chunkState_ = ChunkSize;
+        return true;
+    }
+
+    const char *colon = strchr(line_, ':');
+    if (!colon)
+        return true;
+    const char *value = colon + 1;
+    while (*value == ' ' || *value == '\t')
+        value++;
+
+    if (startsWithIgnoreCaseC(line_, "content-length:"))
+    {
+        if (bodyMode_ != BodyChunked)
+        {
+            bodyMode_ = BodyLength;
+            remaining_ = strtoul(value, nullptr, 10);
+        }
+    }
+    else if (startsWithIgnoreCaseC(line_, "transfer-encoding:"))
+    {
+        if (strcasestr(value, "chunked"))
+            bodyMode_ = BodyChunked;
+    }
+    else if (startsWithIgnoreCaseC(line_, "connection:"))
+    {
+        if (strcasestr(value, "close"))
+            keepAlive_ = false;
+        else if (strcasestr(value, "keep-alive"))
+            keepAlive_ = true;
+    }
+    return true;
+}
+
+bool AsyncFacilitatorRequest::bodyBytes(const uint8_t *data, size_t len, size_t &used)
+{
+    used = 0;
+    if (bodyMode_ == BodyUntilClose)
+    {
+        parser_.feed((const char *)data, len);
+        used = len;
+        return true;
+    }
+
+    if (bodyMode_ == BodyLength)
+    {
+        size_t take = len < remaining_ ? len : remaining_;
+        parser_.feed((const char *)data, take);
+        remaining_ -= take;
+        used = take;
+        if (remaining_ == 0)
+        {
+            complete();
+            return false;
+        }
+        return true;
+    }
+
+    // Chunked transfer coding
+    while (used < len)
+    {
+        if (chunkState_ == ChunkData)
+        {
+            size_t avail = len - used;
+            size_t take = avail < remaining_ ? avail : remaining_;
+            parser_.feed((const char *)data + used, take);
+            used += take;
+            remaining_ -= take;
+            if (remaining_ == 0)
+                chunkState_ = ChunkDataEnd;
+            continue;
+        }
+
+        char c = (char)data[used++];
+        if (chunkState_ == ChunkDataEnd)
+        {
+            if (c == '\n')
+            {
+                chunkState_ = ChunkSize;
+                lineLen_ = 0;
+            }
+            continue;
+        }
+
+        // Chunk-size and trailer lines
+        if (c != '\n')
+        {
+            if (c != '\r' && lineLen_ < sizeof(line_) - 1)
+                line_[lineLen_++] = c;
+            continue;
+        }
+        line_[lineLen_] = '\0';
+        size_t lineLen = lineLen_;
+        lineLen_ = 0;
+
+        if (chunkState_ == ChunkSize)
+        {
+            char *end = nullptr;
+            unsigned long size = strtoul(line_, &end, 16); // chunk extensions after ';' are ignored
+            if (end == line_)
+            {
+                fail(X4PAY_HTTP_ERROR_PROTOCOL);
+                return false;
+            }
+            if (size == 0)
+            {
+                chunkState_ = ChunkTrailer;
+            }
+            else
+            {
+                remaining_ = size;
+                chunkState_ = ChunkData;
+            }
+        }
+        else if (lineLen == 0)
+        {
+            // Blank line ends the trailer section
+            complete();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AsyncFacilitatorRequest::retryOnFreshConnection(bool requestSent)
+{
+    // A kept-alive connection may have been closed by the server while idle. Retry once on
+    // a new connection. A failed write means the facilitator never got a whole request;
+    // once it was all sent the facilitator may have acted on it, so only idempotent
+    // requests go out again (resending a settle could pay twice).
+    if (!reused_ || retried_ || receivedAny_)
+        return false;
+    if (requestSent && !idempotent_)
+        return false;
+
+    retried_ = true;
+    reused_ = false;
+    if (transport_)
+        transport_->stop();
+    transport_ = nullptr;
+
+    body_->rewind();
+    headSent_ = 0;
+    outLen_ = 0;
+    outPos_ = 0;
+    state_ = Connecting;
+    phaseMs_ = millis();
+    return true;
+}
+
+void AsyncFacilitatorRequest::complete()
+{
+    if (!parser_.finish())
+        parser_.result().malformed = true;
+    state_ = Done;
+    lastUsedMs_ = millis();
+    if (!keepAlive_)
+        close();
+}
+
+void AsyncFacilitatorRequest::fail(int code)
+{
+    statusCode_ = code;
+    state_ = Failed;
+    close();
+}
+
+void AsyncFacilitatorRequest::reset()
+{
+    state_ = Idle;
+    body_ = nullptr;
+}
+
+void AsyncFacilitatorRequest::close()
+{
+    if (transport_)
+        transport_->stop();
+    transport_ = nullptr;
+    origin_ = "";
+}
+
+HttpResponse AsyncFacilitatorRequest::response() const
+{
+    HttpResponse response;
+    response.statusCode = statusCode_;
+    response.success = state_ == Done && statusCode_ > 0;
+    return response;
+}
+
+AsyncFacilitatorClient::AsyncFacilitatorClient() : rootCA_(nullptr)
+{
+    deadlines_[FacilitatorVerify] = kDefaultVerifyDeadlines;
+    deadlines_[FacilitatorSettle] = kDefaultSettleDeadlines;
+}
+
+void AsyncFacilitatorClient::setDeadlines(FacilitatorEndpoint endpoint, const FacilitatorDeadlines &deadlines)
+{
+    if (endpoint < FacilitatorEndpointCount)
+        deadlines_[endpoint] = deadlines;
+}
+
+void AsyncFacilitatorClient::setCACert(const char *rootCA)
+{
+    rootCA_ = rootCA;
+    for (size_t i = 0; i < X4PAY_ASYNC_FACILITATOR_SLOTS; ++i)
+        slots_[i].setCACert(rootCA);
+}
+
+int AsyncFacilitatorClient::start(FacilitatorEndpoint endpoint, const String &url, SegmentedBodyStream &body,
+                                  const String &customHeaders)
+{
+    // Prefer a slot whose kept-alive connection already points at this origin
+    int chosen = -1;
+    for (size_t i = 0; i < X4PAY_ASYNC_FACILITATOR_SLOTS; ++i)
+    {
+        if (!slots_[i].idle())
+            continue;
+        if (slots_[i].canReuse(url))
+        {
+            chosen = (int)i;
+            break;
+        }
+        if (chosen < 0)
+            chosen = (int)i;
+    }
+    if (chosen < 0)
+        return -1;
+
+    if (!slots_[chosen].start(url, body, customHeaders, deadlines_[endpoint], endpoint == FacilitatorVerify))
+        return -1;
+    return chosen;
+}
+
+void AsyncFacilitatorClient::poll()
+{
+    for (size_t i = 0; i < X4PAY_ASYNC_FACILITATOR_SLOTS; ++i)
+    {
+        if (!slots_[i].idle() && !slots_[i].finished())
+            slots_[i].poll();
+    }
+}
+
+size_t AsyncFacilitatorClient::inFlight() const
+{
+    size_t count = 0;
+    for (size_t i = 0; i < X4PAY_ASYNC_FACILITATOR_SLOTS; ++i)
+    {
+        if (!slots_[i].idle())
+            ++count;
+    }
+    return count;
+}
@@ -0,0 +1,189 @@
+#ifndef ASYNC_FACILITATOR_CLIENT_H
+#define ASYNC_FACILITATOR_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include "ResumableTlsClient.h"
+#include "SegmentedBodyStream.h"
+#include "FacilitatorResponseParser.h"
+#include "httputils.h"
+
+// Requests one worker can keep in flight at once (each holds its own connection)
+#ifndef X4PAY_ASYNC_FACILITATOR_SLOTS
+#define X4PAY_ASYNC_FACILITATOR_SLOTS 2
+#endif
+
+// Idle time after which a kept-alive facilitator connection is closed
+#ifndef X4PAY_FACILITATOR_IDLE_TIMEOUT_MS
+#define X4PAY_FACILITATOR_IDLE_TIMEOUT_MS 30000
+#endif
+
+// Failures reported through statusCode(), next to HTTPClient's HTTPC_ERROR_* codes
+#define X4PAY_HTTP_ERROR_CONNECT_TIMEOUT (-20)
+#define X4PAY_HTTP_ERROR_FIRST_BYTE_TIMEOUT (-21)
+#define X4PAY_HTTP_ERROR_TOTAL_TIMEOUT (-22)
+#define X4PAY_HTTP_ERROR_PROTOCOL (-23)
+
+// Deadlines for one request, each measured in milliseconds
+struct FacilitatorDeadlines
+{
+    uint32_t connectMs;   // TCP connect + TLS handshake
+    uint32_t firstByteMs; // request fully sent -> first response byte
+    uint32_t totalMs;     // start -> response complete
+};
+
+enum FacilitatorEndpoint : uint8_t
+{
+    FacilitatorVerify = 0,
+    FacilitatorSettle,
+    FacilitatorEndpointCount
+};
+
+// One HTTP/1.1 POST advanced by poll(). Apart from the TCP connect (bounded by
+// connectMs) nothing waits on the network: every call does what is possible now and returns.
+class AsyncFacilitatorRequest
+{
+public:
+    enum State : uint8_t
+    {
+        Idle,
+        Connecting,
+        Handshaking,
+        Sending,
+        AwaitingFirstByte,
+        ReadingHeaders,
+        ReadingBody,
+        Done,
+        Failed
+    };
+
+    AsyncFacilitatorRequest();
+
+    // body must stay alive until the request has finished (headers are copied).
+    // idempotent requests (verify) may be sent again when a reused connection closes
+    // after the request went out; others (settle) are only resent if a write failed.
+    bool start(const String &url, SegmentedBodyStream &body, const String &customHeaders,
+               const FacilitatorDeadlines &deadlines, bool idempotent = false);
+
+    State poll();
+
+    // Back to Idle; a kept-alive connection stays open for the next start()
+    void reset();
+    // Drop the connection
+    void close();
+
+    void setCACert(const char *rootCA);
+
+    State state() const { return state_; }
+    bool finished() const { return state_ == Done || state_ == Failed; }
+    bool idle() const { return state_ == Idle; }
+
+    // HTTP status once Done, negative error code once Failed
+    int statusCode() const { return statusCode_; }
+    HttpResponse response() const;
+    const FacilitatorResult &result() const { return parser_.result(); }
+
+    // True when start() for this url would reuse the open connection
+    bool canReuse(const String &url) const;
+    bool reusedConnection() const { return reused_; }
+
+private:
+    enum BodyMode : uint8_t
+    {
+        BodyLength,
+        BodyChunked,
+        BodyUntilClose
+    };
+
+    enum ChunkState : uint8_t
+    {
+        ChunkSize,
+        ChunkData,
+        ChunkDataEnd,
+        ChunkTrailer
+    };
+
+    WiFiClient plain_;
+    ResumableTlsClient secure_;
+    WiFiClient *transport_; // open connection, nullptr if none
+    String origin_;         // scheme://host:port of transport_
+    String host_;
+    uint16_t port_;
+    bool https_;
+    uint32_t lastUsedMs_;
+
+    State state_;
+    FacilitatorDeadlines deadlines_;
+    uint32_t startedMs_;
+    uint32_t phaseMs_; // start of the current deadline phase
+    bool reused_;
+    bool retried_;
+    bool idempotent_;
+    bool receivedAny_;
+
+    // Outgoing request: head_ then the body stream, staged through out_
+    SegmentedBodyStream *body_;
+    String head_;
+    size_t headSent_;
+    uint8_t out_[256];
+    size_t outLen_;
+    size_t outPos_;
+
+    // Incoming response
+    FacilitatorResponseParser parser_;
+    int statusCode_;
+    char line_[128];
+    size_t lineLen_;
+    bool statusLineSeen_;
+    bool keepAlive_;
+    BodyMode bodyMode_;
+    ChunkState chunkState_;
+    size_t remaining_;
+
+    void connect();
+    void send();
+    void receive();
+    bool consume(const uint8_t *data, size_t len);
+    bool headerLine();
+    bool bodyBytes(const uint8_t *data, size_t len, size_t &used);
+    void complete();
+    void fail(int code);
+    bool retryOnFreshConnection(bool requestSent);
+    void checkDeadlines();
+};
+
+// Fixed set of request slots driven from one task.
+// Keeps several verify/settle requests in flight, each with its own connection and deadlines.
+class AsyncFacilitatorClient
+{
+public:
+    AsyncFacilitatorClient();
+
+    void setDeadlines(FacilitatorEndpoint endpoint, const FacilitatorDeadlines &deadlines);
+    const FacilitatorDeadlines &getDeadlines(FacilitatorEndpoint endpoint) const { return deadlines_[endpoint]; }
+
+    void setCACert(const char *rootCA);
+    const char *getCACert() const { return rootCA_; }
+
+    // Start a POST on a free slot (preferring one already connected to the origin); -1 if all are busy
+    int start(FacilitatorEndpoint endpoint, const String &url, SegmentedBodyStream &body,
+              const String &customHeaders = "");
+
+    // Advance every request that is in flight
+    void poll();
+
+    AsyncFacilitatorRequest &request(int slot) { return slots_[slot]; }
+
+    // Hand a finished slot back
+    void release(int slot) { slots_[slot].reset(); }
+
+    size_t inFlight() const;
+    static constexpr size_t capacity() { return X4PAY_ASYNC_FACILITATOR_SLOTS; }
+
+private:
+    AsyncFacilitatorRequest slots_[X4PAY_ASYNC_FACILITATOR_SLOTS];
+    FacilitatorDeadlines deadlines_[FacilitatorEndpointCount];
+    const char *rootCA_;
+};
+
+#endif // ASYNC_FACILITATOR_CLIENT_H
@@ -0,0 +1,79 @@
+#ifndef BLE_FRAME_H
+#define BLE_FRAME_H
+
+#include <Arduino.h>
+
+// Highest framed protocol version this device speaks (0 = text only).
+// Version 2 START chunks begin with the 2-byte total length of the request.
+#define X4PAY_FRAME_VERSION 2
+
+// Binary framing negotiated per connection with the text command "[PROTO]<version>".
+// Every write is one frame: opcode, sequence, flags, little-endian payload length, payload.
+// Opcodes start at 0x80 so a frame can never be mistaken for a text command.
+#define X4PAY_FRAME_HEADER_BYTES 5
+
+enum BleOpcode : uint8_t
+{
+    OpInfo = 0x80,    // price, payTo, network (the text protocol's default reply)
+    OpPayment = 0x81, // payment chunk: JSON--customContext--[options]
+    OpPrice = 0x82,   // price request chunk: customContext--[options]
+    OpLogo = 0x83,
+    OpBanner = 0x84,
+    OpDesc = 0x85,
+    OpConfig = 0x86,
+    OpOptions = 0x87,
+    OpLink = 0x88,    // negotiated MTU / PHY of this connection
+    OpResume = 0x89,  // resend the last fragmented response from the 2-byte offset in the payload
+    OpcodeEnd         // one past the last opcode; the dispatch table covers [OpInfo, OpcodeEnd)
+};
+
+enum BleFrameFlags : uint8_t
+{
+    FrameStart = 0x01,    // first chunk of a payment / price request
+    FrameEnd = 0x02,      // last chunk; the request is complete
+    FrameFragment = 0x04, // response split to fit the MTU; payload starts with a 2-byte offset
+    FrameError = 0x20,    // payload is an ERROR:... reply
+    FrameEvent = 0x40,    // unsolicited (payment result from the worker)
+    FrameResponse = 0x80  // sent by the device
+};
+
+struct BleFrame
+{
+    uint8_t opcode;
+    uint8_t sequence; // echoed in the response so the app can match it
+    uint8_t flags;
+    const uint8_t *payload;
+    uint16_t length;
+};
+
+// Ordering state of one chunked request (payment or price) on a framed connection
+struct BleChunkAssembly
+{
+    uint16_t total;       // declared length from the START chunk, 0 when not declared (version 1)
+    uint8_t nextSequence; // sequence the next chunk must carry
+    bool active;          // START seen, END not yet
+};
+
+// false if data is not a complete frame
+inline bool parseBleFrame(const uint8_t *data, size_t size, BleFrame &frame)
+{
+    if (size < X4PAY_FRAME_HEADER_BYTES || data[0] < OpInfo)
+        return false;
+    frame.opcode = data[0];
+    frame.sequence = data[1];
+    frame.flags = data[2];
+    frame.length = (uint16_t)(data[3] | (data[4] << 8));
+    frame.payload = data + X4PAY_FRAME_HEADER_BYTES;
+    return frame.length == size - X4PAY_FRAME_HEADER_BYTES;
+}
+
+inline void writeBleFrameHeader(uint8_t *out, uint8_t opcode, uint8_t sequence, uint8_t flags, uint16_t length)
+{
+    out[0] = opcode;
+    out[1] = sequence;
+    out[2] = flags;
+    out[3] = (uint8_t)(length & 0xFF);
+    out[4] = (uint8_t)(length >> 8);
+}
+
+#endif // BLE_FRAME_H
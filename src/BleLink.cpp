@@ -0,0 +1,131 @@
+#include "BleLink.h"
+
+BleLinkTable::Link BleLinkTable::links_[X4PAY_MAX_LINKS] = {};
+SemaphoreHandle_t BleLinkTable::lock_ = nullptr;
+
+void BleLinkTable::lock()
+{
+    if (lock_)
+        xSemaphoreTake(lock_, portMAX_DELAY);
+}
+
+void BleLinkTable::unlock()
+{
+    if (lock_)
+        xSemaphoreGive(lock_);
+}
+
+BleLinkTable::Link *BleLinkTable::findLocked(uint16_t connHandle)
+{
+    for (size_t i = 0; i < X4PAY_MAX_LINKS; ++i)
+    {
+        if (links_[i].used && links_[i].info.connHandle == connHandle)
+            return &links_[i];
+    }
+    return nullptr;
+}
+
+void BleLinkTable::begin()
+{
+    if (!lock_)
+        lock_ = xSemaphoreCreateMutex();
+    for (size_t i = 0; i < X4PAY_MAX_LINKS; ++i)
+        links_[i].used = false;
+}
+
+void BleLinkTable::open(NimBLEServer *server, uint16_t connHandle, uint16_t mtu)
+{
+    // Longer link-layer packets and the faster PHY, where the central agrees.
+    // The MTU itself is exchanged by the central (client side), up to X4PAY_BLE_MTU.
+    if (server)
+    {
+#if X4PAY_BLE_DATA_LENGTH > 27
+        server->setDataLen(connHandle, X4PAY_BLE_DATA_LENGTH);
+#endif
+#if X4PAY_BLE_2M_PHY
+        server->updatePhy(connHandle, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_2M_MASK, 0);
+#endif
+    }
+
+    lock();
+    Link *link = findLocked(connHandle);
+    for (size_t i = 0; !link && i < X4PAY_MAX_LINKS; ++i)
+    {
+        if (!links_[i].used)
+            link = &links_[i];
+    }
+    if (link)
+    {
+        link->used = true;
+        link->info.connHandle = connHandle;
+        link->info.mtu = mtu >= X4PAY_BLE_DEFAULT_MTU ? mtu : X4PAY_BLE_DEFAULT_MTU;
+        link->info.maxPayload = link->info.mtu - 3;
+        link->info.dataLength = X4PAY_BLE_DATA_LENGTH;
+        link->info.txPhy = BLE_GAP_LE_PHY_1M; // until the PHY update completes
+        link->info.rxPhy = BLE_GAP_LE_PHY_1M;
+        link->info.connectedMs = millis();
+    }
+    unlock();
+}
+
+void BleLinkTable::close(uint16_t connHandle)
+{
+    lock();
+    Link *link = findLocked(connHandle);
+    if (link)
+        link->used = false;
+    unlock();
+}
+
+void BleLinkTable::setMtu(uint16_t connHandle, uint16_t mtu)
+{
+    lock();
+    Link *link = findLocked(connHandle);
+    if (link && mtu >= X4PAY_BLE_DEFAULT_MTU)
+    {
+        link->info.mtu = mtu;
+        link->info.maxPayload = mtu - 3;
+    }
+    unlock();
+}
+
+void BleLinkTable::setPhy(uint16_t connHandle, uint8_t txPhy, uint8_t rxPhy)
+{
+    lock();
+    Link *link = findLocked(connHandle);
+    if (link)
+    {
+        link->info.txPhy = txPhy;
+        link->info.rxPhy = rxPhy;
+    }
+    unlock();
+}
+
+bool BleLinkTable::get(uint16_t connHandle, BleLinkInfo &info)
+{
+    lock();
+    Link *link = findLocked(connHandle);
+    if (link)
+        info = link->info;
+    unlock();
+    return link != nullptr;
+}
+
+size_t BleLinkTable::list(BleLinkInfo *out, size_t max)
+{
+    size_t count = 0;
+    lock();
+    for (size_t i = 0; i < X4PAY_MAX_LINKS && count < max; ++i)
+    {
+        if (links_[i].used)
+            out[count++] = links_[i].info;
+    }
+    unlock();
+    return count;
+}
+
+uint16_t BleLinkTable::maxPayload(uint16_t connHandle)
+{
+    BleLinkInfo info;
+    return get(connHandle, info) ? info.maxPayload : X4PAY_BLE_DEFAULT_MTU - 3;
+}
@@ -0,0 +1,85 @@
+#ifndef BLE_LINK_H
+#define BLE_LINK_H
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "PaymentSession.h"
+
+// ATT MTU offered to centrals (517 = largest attribute value 512 + headers)
+#ifndef X4PAY_BLE_MTU
+#define X4PAY_BLE_MTU 517
+#endif
+
+// LE Data Length Extension: link-layer payload requested per connection (27 disables)
+#ifndef X4PAY_BLE_DATA_LENGTH
+#define X4PAY_BLE_DATA_LENGTH 251
+#endif
+
+// Ask for the 2M PHY on every connection. The original ESP32 controller only has 1M.
+#ifndef X4PAY_BLE_2M_PHY
+#if defined(CONFIG_IDF_TARGET_ESP32)
+#define X4PAY_BLE_2M_PHY 0
+#else
+#define X4PAY_BLE_2M_PHY 1
+#endif
+#endif
+
+// Connections tracked at once (one per central that can hold a payment session)
+#ifndef X4PAY_MAX_LINKS
+#define X4PAY_MAX_LINKS X4PAY_MAX_SESSIONS
+#endif
+
+// Default ATT MTU before the central exchanges a larger one
+#define X4PAY_BLE_DEFAULT_MTU 23
+
+struct BleLinkInfo
+{
+    uint16_t connHandle;
+    uint16_t mtu;         // negotiated ATT MTU
+    uint16_t maxPayload;  // largest write / notification value (mtu - 3)
+    uint16_t dataLength;  // link-layer payload requested (DLE)
+    uint8_t txPhy;        // 1 = 1M, 2 = 2M, 3 = coded
+    uint8_t rxPhy;
+    uint32_t connectedMs; // millis() at connect
+};
+
+// Link parameters of each connected central, kept current by the server callbacks.
+// Writers and notifications size their chunks from maxPayload.
+class BleLinkTable
+{
+public:
+    static void begin();
+
+    // Request DLE and 2M PHY for a new connection and start tracking it
+    static void open(NimBLEServer *server, uint16_t connHandle, uint16_t mtu);
+    static void close(uint16_t connHandle);
+
+    static void setMtu(uint16_t connHandle, uint16_t mtu);
+    static void setPhy(uint16_t connHandle, uint8_t txPhy, uint8_t rxPhy);
+
+    // false when the connection is not tracked
+    static bool get(uint16_t connHandle, BleLinkInfo &info);
+    // Copies up to max links into out, returns how many
+    static size_t list(BleLinkInfo *out, size_t max);
+
+    // Largest value that fits one write / notification on this connection
+    static uint16_t maxPayload(uint16_t connHandle);
+
+private:
+    struct Link
+    {
+        BleLinkInfo info;
+        bool used;
+    };
+
+    static Link links_[X4PAY_MAX_LINKS];
+    static SemaphoreHandle_t lock_;
+
+    static Link *findLocked(uint16_t connHandle);
+    static void lock();
+    static void unlock();
+};
+
+#endif // BLE_LINK_H
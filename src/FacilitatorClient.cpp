@@ -0,0 +1,352 @@
+#include "FacilitatorClient.h"
+#include "stackmonitor.h"
+
+// Write-only Stream that hands the (de-chunked) response body to the parser
+class ParserSink : public Stream
+{
+public:
+    explicit ParserSink(FacilitatorResponseParser &parser) : parser_(parser) {}
+
+    size_t write(uint8_t c) override
+    {
+        char ch = (char)c;
+        parser_.feed(&ch, 1);
+        return 1;
+    }
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        parser_.feed((const char *)buf, size);
+        return size;
+    }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    void flush() override {}
+
+private:
+    FacilitatorResponseParser &parser_;
+};
+
+FacilitatorClient::FacilitatorClient(uint32_t idleTimeoutMs)
+    : active_(nullptr), lastUsedMs_(0), idleTimeoutMs_(idleTimeoutMs), rootCA_(nullptr),
+      stats_{0, 0, 0, 0, 0}
+{
+    lock_ = xSemaphoreCreateMutex();
+
+    // Keep the socket open between requests (HTTP/1.1 keep-alive)
+    http_.setReuse(true);
+
+    // HTTPClient only follows redirects for in-memory payloads; streamed bodies are
+    // re-sent by execute() instead, so it needs to see the Location header
+    http_.setFollowRedirects(HTTPC_DISABLE_FOLLOW_REDIRECTS);
+    static const char *redirectHeaders[] = {"Location"};
+    http_.collectHeaders(redirectHeaders, 1);
+
+    // Set timeout to 60 seconds for blockchain operations (settle can take 30-45s)
+    http_.setTimeout(60000); // 60 seconds in milliseconds
+
+    secure_.setInsecure();
+}
+
+FacilitatorClient::~FacilitatorClient()
+{
+    close();
+    if (lock_)
+        vSemaphoreDelete(lock_);
+}
+
+FacilitatorClient &FacilitatorClient::shared()
+{
+    static FacilitatorClient client;
+    return client;
+}
+
+static thread_local FacilitatorClient *s_taskClient = nullptr;
+
+FacilitatorClient &FacilitatorClient::current()
+{
+    return s_taskClient ? *s_taskClient : shared();
+}
+
+void FacilitatorClient::bindToCurrentTask(FacilitatorClient *client)
+{
+    s_taskClient = client;
+}
+
+void FacilitatorClient::setCACert(const char *rootCA)
+{
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    rootCA_ = rootCA;
+    if (rootCA_)
+        secure_.setCACert(rootCA_);
+    else
+        secure_.setInsecure();
+    // A new trust anchor only applies to new handshakes
+    if (active_)
+    {
+        active_->stop();
+        active_ = nullptr;
+        origin_ = "";
+    }
+    xSemaphoreGive(lock_);
+}
+
+void FacilitatorClient::close()
+{
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    if (active_)
+    {
+        active_->stop();
+        active_ = nullptr;
+    }
+    origin_ = "";
+    xSemaphoreGive(lock_);
+}
+
+// Length of the "https://host:port" prefix of url
+size_t FacilitatorClient::originLength(const char *url, bool &https)
+{
+    https = strncmp(url, "https://", 8) == 0;
+    const char *host = strstr(url, "://");
+    host = host ? host + 3 : url;
+    const char *path = strchr(host, '/');
+    return path ? (size_t)(path - url) : strlen(url);
+}
+
+bool FacilitatorClient::isRedirect(int code)
+{
+    return code == 301 || code == 302 || code == 307 || code == 308;
+}
+
+// Errors raised before the whole request went out - safe to retry on a fresh connection.
+// CONNECTION_LOST is not one: HTTPClient reports it while waiting for the response, when
+// the facilitator may already have acted on the request (a resent /settle could pay twice).
+bool FacilitatorClient::isConnectionError(int code)
+{
+    return code == HTTPC_ERROR_CONNECTION_REFUSED ||
+           code == HTTPC_ERROR_SEND_HEADER_FAILED ||
+           code == HTTPC_ERROR_SEND_PAYLOAD_FAILED ||
+           code == HTTPC_ERROR_NOT_CONNECTED;
+}
+
+void FacilitatorClient::expireConnection(const char *url, size_t originLength)
+{
+    if (!active_)
+        return;
+
+    bool idle = (millis() - lastUsedMs_) > idleTimeoutMs_;
+    bool otherOrigin = origin_.length() != originLength || strncmp(origin_.c_str(), url, originLength) != 0;
+    if (idle || otherOrigin || !active_->connected())
+    {
+        active_->stop();
+        active_ = nullptr;
+        origin_ = "";
+    }
+}
+
+int FacilitatorClient::send(const char *url, WiFiClient &transport, SegmentedBodyStream &body, const String &customHeaders)
+{
+    // HTTPClient keeps its own copy of the URL; ours stays in the caller's buffer
+    if (!http_.begin(transport, url))
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+
+    // Default content type
+    http_.addHeader("Content-Type", "application/json");
+    addCustomHeaders(http_, customHeaders);
+
+    // Body is copied from the segments straight into the socket buffer
+    body.rewind();
+    return http_.sendRequest("POST", &body, body.size());
+}
+
+HttpResponse FacilitatorClient::post(const String &url, const String &jsonPayload, const String &customHeaders)
+{
+    SegmentedBodyStream body;
+    body.append(jsonPayload);
+    return post(url.c_str(), body, customHeaders);
+}
+
+HttpResponse FacilitatorClient::post(const char *url, SegmentedBodyStream &body, const String &customHeaders)
+{
+    return execute(url, body, customHeaders, nullptr);
+}
+
+HttpResponse FacilitatorClient::post(const char *url, SegmentedBodyStream &body, FacilitatorResponseParser &parser,
+                                     const String &customHeaders)
+{
+    return execute(url, body, customHeaders, &parser);
+}
+
+HttpResponse FacilitatorClient::execute(const char *url, SegmentedBodyStream &body, const String &customHeaders,
+                                        FacilitatorResponseParser *parser)
+{
+    STACK_CHECKPOINT("FacilitatorClient::post:start");
+
+    HttpResponse response;
+
+    // Initialize response with minimal memory allocation
+    response.success = false;
+    response.statusCode = 0;
+    response.body = "";
+
+    xSemaphoreTake(lock_, portMAX_DELAY);
+
+    const char *target = url;
+    String location; // only used once redirected
+    bool https = false;
+    size_t originLen = 0;
+    WiFiClient *transport = nullptr;
+    bool reused = false;
+    int httpResponseCode = 0;
+
+    for (uint8_t redirects = 0;; redirects++)
+    {
+        originLen = originLength(target, https);
+        expireConnection(target, originLen);
+
+        transport = https ? static_cast<WiFiClient *>(&secure_) : &plain_;
+        reused = active_ != nullptr;
+        stats_.requests++;
+
+        httpResponseCode = send(target, *transport, body, customHeaders);
+
+        // The server may have closed a kept-alive socket while we were idle; retry once fresh
+        if (reused && isConnectionError(httpResponseCode))
+        {
+            http_.end();
+            transport->stop();
+            stats_.reconnects++;
+            reused = false;
+            httpResponseCode = send(target, *transport, body, customHeaders);
+        }
+
+        if (!isRedirect(httpResponseCode) || redirects >= X4PAY_FACILITATOR_MAX_REDIRECTS)
+            break;
+
+        String next = http_.header("Location");
+        if (next.length() == 0)
+            break;
+
+        // The redirect body is never read, so this socket can't carry the next request
+        http_.end();
+        transport->stop();
+        active_ = nullptr;
+        origin_ = "";
+        stats_.redirects++;
+
+        if (next.startsWith("/"))
+        {
+            String absolute;
+            absolute.concat(target, originLen);
+            absolute += next;
+            location = absolute;
+        }
+        else
+        {
+            location = next;
+        }
+        target = location.c_str();
+        Serial.print("Facilitator redirected to ");
+        Serial.println(location);
+    }
+
+    STACK_CHECKPOINT("FacilitatorClient::post:after_post");
+
+    if (reused)
+        stats_.connectionsReused++;
+    else if (httpResponseCode > 0)
+        stats_.connectionsOpened++;
+
+    // Set response data
+    response.statusCode = httpResponseCode;
+
+    if (httpResponseCode > 0 && parser)
+    {
+        // Parse while reading - the body is never held in memory
+        parser->reset();
+        ParserSink sink(*parser);
+        int written = http_.writeToStream(&sink);
+        bool parsed = parser->finish();
+        response.success = written >= 0 && parsed && (httpResponseCode >= 200 && httpResponseCode < 300);
+        if (written < 0)
+            httpResponseCode = written; // body lost mid-way; don't reuse the socket
+    }
+    else if (httpResponseCode > 0)
+    {
+        response.body.reserve(512); // Pre-allocate expected response size
+        response.body = http_.getString();
+        response.success = (httpResponseCode >= 200 && httpResponseCode < 300);
+    }
+
+    // end() keeps the socket open when the server allowed keep-alive
+    http_.end();
+
+    if (httpResponseCode > 0 && transport->connected())
+    {
+        if (!reused)
+        {
+            // Reuses origin_'s buffer; steady-state requests don't allocate here
+            origin_ = "";
+            origin_.concat(target, originLen);
+        }
+        active_ = transport;
+        lastUsedMs_ = millis();
+    }
+    else
+    {
+        // Failed or server sent "Connection: close" - start fresh next time
+        transport->stop();
+        active_ = nullptr;
+        origin_ = "";
+    }
+
+    xSemaphoreGive(lock_);
+
+    STACK_CHECKPOINT("FacilitatorClient::post:end");
+
+    return response;
+}
+
+// Add custom headers if provided - Memory optimized
+void addCustomHeaders(HTTPClient &http, const String &customHeaders)
+{
+    if (customHeaders.length() == 0)
+        return;
+
+    int startIndex = 0;
+    int endIndex = customHeaders.indexOf('\n');
+
+    while (startIndex < customHeaders.length())
+    {
+        String headerLine;
+        headerLine.reserve(100); // Pre-allocate for header line
+
+        if (endIndex == -1)
+        {
+            headerLine = customHeaders.substring(startIndex);
+            startIndex = customHeaders.length();
+        }
+        else
+        {
+            headerLine = customHeaders.substring(startIndex, endIndex);
+            startIndex = endIndex + 1;
+            endIndex = customHeaders.indexOf('\n', startIndex);
+        }
+
+        // Parse individual header (format: "HeaderName: HeaderValue")
+        int colonIndex = headerLine.indexOf(':');
+        if (colonIndex > 0)
+        {
+            String headerName = headerLine.substring(0, colonIndex);
+            String headerValue = headerLine.substring(colonIndex + 1);
+            headerName.trim();
+            headerValue.trim();
+            http.addHeader(headerName, headerValue);
+
+            // Free memory immediately
+            headerName = "";
+            headerValue = "";
+        }
+        headerLine = ""; // Free memory
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef FACILITATOR_CLIENT_H
+#define FACILITATOR_CLIENT_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <WiFiClient.h>
+#include "ResumableTlsClient.h"
+#include "SegmentedBodyStream.h"
+#include "FacilitatorResponseParser.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "httputils.h"
+
+// Idle time after which a kept-alive facilitator connection is closed
+#ifndef X4PAY_FACILITATOR_IDLE_TIMEOUT_MS
+#define X4PAY_FACILITATOR_IDLE_TIMEOUT_MS 30000
+#endif
+
+// Redirect hops followed per request before the 3xx is returned to the caller
+#ifndef X4PAY_FACILITATOR_MAX_REDIRECTS
+#define X4PAY_FACILITATOR_MAX_REDIRECTS 5
+#endif
+
+struct FacilitatorClientStats
+{
+    uint32_t requests;           // POSTs issued
+    uint32_t connectionsOpened;  // fresh TCP (+TLS) connections
+    uint32_t connectionsReused;  // requests served on a kept-alive connection
+    uint32_t reconnects;         // retries after a stale kept-alive connection failed
+    uint32_t redirects;          // 3xx hops re-sent to the Location target
+};
+
+// Long-lived HTTP/1.1 client for the facilitator.
+// Keeps one connection open across verify/settle and across payments so the
+// TCP + TLS handshake is paid once instead of on every request.
+class FacilitatorClient
+{
+public:
+    explicit FacilitatorClient(uint32_t idleTimeoutMs = X4PAY_FACILITATOR_IDLE_TIMEOUT_MS);
+    ~FacilitatorClient();
+
+    // POST a JSON body, reusing the open connection when it targets the same origin
+    HttpResponse post(const String &url, const String &jsonPayload, const String &customHeaders = "");
+
+    // POST a body streamed from borrowed segments with a precomputed Content-Length
+    HttpResponse post(const char *url, SegmentedBodyStream &body, const String &customHeaders = "");
+    HttpResponse post(const String &url, SegmentedBodyStream &body, const String &customHeaders = "")
+    {
+        return post(url.c_str(), body, customHeaders);
+    }
+
+    // POST and feed the reply straight into parser instead of buffering it; response.body stays empty
+    HttpResponse post(const char *url, SegmentedBodyStream &body, FacilitatorResponseParser &parser,
+                      const String &customHeaders = "");
+    HttpResponse post(const String &url, SegmentedBodyStream &body, FacilitatorResponseParser &parser,
+                      const String &customHeaders = "")
+    {
+        return post(url.c_str(), body, parser, customHeaders);
+    }
+
+    // Close the kept-alive connection
+    void close();
+
+    void setIdleTimeout(uint32_t ms) { idleTimeoutMs_ = ms; }
+    uint32_t getIdleTimeout() const { return idleTimeoutMs_; }
+
+    // Root CA used to validate the facilitator; without one the certificate is not checked
+    void setCACert(const char *rootCA);
+    const char *getCACert() const { return rootCA_; }
+
+    const FacilitatorClientStats &getStats() const { return stats_; }
+
+    // TLS session resumption hit/miss counters for facilitator reconnects
+    TlsSessionCacheStats getTlsSessionStats() const { return TlsSessionCache::shared().getStats(); }
+
+    // Process-wide client used by postJson
+    static FacilitatorClient &shared();
+
+    // Client postJson uses on the calling task: the one bound with bindToCurrentTask, else shared().
+    // Lets parallel verify workers keep separate connections instead of queueing on one.
+    static FacilitatorClient &current();
+    static void bindToCurrentTask(FacilitatorClient *client);
+
+private:
+    HTTPClient http_;
+    WiFiClient plain_;
+    ResumableTlsClient secure_; // resumes TLS sessions from TlsSessionCache::shared()
+    WiFiClient *active_;        // transport currently holding the connection
+    String origin_;             // scheme://host:port of the open connection
+    uint32_t lastUsedMs_;
+    uint32_t idleTimeoutMs_;
+    const char *rootCA_;
+    FacilitatorClientStats stats_;
+    SemaphoreHandle_t lock_;
+
+    // Drop the connection if it has been idle too long or points at another origin
+    void expireConnection(const char *url, size_t originLength);
+    HttpResponse execute(const char *url, SegmentedBodyStream &body, const String &customHeaders,
+                         FacilitatorResponseParser *parser);
+    int send(const char *url, WiFiClient &transport, SegmentedBodyStream &body, const String &customHeaders);
+    static size_t originLength(const char *url, bool &https);
+    static bool isConnectionError(int code);
+    static bool isRedirect(int code);
+};
+
+// Parse "Name: Value\n..." header lines into the request
+void addCustomHeaders(HTTPClient &http, const String &customHeaders);
+
+#endif // FACILITATOR_CLIENT_H
@@ -0,0 +1,463 @@
+#include "FacilitatorResponseParser.h"
+#include <string.h>
+
+static const uint8_t kMaxDepth = 32; // one bit per level in objectMask_
+static const uint8_t kItemsDepth = 2; // root object -> walked array
+
+void FacilitatorResult::clear()
+{
+    memset(this, 0, sizeof(*this));
+}
+
+FacilitatorResponseParser::FacilitatorResponseParser()
+    : itemsKey_(nullptr), onItem_(nullptr), itemContext_(nullptr)
+{
+    reset();
+}
+
+void FacilitatorResponseParser::walkItems(const char *member, ItemCallback onItem, void *context)
+{
+    itemsKey_ = member;
+    onItem_ = onItem;
+    itemContext_ = context;
+}
+
+void FacilitatorResponseParser::reset()
+{
+    result_.clear();
+    state_ = Idle;
+    depth_ = 0;
+    objectMask_ = 0;
+    expectKey_ = false;
+    stringIsKey_ = false;
+    field_ = FieldNone;
+    keyLen_ = 0;
+    keyOverflow_ = false;
+    target_ = nullptr;
+    targetCap_ = 0;
+    targetLen_ = 0;
+    unicode_ = 0;
+    unicodeDigits_ = 0;
+    highSurrogate_ = 0;
+    literalLen_ = 0;
+    started_ = false;
+    item_.clear();
+    capture_ = &result_;
+    captureDepth_ = 1;
+    inItems_ = false;
+    itemIndex_ = 0;
+}
+
+bool FacilitatorResponseParser::inObject() const
+{
+    return depth_ > 0 && ((objectMask_ >> (depth_ - 1)) & 1u);
+}
+
+FacilitatorResponseParser::Field FacilitatorResponseParser::resolveKey() const
+{
+    if (strcmp(key_, "isValid") == 0)
+        return FieldIsValid;
+    if (strcmp(key_, "success") == 0)
+        return FieldSuccess;
+    if (strcmp(key_, "invalidReason") == 0)
+        return FieldInvalidReason;
+    if (strcmp(key_, "errorReason") == 0)
+        return FieldErrorReason;
+    if (strcmp(key_, "transaction") == 0)
+        return FieldTransaction;
+    if (strcmp(key_, "payer") == 0)
+        return FieldPayer;
+    if (strcmp(key_, "network") == 0)
+        return FieldNetwork;
+    if (itemsKey_ && depth_ == 1 && strcmp(key_, itemsKey_) == 0)
+        return FieldItems;
+    return FieldNone;
+}
+
+void FacilitatorResponseParser::beginString()
+{
+    state_ = InString;
+    stringIsKey_ = inObject() && expectKey_;
+    target_ = nullptr;
+    targetLen_ = 0;
+
+    if (stringIsKey_)
+    {
+        keyLen_ = 0;
+        keyOverflow_ = false;
+        return;
+    }
+
+    // Only values of top-level members (or of the walked items) are captured
+    if (depth_ != captureDepth_ || !inObject())
+        return;
+
+    switch (field_)
+    {
+    case FieldInvalidReason:
+        target_ = capture_->invalidReason;
+        targetCap_ = sizeof(capture_->invalidReason);
+        break;
+    case FieldErrorReason:
+        target_ = capture_->errorReason;
+        targetCap_ = sizeof(capture_->errorReason);
+        break;
+    case FieldTransaction:
+        target_ = capture_->transaction;
+        targetCap_ = sizeof(capture_->transaction);
+        break;
+    case FieldPayer:
+        target_ = capture_->payer;
+        targetCap_ = sizeof(capture_->payer);
+        break;
+    case FieldNetwork:
+        target_ = capture_->network;
+        targetCap_ = sizeof(capture_->network);
+        break;
+    default:
+        break;
+    }
+}
+
+void FacilitatorResponseParser::appendString(char c)
+{
+    if (stringIsKey_)
+    {
+        if (keyLen_ < sizeof(key_) - 1)
+            key_[keyLen_++] = c;
+        else
+            keyOverflow_ = true;
+        return;
+    }
+
+    if (!target_)
+        return;
+    if (targetLen_ < targetCap_ - 1)
+        target_[targetLen_++] = c;
+    else
+        capture_->truncated = true;
+}
+
+// UTF-8 encode a decoded \u escape; a character that doesn't fit whole ends the capture
+void FacilitatorResponseParser::appendCodePoint(uint32_t cp)
+{
+    char bytes[4];
+    size_t n;
+    if (cp < 0x80)
+    {
+        bytes[0] = (char)cp;
+        n = 1;
+    }
+    else if (cp < 0x800)
+    {
+        bytes[0] = (char)(0xC0 | (cp >> 6));
+        bytes[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    }
+    else if (cp < 0x10000)
+    {
+        bytes[0] = (char)(0xE0 | (cp >> 12));
+        bytes[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        bytes[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    }
+    else
+    {
+        bytes[0] = (char)(0xF0 | (cp >> 18));
+        bytes[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        bytes[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        bytes[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+
+    if (!stringIsKey_ && target_ && targetLen_ + n > targetCap_ - 1)
+    {
+        capture_->truncated = true;
+        targetCap_ = targetLen_ + 1;
+        return;
+    }
+    for (size_t i = 0; i < n; ++i)
+        appendString(bytes[i]);
+}
+
+void FacilitatorResponseParser::endUnicode()
+{
+    state_ = InString;
+    uint32_t unit = unicode_;
+
+    if (highSurrogate_)
+    {
+        uint16_t high = highSurrogate_;
+        highSurrogate_ = 0;
+        if (unit >= 0xDC00 && unit <= 0xDFFF)
+        {
+            appendCodePoint(0x10000 + (((uint32_t)high - 0xD800) << 10) + (unit - 0xDC00));
+            return;
+        }
+        appendCodePoint(0xFFFD); // unpaired high surrogate
+    }
+
+    if (unit >= 0xD800 && unit <= 0xDBFF)
+        highSurrogate_ = (uint16_t)unit; // wait for the low half
+    else if (unit >= 0xDC00 && unit <= 0xDFFF)
+        appendCodePoint(0xFFFD);
+    else
+        appendCodePoint(unit);
+}
+
+void FacilitatorResponseParser::endString()
+{
+    if (highSurrogate_)
+    {
+        highSurrogate_ = 0;
+        appendCodePoint(0xFFFD);
+    }
+
+    state_ = Idle;
+    if (stringIsKey_)
+    {
+        key_[keyLen_] = '\0';
+        field_ = keyOverflow_ ? FieldNone : resolveKey();
+        return;
+    }
+
+    if (target_)
+    {
+        target_[targetLen_] = '\0';
+        target_ = nullptr;
+    }
+    field_ = FieldNone;
+
+    if (inItems_ && depth_ == kItemsDepth)
+    {
+        item_.clear();
+        endItem();
+    }
+}
+
+void FacilitatorResponseParser::endLiteral()
+{
+    state_ = Idle;
+    literal_[literalLen_] = '\0';
+
+    if (depth_ == captureDepth_ && inObject())
+    {
+        bool isTrue = strcmp(literal_, "true") == 0;
+        bool isFalse = strcmp(literal_, "false") == 0;
+        if (isTrue || isFalse)
+        {
+            if (field_ == FieldIsValid)
+            {
+                capture_->hasIsValid = true;
+                capture_->isValid = isTrue;
+            }
+            else if (field_ == FieldSuccess)
+            {
+                capture_->hasSuccess = true;
+                capture_->success = isTrue;
+            }
+        }
+    }
+    field_ = FieldNone;
+
+    if (inItems_ && depth_ == kItemsDepth)
+    {
+        item_.clear();
+        endItem();
+    }
+}
+
+void FacilitatorResponseParser::endItem()
+{
+    if (onItem_)
+        onItem_(itemContext_, itemIndex_, item_);
+    itemIndex_++;
+    capture_ = &result_;
+    captureDepth_ = 1;
+}
+
+static bool isLiteralChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '-' || c == '+' || c == '.';
+}
+
+void FacilitatorResponseParser::step(char c)
+{
+    switch (state_)
+    {
+    case InString:
+        if (highSurrogate_ && c != '\\')
+        {
+            highSurrogate_ = 0;
+            appendCodePoint(0xFFFD);
+        }
+        if (c == '\\')
+            state_ = InEscape;
+        else if (c == '"')
+            endString();
+        else
+            appendString(c);
+        return;
+
+    case InEscape:
+        // \" \\ \/ map to themselves; \uXXXX is decoded to UTF-8
+        switch (c)
+        {
+        case 'n': c = '\n'; break;
+        case 't': c = '\t'; break;
+        case 'r': c = '\r'; break;
+        case 'b': c = '\b'; break;
+        case 'f': c = '\f'; break;
+        case 'u':
+            state_ = InUnicode;
+            unicode_ = 0;
+            unicodeDigits_ = 0;
+            return;
+        default: break;
+        }
+        if (highSurrogate_)
+        {
+            highSurrogate_ = 0;
+            appendCodePoint(0xFFFD);
+        }
+        appendString(c);
+        state_ = InString;
+        return;
+
+    case InUnicode:
+    {
+        int digit = -1;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        if (digit < 0)
+        {
+            result_.malformed = true;
+            return;
+        }
+        unicode_ = (unicode_ << 4) | (uint32_t)digit;
+        if (++unicodeDigits_ == 4)
+            endUnicode();
+        return;
+    }
+
+    case InLiteral:
+        if (isLiteralChar(c))
+        {
+            if (literalLen_ < sizeof(literal_) - 1)
+                literal_[literalLen_++] = c;
+            return;
+        }
+        endLiteral();
+        break; // c terminates the literal and is handled below
+
+    case Idle:
+        break;
+    }
+
+    switch (c)
+    {
+    case '{':
+    case '[':
+        if (depth_ >= kMaxDepth)
+        {
+            result_.malformed = true;
+            return;
+        }
+        if (c == '{')
+            objectMask_ |= (1u << depth_);
+        else
+            objectMask_ &= ~(1u << depth_);
+
+        if (inItems_ && depth_ == kItemsDepth)
+        {
+            // Next element of the walked array
+            item_.clear();
+            capture_ = &item_;
+            captureDepth_ = kItemsDepth + 1;
+        }
+        else if (c == '[' && depth_ == 1 && field_ == FieldItems)
+        {
+            inItems_ = true;
+        }
+        depth_++;
+        started_ = true;
+        expectKey_ = (c == '{');
+        field_ = FieldNone; // nested values are never captured
+        return;
+
+    case '}':
+    case ']':
+        if (depth_ == 0)
+        {
+            result_.malformed = true;
+            return;
+        }
+        depth_--;
+        expectKey_ = false;
+        field_ = FieldNone;
+        if (inItems_ && depth_ == kItemsDepth)
+            endItem();
+        else if (inItems_ && depth_ == kItemsDepth - 1)
+            inItems_ = false;
+        return;
+
+    case ':':
+        expectKey_ = false;
+        return;
+
+    case ',':
+        expectKey_ = inObject();
+        field_ = FieldNone;
+        return;
+
+    case '"':
+        beginString();
+        return;
+
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+        return;
+
+    default:
+        if (isLiteralChar(c))
+        {
+            state_ = InLiteral;
+            literalLen_ = 0;
+            literal_[literalLen_++] = c;
+            return;
+        }
+        result_.malformed = true;
+        return;
+    }
+}
+
+void FacilitatorResponseParser::feed(const char *data, size_t len)
+{
+    for (size_t i = 0; i < len && !result_.malformed; ++i)
+        step(data[i]);
+}
+
+bool FacilitatorResponseParser::finish()
+{
+    if (state_ == InLiteral)
+        endLiteral();
+    if (!started_ || depth_ != 0 || state_ != Idle)
+        result_.malformed = true;
+    return !result_.malformed;
+}
+
+bool FacilitatorResponseParser::parse(const char *data, size_t len, FacilitatorResult &out)
+{
+    FacilitatorResponseParser parser;
+    parser.feed(data, len);
+    bool ok = parser.finish();
+    out = parser.result();
+    return ok;
+}
@@ -0,0 +1,123 @@
+#ifndef FACILITATOR_RESPONSE_PARSER_H
+#define FACILITATOR_RESPONSE_PARSER_H
+
+// Plain C++ (no Arduino headers) so it can be compiled and exercised on a host.
+#include <stddef.h>
+#include <stdint.h>
+
+// Typed view of a facilitator /verify or /settle reply.
+// String fields are NUL-terminated and truncated to their buffer size.
+struct FacilitatorResult
+{
+    bool hasIsValid;        // "isValid" present (verify)
+    bool isValid;
+    bool hasSuccess;        // "success" present (settle)
+    bool success;
+    char invalidReason[64];
+    char errorReason[64];
+    char transaction[80];   // 0x + 64 hex chars
+    char payer[48];         // 0x + 40 hex chars
+    char network[32];
+    bool truncated;         // a captured string did not fit its buffer
+    bool malformed;         // input was not a well-formed JSON value
+
+    void clear();
+};
+
+// Incremental JSON tokenizer for facilitator replies.
+// Bytes may arrive in any number of chunks; only top-level members of the root
+// object are captured, everything else (nested objects, arrays, unknown keys)
+// is skipped without buffering. Memory use is fixed regardless of body size.
+class FacilitatorResponseParser
+{
+public:
+    // Receives each element of the walked array in order; non-object elements come as an empty result
+    typedef void (*ItemCallback)(void *context, size_t index, const FacilitatorResult &item);
+
+    FacilitatorResponseParser();
+
+    // Clears the parse state; a walk set up with walkItems() stays in place
+    void reset();
+
+    // Batch replies: {"<member>":[{...}, ...]}. Each element of that top-level array is
+    // captured like a reply of its own and handed to onItem as soon as it closes.
+    void walkItems(const char *member, ItemCallback onItem, void *context);
+
+    // Feed the next slice of the response body
+    void feed(const char *data, size_t len);
+
+    // Flush a trailing literal and validate nesting; returns false if malformed
+    bool finish();
+
+    const FacilitatorResult &result() const { return result_; }
+    FacilitatorResult &result() { return result_; }
+
+    // Convenience: parse a complete body in one call
+    static bool parse(const char *data, size_t len, FacilitatorResult &out);
+
+private:
+    enum State : uint8_t
+    {
+        Idle,
+        InString,
+        InEscape,
+        InUnicode,
+        InLiteral
+    };
+
+    enum Field : uint8_t
+    {
+        FieldNone,
+        FieldIsValid,
+        FieldSuccess,
+        FieldInvalidReason,
+        FieldErrorReason,
+        FieldTransaction,
+        FieldPayer,
+        FieldNetwork,
+        FieldItems
+    };
+
+    FacilitatorResult result_;
+    State state_;
+    uint8_t depth_;
+    uint32_t objectMask_;   // bit n set = container at depth n+1 is an object
+    bool expectKey_;
+    bool stringIsKey_;
+    Field field_;           // key of the member whose value comes next
+    char key_[16];
+    uint8_t keyLen_;
+    bool keyOverflow_;
+    char *target_;          // string field being captured, nullptr if skipped
+    size_t targetCap_;
+    size_t targetLen_;
+    uint32_t unicode_;      // \uXXXX code unit being read
+    uint8_t unicodeDigits_;
+    uint16_t highSurrogate_; // first half of a surrogate pair, 0 if none
+    char literal_[8];
+    uint8_t literalLen_;
+    bool started_;          // root value opened
+
+    // Array walk: item_ is captured at depth 3 while capture_ points at it
+    FacilitatorResult item_;
+    FacilitatorResult *capture_; // result_ or item_
+    uint8_t captureDepth_;  // depth whose object members are captured
+    const char *itemsKey_;  // member holding the array, nullptr if not walking
+    ItemCallback onItem_;
+    void *itemContext_;
+    bool inItems_;
+    size_t itemIndex_;
+
+    void step(char c);
+    void beginString();
+    void endString();
+    void appendString(char c);
+    void appendCodePoint(uint32_t cp);
+    void endUnicode();
+    void endLiteral();
+    void endItem();
+    Field resolveKey() const;
+    bool inObject() const;
+};
+
+#endif // FACILITATOR_RESPONSE_PARSER_H
@@ -0,0 +1,95 @@
+#include "PaymentArena.h"
+
+void PaymentArena::attach(uint8_t *storage, size_t capacity)
+{
+    base_ = storage;
+    capacity_ = storage ? capacity : 0;
+    used_ = 0;
+    highWater_ = 0;
+    failures_ = 0;
+}
+
+void *PaymentArena::allocate(size_t bytes, size_t align)
+{
+    size_t start = (used_ + (align - 1)) & ~(align - 1);
+    if (!base_ || start + bytes > capacity_)
+    {
+        failures_++;
+        return nullptr;
+    }
+    used_ = start + bytes;
+    if (used_ > highWater_)
+        highWater_ = used_;
+    return base_ + start;
+}
+
+void PaymentArena::rewind(size_t mark)
+{
+    if (mark < used_)
+        used_ = mark;
+}
+
+PayloadBuffer::~PayloadBuffer()
+{
+    if (!fixed_ && data_)
+        free(data_);
+}
+
+void PayloadBuffer::attach(char *storage, size_t capacity)
+{
+    if (!fixed_ && data_)
+        free(data_);
+    data_ = storage;
+    cap_ = storage ? capacity : 0;
+    fixed_ = true;
+    clear();
+}
+
+bool PayloadBuffer::reserve(size_t bytes)
+{
+    if (bytes + 1 <= cap_)
+        return true;
+    if (fixed_ || (limit_ && bytes > limit_))
+        return false;
+
+    // Heap mode: grow once and keep the block for later payments
+    char *grown = static_cast<char *>(realloc(data_, bytes + 1));
+    if (!grown)
+        return false;
+    if (!data_)
+        grown[0] = '\0';
+    data_ = grown;
+    cap_ = bytes + 1;
+    return true;
+}
+
+bool PayloadBuffer::append(const char *data, size_t len)
+{
+    if (overflowed_)
+        return false;
+    if (len_ + len + 1 > cap_)
+    {
+        size_t want = len_ + len;
+        if (!fixed_ && want < cap_ * 2)
+            want = cap_ * 2; // amortize growth in heap mode
+        if (limit_ && want > limit_ && len_ + len <= limit_)
+            want = limit_;
+        if (!reserve(want))
+        {
+            overflowed_ = true;
+            return false;
+        }
+    }
+    memcpy(data_ + len_, data, len);
+    len_ += len;
+    data_[len_] = '\0';
+    return true;
+}
+
+void PayloadBuffer::clear()
+{
+    len_ = 0;
+    overflowed_ = false;
+    if (data_ && cap_ > 0)
+        data_[0] = '\0';
+}
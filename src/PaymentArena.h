@@ -0,0 +1,108 @@
+#ifndef PAYMENT_ARENA_H
+#define PAYMENT_ARENA_H
+
+#include <Arduino.h>
+
+// Bytes of static arena per payment session. 0 (default) keeps session buffers
+// on the heap; any other value carves the request assembly buffers and
+// per-payment scratch from a preallocated per-session arena. Facilitator I/O
+// (HTTPClient), price callbacks, the journal and batch settlement are not covered.
+#ifndef X4PAY_PAYMENT_ARENA_BYTES
+#define X4PAY_PAYMENT_ARENA_BYTES 0
+#endif
+
+// Largest X-PAYMENT payload / [PRICE] request a session assembles. Heap buffers reserve
+// this when a request starts and refuse to grow past it; arena buffers are carved at
+// this size (plus the NUL). A larger request is answered with a too-large error.
+#ifndef X4PAY_MAX_PAYMENT_BYTES
+#define X4PAY_MAX_PAYMENT_BYTES 2048
+#endif
+#ifndef X4PAY_MAX_PRICE_REQUEST_BYTES
+#define X4PAY_MAX_PRICE_REQUEST_BYTES 512
+#endif
+
+// Arena carve-outs for the chunk assembly buffers (arena mode only)
+#ifndef X4PAY_ARENA_PAYLOAD_BYTES
+#define X4PAY_ARENA_PAYLOAD_BYTES (X4PAY_MAX_PAYMENT_BYTES + 1)
+#endif
+#ifndef X4PAY_ARENA_PRICE_BYTES
+#define X4PAY_ARENA_PRICE_BYTES (X4PAY_MAX_PRICE_REQUEST_BYTES + 1)
+#endif
+
+#if X4PAY_PAYMENT_ARENA_BYTES > 0 && X4PAY_PAYMENT_ARENA_BYTES < (X4PAY_ARENA_PAYLOAD_BYTES + X4PAY_ARENA_PRICE_BYTES)
+#error "X4PAY_PAYMENT_ARENA_BYTES must hold X4PAY_ARENA_PAYLOAD_BYTES + X4PAY_ARENA_PRICE_BYTES plus scratch space"
+#endif
+
+// Bump allocator over caller-provided storage.
+// Individual allocations are never freed - the whole arena (or everything
+// after a mark) is rewound at once when a payment completes.
+class PaymentArena
+{
+public:
+    PaymentArena() : base_(nullptr), capacity_(0), used_(0), highWater_(0), failures_(0) {}
+
+    void attach(uint8_t *storage, size_t capacity);
+
+    // nullptr when the arena is exhausted (or has no storage)
+    void *allocate(size_t bytes, size_t align = 4);
+    char *allocateChars(size_t count) { return static_cast<char *>(allocate(count, 1)); }
+
+    size_t mark() const { return used_; }
+    void rewind(size_t mark);
+    void reset() { rewind(0); }
+
+    size_t capacity() const { return capacity_; }
+    size_t used() const { return used_; }
+    size_t highWater() const { return highWater_; }
+    uint32_t failures() const { return failures_; }
+
+private:
+    uint8_t *base_;
+    size_t capacity_;
+    size_t used_;
+    size_t highWater_;
+    uint32_t failures_;
+};
+
+// NUL-terminated byte buffer for chunked BLE requests.
+// Either fixed (storage carved from an arena, appends past capacity fail) or
+// heap-backed (grows on demand up to its limit and keeps its allocation across payments).
+class PayloadBuffer
+{
+public:
+    PayloadBuffer() : data_(nullptr), len_(0), cap_(0), limit_(0), fixed_(false), overflowed_(false) {}
+    ~PayloadBuffer();
+
+    PayloadBuffer(const PayloadBuffer &) = delete;
+    PayloadBuffer &operator=(const PayloadBuffer &) = delete;
+
+    // Use fixed external storage (capacity includes the terminating NUL)
+    void attach(char *storage, size_t capacity);
+
+    // Heap mode: most bytes the buffer may hold (0 = no limit); reserves and appends past it fail
+    void setLimit(size_t maxLength) { limit_ = maxLength; }
+
+    bool reserve(size_t bytes);
+    bool append(const char *data, size_t len);
+    bool append(const char *cstr) { return append(cstr, strlen(cstr)); }
+
+    // Empty the buffer; capacity is kept
+    void clear();
+
+    const char *c_str() const { return data_ ? data_ : ""; }
+    size_t length() const { return len_; }
+    size_t capacity() const { return cap_; }
+
+    // An append did not fit; sticky until clear()
+    bool overflowed() const { return overflowed_; }
+
+private:
+    char *data_;
+    size_t len_;
+    size_t cap_;
+    size_t limit_;
+    bool fixed_;
+    bool overflowed_;
+};
+
+#endif // PAYMENT_ARENA_H
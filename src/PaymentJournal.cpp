@@ -0,0 +1,593 @@
+#include "PaymentJournal.h"
+#include "SettlementBatch.h"
+#include "x4Pay-core.h"
+
+#ifdef ESP32
+#include <esp_partition.h>
+#else
+#include <stdio.h>
+#endif
+
+static const uint16_t kRecordMagic = 0x4A57;     // "WJ"
+static const uint32_t kSectorMagic = 0x4A573458; // "X4WJ"
+
+SemaphoreHandle_t PaymentJournal::lock_ = nullptr;
+size_t PaymentJournal::sectorCount_ = 0;
+uint16_t PaymentJournal::sector_ = 0;
+size_t PaymentJournal::offset_ = 0;
+uint32_t PaymentJournal::epoch_ = 0;
+uint32_t PaymentJournal::nextId_ = 1;
+uint8_t PaymentJournal::staged_[X4PAY_JOURNAL_BUFFER_BYTES];
+size_t PaymentJournal::stagedLength_ = 0;
+PaymentJournal::Open PaymentJournal::open_[X4PAY_JOURNAL_MAX_OPEN] = {};
+PaymentJournalStats PaymentJournal::stats_ = {};
+
+// ---- Storage: a flash partition on the device, a plain file elsewhere ----
+
+#ifdef ESP32
+static const esp_partition_t *s_partition = nullptr;
+
+static size_t storageOpen()
+{
+    s_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, X4PAY_JOURNAL_PARTITION);
+    return s_partition ? s_partition->size : 0;
+}
+
+static bool storageRead(size_t offset, void *data, size_t length)
+{
+    return esp_partition_read(s_partition, offset, data, length) == ESP_OK;
+}
+
+static bool storageWrite(size_t offset, const void *data, size_t length)
+{
+    return esp_partition_write(s_partition, offset, data, length) == ESP_OK;
+}
+
+static bool storageErase(size_t offset, size_t length)
+{
+    return esp_partition_erase_range(s_partition, offset, length) == ESP_OK;
+}
+#else
+static FILE *s_file = nullptr;
+
+static bool storageErase(size_t offset, size_t length)
+{
+    static const uint8_t erased[64] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                       0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                       0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                       0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    if (fseek(s_file, (long)offset, SEEK_SET) != 0)
+        return false;
+    for (size_t done = 0; done < length; done += sizeof(erased))
+    {
+        size_t n = length - done < sizeof(erased) ? length - done : sizeof(erased);
+        if (fwrite(erased, 1, n, s_file) != n)
+            return false;
+    }
+    return fflush(s_file) == 0;
+}
+
+static size_t storageOpen()
+{
+    s_file = fopen(X4PAY_JOURNAL_FILE, "r+b");
+    if (!s_file)
+    {
+        // First run: create the file already "erased"
+        s_file = fopen(X4PAY_JOURNAL_FILE, "w+b");
+        if (!s_file || !storageErase(0, X4PAY_JOURNAL_FILE_BYTES))
+            return 0;
+    }
+    return X4PAY_JOURNAL_FILE_BYTES;
+}
+
+static bool storageRead(size_t offset, void *data, size_t length)
+{
+    return fseek(s_file, (long)offset, SEEK_SET) == 0 && fread(data, 1, length, s_file) == length;
+}
+
+static bool storageWrite(size_t offset, const void *data, size_t length)
+{
+    return fseek(s_file, (long)offset, SEEK_SET) == 0 && fwrite(data, 1, length, s_file) == length && fflush(s_file) == 0;
+}
+#endif
+
+// CRC-16/CCITT-FALSE, fed incrementally
+static uint16_t crc16(uint16_t crc, const void *data, size_t length)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    while (length--)
+    {
+        crc ^= (uint16_t)(*p++) << 8;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static size_t padded(size_t length)
+{
+    return (length + 3) & ~(size_t)3;
+}
+
+static size_t sectorBase(uint16_t sector)
+{
+    return (size_t)sector * X4PAY_JOURNAL_SECTOR_BYTES;
+}
+
+void PaymentJournal::lock()
+{
+    if (lock_)
+        xSemaphoreTake(lock_, portMAX_DELAY);
+}
+
+void PaymentJournal::unlock()
+{
+    if (lock_)
+        xSemaphoreGive(lock_);
+}
+
+void PaymentJournal::begin(x4PayCore *core)
+{
+#if X4PAY_JOURNAL
+    if (enabled())
+        return;
+    if (!lock_)
+        lock_ = xSemaphoreCreateMutex();
+
+    size_t bytes = storageOpen();
+    if (bytes / X4PAY_JOURNAL_SECTOR_BYTES < 2)
+    {
+        Serial.println("Journal: no " X4PAY_JOURNAL_PARTITION " partition, payments are not journaled");
+        return;
+    }
+    sectorCount_ = bytes / X4PAY_JOURNAL_SECTOR_BYTES;
+
+    lock();
+    replay(core);
+    unlock();
+#else
+    (void)core;
+#endif
+}
+
+// Rebuild the open payments from every sector in epoch order, act on them,
+// then erase what was read so the next boot does not see it again
+void PaymentJournal::replay(x4PayCore *core)
+{
+    uint32_t epochs[64];
+    size_t sectors = sectorCount_ < 64 ? sectorCount_ : 64;
+    bool written[64] = {};
+    uint32_t lastEpoch = 0;
+
+    for (uint16_t s = 0; s < sectors; ++s)
+    {
+        SectorHeader header;
+        if (!storageRead(sectorBase(s), &header, sizeof(header)))
+            continue;
+        if (header.magic != 0xFFFFFFFF)
+            written[s] = true;
+        epochs[s] = (header.magic == kSectorMagic && header.epochCheck == ~header.epoch) ? header.epoch : 0;
+        if (epochs[s] > lastEpoch)
+            lastEpoch = epochs[s];
+    }
+
+    // Oldest sector first, records in append order inside it
+    bool done[64] = {};
+    for (;;)
+    {
+        int next = -1;
+        for (uint16_t s = 0; s < sectors; ++s)
+        {
+            if (!done[s] && epochs[s] != 0 && (next < 0 || epochs[s] < epochs[next]))
+                next = s;
+        }
+        if (next < 0)
+            break;
+        done[next] = true;
+
+        size_t offset = sizeof(SectorHeader);
+        while (offset + sizeof(RecordHeader) <= X4PAY_JOURNAL_SECTOR_BYTES)
+        {
+            RecordHeader header;
+            if (!storageRead(sectorBase(next) + offset, &header, sizeof(header)) || header.magic != kRecordMagic)
+                break;
+            size_t size = padded(sizeof(header) + header.length);
+            if (offset + size > X4PAY_JOURNAL_SECTOR_BYTES)
+                break;
+
+            // A torn or corrupt record ends the sector
+            uint8_t *data = header.length ? (uint8_t *)malloc(header.length) : nullptr;
+            if (header.length && (!data || !storageRead(sectorBase(next) + offset + sizeof(header), data, header.length)))
+            {
+                free(data);
+                break;
+            }
+            RecordHeader check = header;
+            check.crc = 0;
+            uint16_t crc = crc16(crc16(0xFFFF, &check, sizeof(check)), data, header.length);
+            free(data);
+            if (crc != header.crc)
+                break;
+
+            if (header.id >= nextId_)
+                nextId_ = header.id + 1;
+            Location location = {(uint16_t)next, (uint16_t)offset, (uint16_t)size, true};
+            track((RecordType)header.type, header.id, location);
+            offset += size;
+        }
+    }
+
+    for (size_t i = 0; i < X4PAY_JOURNAL_MAX_OPEN; ++i)
+    {
+        if (open_[i].used)
+            resume(core, open_[i]);
+        open_[i].used = false;
+    }
+
+    // Everything recoverable has been handed over; start from clean sectors
+    // (sector 0 is erased by openSector below)
+    for (uint16_t s = 1; s < sectorCount_; ++s)
+    {
+        if (s < sectors && !written[s])
+            continue;
+        if (storageErase(sectorBase(s), X4PAY_JOURNAL_SECTOR_BYTES))
+            stats_.sectorErases++;
+    }
+    epoch_ = lastEpoch;
+    if (!openSector(0))
+        sectorCount_ = 0;
+}
+
+// Finish what a payment left open when the device went down
+void PaymentJournal::resume(x4PayCore *core, const Open &entry)
+{
+    const Location &location = entry.settled.valid ? entry.settled : entry.verified;
+    if (!location.valid)
+        return;
+
+    char *record = (char *)malloc(location.size);
+    if (!record || !storageRead(sectorBase(location.sector) + location.offset, record, location.size))
+    {
+        free(record);
+        return;
+    }
+    RecordHeader header;
+    memcpy(&header, record, sizeof(header));
+    const char *data = record + sizeof(header);
+
+    if (entry.settled.valid)
+    {
+        // Settled but never reported: bring the last payment state back
+        const char *transaction = data;
+        const char *payer = data + strnlen(data, header.length) + 1;
+        if (core && payer < data + header.length)
+        {
+            core->setLastPaymentState(true, transaction, payer);
+            stats_.restored++;
+        }
+    }
+    else if (header.length >= 4)
+    {
+        // Verified, never settled: settle it from the batch store
+        uint16_t payloadLength, requirementsLength;
+        memcpy(&payloadLength, data, sizeof(payloadLength));
+        memcpy(&requirementsLength, data + 2, sizeof(requirementsLength));
+        if (4u + payloadLength + requirementsLength <= header.length &&
+            SettlementBatch::adopt(data + 4, payloadLength, data + 4 + payloadLength, requirementsLength))
+            stats_.resumed++;
+        else
+            Serial.println("ERROR: Journal could not hand a verified payment to settlement");
+    }
+    free(record);
+}
+
+PaymentJournal::Open *PaymentJournal::findOpen(uint32_t id, bool create)
+{
+    Open *freeSlot = nullptr;
+    for (size_t i = 0; i < X4PAY_JOURNAL_MAX_OPEN; ++i)
+    {
+        if (open_[i].used && open_[i].id == id)
+            return &open_[i];
+        if (!open_[i].used && !freeSlot)
+            freeSlot = &open_[i];
+    }
+    if (!create || !freeSlot)
+        return nullptr;
+    *freeSlot = Open();
+    freeSlot->id = id;
+    freeSlot->used = true;
+    return freeSlot;
+}
+
+void PaymentJournal::track(RecordType type, uint32_t id, const Location &location)
+{
+    switch (type)
+    {
+    case RecordVerified:
+    {
+        Open *entry = findOpen(id, true);
+        if (entry)
+            entry->verified = location;
+        break;
+    }
+    case RecordSettled:
+    {
+        // Created here too: a carried verified record may replay after its settled record
+        Open *entry = findOpen(id, true);
+        if (entry)
+            entry->settled = location;
+        break;
+    }
+    case RecordDeferred:
+    case RecordFailed:
+    case RecordCompleted:
+    {
+        Open *entry = findOpen(id, false);
+        if (entry)
+            entry->used = false;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Erase a sector and make it the append head
+bool PaymentJournal::openSector(uint16_t sector)
+{
+    if (!storageErase(sectorBase(sector), X4PAY_JOURNAL_SECTOR_BYTES))
+        return false;
+    stats_.sectorErases++;
+    epoch_++;
+    SectorHeader header = {kSectorMagic, epoch_, ~epoch_, 0xFFFFFFFF};
+    if (!storageWrite(sectorBase(sector), &header, sizeof(header)))
+        return false;
+    sector_ = sector;
+    offset_ = sizeof(header);
+    return true;
+}
+
+// Bytes of still-open records in a sector - they have to move before it can be erased
+size_t PaymentJournal::carryNeed(uint16_t sector)
+{
+    size_t need = 0;
+    for (size_t i = 0; i < X4PAY_JOURNAL_MAX_OPEN; ++i)
+    {
+        const Open &entry = open_[i];
+        if (!entry.used)
+            continue;
+        if (entry.verified.valid && entry.verified.sector == sector)
+            need += entry.verified.size;
+        if (entry.settled.valid && entry.settled.sector == sector)
+            need += entry.settled.size;
+    }
+    return need;
+}
+
+// Copy the open records of sector to the head. The originals stay until the sector is
+// erased, so a reset in between leaves two copies (replay keeps the newer) rather than none.
+bool PaymentJournal::carryForward(uint16_t sector)
+{
+    for (size_t i = 0; i < X4PAY_JOURNAL_MAX_OPEN; ++i)
+    {
+        Open &entry = open_[i];
+        if (!entry.used)
+            continue;
+        Location *locations[2] = {&entry.verified, &entry.settled};
+        for (Location *location : locations)
+        {
+            if (!location->valid || location->sector != sector)
+                continue;
+            uint8_t *record = (uint8_t *)malloc(location->size);
+            bool moved = record && storageRead(sectorBase(sector) + location->offset, record, location->size) &&
+                         storageWrite(sectorBase(sector_) + offset_, record, location->size);
+            free(record);
+            if (!moved)
+                return false;
+            *location = {sector_, (uint16_t)offset_, location->size, true};
+            offset_ += location->size;
+            stats_.carried++;
+            stats_.writes++;
+            stats_.bytesWritten += location->size;
+        }
+    }
+    return true;
+}
+
+// Make room for size bytes at the head (staged bytes included). The head always keeps
+// enough space to take the open records of the sector after it, so moving on is:
+// carry those records here, erase that sector, continue there.
+bool PaymentJournal::reserve(size_t size)
+{
+    if (size > X4PAY_JOURNAL_SECTOR_BYTES - sizeof(SectorHeader))
+        return false;
+
+    for (size_t attempt = 0; attempt <= sectorCount_; ++attempt)
+    {
+        uint16_t next = (sector_ + 1) % sectorCount_;
+        if (offset_ + stagedLength_ + size + carryNeed(next) <= X4PAY_JOURNAL_SECTOR_BYTES)
+            return true;
+        flushStaged();
+        if (!carryForward(next) || !openSector(next))
+            return false;
+    }
+    return false;
+}
+
+void PaymentJournal::flushStaged()
+{
+    if (stagedLength_ == 0)
+        return;
+    if (storageWrite(sectorBase(sector_) + offset_, staged_, stagedLength_))
+    {
+        stats_.writes++;
+        stats_.bytesWritten += stagedLength_;
+    }
+    else
+    {
+        stats_.dropped++;
+    }
+    offset_ += stagedLength_;
+    stagedLength_ = 0;
+}
+
+void PaymentJournal::append(RecordType type, uint32_t id, const Part *parts, size_t partCount, bool durable)
+{
+    if (!enabled() || id == 0)
+        return;
+
+    size_t length = 0;
+    for (size_t i = 0; i < partCount; ++i)
+        length += parts[i].length;
+    if (length > 0xFFFF)
+    {
+        drop(type);
+        return;
+    }
+
+    RecordHeader header = {kRecordMagic, (uint8_t)type, 0, id, (uint16_t)length, 0};
+    uint16_t crc = crc16(0xFFFF, &header, sizeof(header));
+    for (size_t i = 0; i < partCount; ++i)
+        crc = crc16(crc, parts[i].data, parts[i].length);
+    header.crc = crc;
+    size_t size = padded(sizeof(header) + length);
+    static const uint8_t padding[4] = {0xFF, 0xFF, 0xFF, 0xFF};
+    size_t pad = size - sizeof(header) - length;
+
+    lock();
+    if (!reserve(size))
+    {
+        unlock();
+        drop(type);
+        return;
+    }
+
+    Location location = {sector_, (uint16_t)(offset_ + stagedLength_), (uint16_t)size, true};
+    if (stagedLength_ + size <= sizeof(staged_))
+    {
+        // Small record: stage it, it goes out with the next durable one
+        uint8_t *out = staged_ + stagedLength_;
+        memcpy(out, &header, sizeof(header));
+        out += sizeof(header);
+        for (size_t i = 0; i < partCount; ++i)
+        {
+            if (parts[i].length)
+                memcpy(out, parts[i].data, parts[i].length);
+            out += parts[i].length;
+        }
+        memcpy(out, padding, pad);
+        stagedLength_ += size;
+    }
+    else
+    {
+        // Large record (payload): staged bytes first, then the record in place
+        flushStaged();
+        location.offset = (uint16_t)offset_;
+        size_t at = sectorBase(sector_) + offset_;
+        bool ok = storageWrite(at, &header, sizeof(header));
+        at += sizeof(header);
+        for (size_t i = 0; i < partCount && ok; ++i)
+        {
+            ok = !parts[i].length || storageWrite(at, parts[i].data, parts[i].length);
+            at += parts[i].length;
+        }
+        ok = ok && (!pad || storageWrite(at, padding, pad));
+        offset_ += size;
+        if (ok)
+        {
+            stats_.writes++;
+            stats_.bytesWritten += size;
+        }
+        else
+        {
+            location.valid = false;
+        }
+    }
+    stats_.records++;
+    if (location.valid)
+        track(type, id, location);
+    if (durable)
+        flushStaged();
+    unlock();
+
+    if (!location.valid)
+        drop(type);
+}
+
+// Count a record that never made it to flash. A lost verified record is the one that
+// matters: that payment can no longer be resumed after a reboot.
+void PaymentJournal::drop(RecordType type)
+{
+    lock();
+    stats_.dropped++;
+    unlock();
+    if (type == RecordVerified)
+        Serial.println("ERROR: Journal could not record a verified payment");
+}
+
+uint32_t PaymentJournal::accepted()
+{
+    if (!enabled())
+        return 0;
+    lock();
+    uint32_t id = nextId_++;
+    if (nextId_ == 0)
+        nextId_ = 1;
+    unlock();
+    append(RecordAccepted, id, nullptr, 0, false);
+    return id;
+}
+
+void PaymentJournal::verified(uint32_t id, const char *payload, size_t payloadLength,
+                              const char *requirements, size_t requirementsLength)
+{
+    if (!enabled() || id == 0)
+        return;
+    if (payloadLength > 0xFFFF || requirementsLength > 0xFFFF)
+    {
+        drop(RecordVerified);
+        return;
+    }
+    // Lengths, payload and requirements, each written from where it already is
+    uint16_t lengths[2] = {(uint16_t)payloadLength, (uint16_t)requirementsLength};
+    Part parts[3] = {{lengths, sizeof(lengths)}, {payload, payloadLength}, {requirements, requirementsLength}};
+    append(RecordVerified, id, parts, 3, true);
+}
+
+void PaymentJournal::deferred(uint32_t id)
+{
+    append(RecordDeferred, id, nullptr, 0, true);
+}
+
+void PaymentJournal::settled(uint32_t id, const char *transaction, const char *payer)
+{
+    Part parts[2] = {{transaction, strlen(transaction) + 1}, {payer, strlen(payer) + 1}};
+    append(RecordSettled, id, parts, 2, true);
+}
+
+void PaymentJournal::failed(uint32_t id)
+{
+    append(RecordFailed, id, nullptr, 0, false);
+}
+
+void PaymentJournal::completed(uint32_t id)
+{
+    append(RecordCompleted, id, nullptr, 0, true);
+}
+
+void PaymentJournal::sync()
+{
+    if (!enabled())
+        return;
+    lock();
+    flushStaged();
+    unlock();
+}
+
+PaymentJournalStats PaymentJournal::getStats()
+{
+    lock();
+    PaymentJournalStats stats = stats_;
+    unlock();
+    return stats;
+}
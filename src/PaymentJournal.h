@@ -0,0 +1,168 @@
+#ifndef PAYMENT_JOURNAL_H
+#define PAYMENT_JOURNAL_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+class x4PayCore;
+
+// 0 compiles the journal out entirely
+#ifndef X4PAY_JOURNAL
+#define X4PAY_JOURNAL 1
+#endif
+
+// Data partition holding the journal on the device, e.g. in partitions.csv:
+//   x4pay_wal, data, 0x99, , 0x10000
+// Without it the journal stays off.
+#ifndef X4PAY_JOURNAL_PARTITION
+#define X4PAY_JOURNAL_PARTITION "x4pay_wal"
+#endif
+
+// Backing file and size for builds without flash partitions (host)
+#ifndef X4PAY_JOURNAL_FILE
+#define X4PAY_JOURNAL_FILE "x4pay_journal.bin"
+#endif
+#ifndef X4PAY_JOURNAL_FILE_BYTES
+#define X4PAY_JOURNAL_FILE_BYTES (16 * 4096)
+#endif
+
+// Erase unit; the journal rotates through the partition one sector at a time
+#ifndef X4PAY_JOURNAL_SECTOR_BYTES
+#define X4PAY_JOURNAL_SECTOR_BYTES 4096
+#endif
+
+// Small records are staged here and written together with the next durable record
+#ifndef X4PAY_JOURNAL_BUFFER_BYTES
+#define X4PAY_JOURNAL_BUFFER_BYTES 256
+#endif
+
+// Verified-but-unresolved payments tracked at once (covers the verify job pool)
+#ifndef X4PAY_JOURNAL_MAX_OPEN
+#define X4PAY_JOURNAL_MAX_OPEN 16
+#endif
+
+struct PaymentJournalStats
+{
+    uint32_t records;      // records appended
+    uint32_t writes;       // flash writes (staged records go out together)
+    uint32_t bytesWritten;
+    uint32_t sectorErases;
+    uint32_t carried;      // open records copied forward out of a sector being recycled
+    uint32_t dropped;      // records that could not be written
+    uint32_t resumed;      // verified, unsettled payments handed to settlement at boot
+    uint32_t restored;     // settled payments whose completion was restored at boot
+};
+
+// Append-only write-ahead journal of payment transitions.
+// Every payment the worker takes is recorded as accepted -> verified -> settled/failed ->
+// completed. The verified record carries the payload and requirements and is on flash
+// before /settle is called, so begin() can resume a payment the device lost mid-way:
+// verified ones are settled through SettlementBatch, settled ones get their last payment
+// state back. Only the verify worker writes, never the BLE host task.
+class PaymentJournal
+{
+public:
+    // Open the storage, replay what the last run left behind, then start a clean journal
+    static void begin(x4PayCore *core);
+    static bool enabled() { return sectorCount_ > 0; }
+
+    // Returns the journal id for the payment, 0 when journaling is off.
+    // accepted and failed are staged and go out with the next record;
+    // the others are on flash before they return.
+    static uint32_t accepted();
+    static void verified(uint32_t id, const char *payload, size_t payloadLength,
+                         const char *requirements, size_t requirementsLength);
+    // Handed to the batch settlement store, which owns it from here
+    static void deferred(uint32_t id);
+    static void settled(uint32_t id, const char *transaction, const char *payer);
+    static void failed(uint32_t id);
+    // Result delivered to the app and the central
+    static void completed(uint32_t id);
+
+    // Write staged records out now
+    static void sync();
+
+    static PaymentJournalStats getStats();
+
+private:
+    enum RecordType : uint8_t
+    {
+        RecordAccepted = 1,
+        RecordVerified,
+        RecordDeferred,
+        RecordSettled,
+        RecordFailed,
+        RecordCompleted
+    };
+
+    struct RecordHeader
+    {
+        uint16_t magic;
+        uint8_t type;
+        uint8_t reserved;
+        uint32_t id;
+        uint16_t length; // data bytes after the header (before padding)
+        uint16_t crc;    // CRC-16 over header (crc = 0) and data
+    };
+
+    struct SectorHeader
+    {
+        uint32_t magic;
+        uint32_t epoch;      // increases every time a sector is opened
+        uint32_t epochCheck; // ~epoch, guards against a torn header
+        uint32_t reserved;
+    };
+
+    // Piece of a record's data; the pieces are written one after another without joining them
+    struct Part
+    {
+        const void *data;
+        size_t length;
+    };
+
+    // Where a record needed for recovery lives
+    struct Location
+    {
+        uint16_t sector;
+        uint16_t offset;
+        uint16_t size; // header + data + padding
+        bool valid;
+    };
+
+    // Payment with a verified record and no final one yet
+    struct Open
+    {
+        uint32_t id;
+        Location verified;
+        Location settled;
+        bool used;
+    };
+
+    static SemaphoreHandle_t lock_;
+    static size_t sectorCount_;
+    static uint16_t sector_; // sector being appended to
+    static size_t offset_;   // next write offset inside sector_
+    static uint32_t epoch_;
+    static uint32_t nextId_;
+    static uint8_t staged_[X4PAY_JOURNAL_BUFFER_BYTES];
+    static size_t stagedLength_;
+    static Open open_[X4PAY_JOURNAL_MAX_OPEN];
+    static PaymentJournalStats stats_;
+
+    static void lock();
+    static void unlock();
+    static void append(RecordType type, uint32_t id, const Part *parts, size_t partCount, bool durable);
+    static void drop(RecordType type);
+    static bool reserve(size_t size);
+    static void flushStaged();
+    static bool openSector(uint16_t sector);
+    static size_t carryNeed(uint16_t sector);
+    static bool carryForward(uint16_t sector);
+    static Open *findOpen(uint32_t id, bool create);
+    static void track(RecordType type, uint32_t id, const Location &location);
+    static void replay(x4PayCore *core);
+    static void resume(x4PayCore *core, const Open &entry);
+};
+
+#endif // PAYMENT_JOURNAL_H
@@ -0,0 +1,230 @@
+#include "PaymentReplayCache.h"
+#include "paymentutils.h"
+
+static const uint64_t kFnvOffset = 1469598103934665603ULL;
+static const uint64_t kFnvPrime = 1099511628211ULL;
+
+static uint64_t fnvMix(uint64_t hash, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= (uint8_t)data[i];
+        hash *= kFnvPrime;
+    }
+    return hash;
+}
+
+PaymentReplayCache::PaymentReplayCache() : capacity_(0), ttlMs_(0), persist_(false), stats_{0, 0, 0, 0}
+{
+    lock_ = xSemaphoreCreateMutex();
+}
+
+PaymentReplayCache::~PaymentReplayCache()
+{
+    if (persist_)
+        prefs_.end();
+    if (lock_)
+        vSemaphoreDelete(lock_);
+}
+
+uint64_t PaymentReplayCache::keyFor(const char *json, size_t length)
+{
+    // The nonce identifies the signed authorization however the JSON around it is formatted
+    const char *nonce = nullptr;
+    size_t nonceLength = 0;
+    uint64_t hash = kFnvOffset;
+    if (findJsonValue(json, length, "nonce", &nonce, &nonceLength) && nonceLength > 0)
+    {
+        hash = fnvMix(hash, "nonce:", 6);
+        hash = fnvMix(hash, nonce, nonceLength);
+    }
+    else
+    {
+        hash = fnvMix(hash, json, length);
+    }
+    return hash ? hash : 1;
+}
+
+void PaymentReplayCache::configure(size_t capacity, uint32_t ttlMs, bool persist)
+{
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    entries_.clear();
+    entries_.shrink_to_fit();
+    capacity_ = capacity;
+    ttlMs_ = ttlMs;
+    if (persist_ && !persist)
+        prefs_.end();
+    if (!persist_ && persist && capacity_ > 0)
+        persist = prefs_.begin("x4pay_replay", false);
+    persist_ = persist && capacity_ > 0;
+    if (capacity_ > 0)
+    {
+        // Allocate all slots up front - the cache never grows afterwards
+        entries_.resize(capacity_);
+        for (auto &entry : entries_)
+        {
+            entry.valid = false;
+            entry.inFlight = false;
+            entry.key = 0;
+            entry.storedAtMs = 0;
+        }
+        if (persist_)
+            load();
+    }
+    xSemaphoreGive(lock_);
+}
+
+bool PaymentReplayCache::expired(const Entry &entry, uint32_t now) const
+{
+    // In-flight entries are released by complete()/forget(), never by age
+    return !entry.inFlight && ttlMs_ > 0 && (now - entry.storedAtMs) > ttlMs_;
+}
+
+PaymentReplayCache::Entry *PaymentReplayCache::find(uint64_t key)
+{
+    for (auto &entry : entries_)
+    {
+        if (entry.valid && entry.key == key)
+            return &entry;
+    }
+    return nullptr;
+}
+
+ReplayStatus PaymentReplayCache::begin(uint64_t key, char *response, size_t capacity)
+{
+    if (!enabled())
+        return ReplayStatus::Fresh;
+
+    uint32_t now = millis();
+    ReplayStatus status = ReplayStatus::Fresh;
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    Entry *entry = find(key);
+    if (entry && expired(*entry, now))
+    {
+        entry->valid = false;
+        entry = nullptr;
+    }
+
+    if (entry && entry->inFlight)
+    {
+        status = ReplayStatus::InFlight;
+        stats_.inFlightHits++;
+    }
+    else if (entry)
+    {
+        status = ReplayStatus::Completed;
+        snprintf(response, capacity, "%s", entry->response);
+        stats_.completedHits++;
+    }
+    else
+    {
+        // Claim a free or expired slot, else the oldest finished one. In-flight entries stay.
+        Entry *slot = nullptr;
+        for (auto &candidate : entries_)
+        {
+            if (!candidate.valid || expired(candidate, now))
+            {
+                slot = &candidate;
+                break;
+            }
+            if (!candidate.inFlight && (!slot || candidate.storedAtMs < slot->storedAtMs))
+                slot = &candidate;
+        }
+        if (slot)
+        {
+            if (slot->valid && !expired(*slot, now))
+                stats_.evictions++;
+            slot->key = key;
+            slot->storedAtMs = now;
+            slot->valid = true;
+            slot->inFlight = true;
+            slot->response[0] = '\0';
+        }
+        stats_.fresh++;
+    }
+    xSemaphoreGive(lock_);
+    return status;
+}
+
+void PaymentReplayCache::complete(uint64_t key, bool paid, const char *response, size_t length)
+{
+    if (!enabled())
+        return;
+
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    Entry *entry = find(key);
+    if (entry)
+    {
+        if (paid)
+        {
+            if (length >= sizeof(entry->response))
+                length = sizeof(entry->response) - 1;
+            memcpy(entry->response, response, length);
+            entry->response[length] = '\0';
+            entry->inFlight = false;
+            entry->storedAtMs = millis();
+            if (persist_)
+                save();
+        }
+        else
+        {
+            entry->valid = false;
+        }
+    }
+    xSemaphoreGive(lock_);
+}
+
+void PaymentReplayCache::forget(uint64_t key)
+{
+    if (!enabled())
+        return;
+
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    Entry *entry = find(key);
+    if (entry)
+        entry->valid = false;
+    xSemaphoreGive(lock_);
+}
+
+// Paid entries from the last run come back with a fresh timestamp
+void PaymentReplayCache::load()
+{
+    size_t length = prefs_.getBytesLength("seen");
+    if (length == 0 || length % sizeof(Persisted) != 0)
+        return;
+    std::vector<Persisted> saved(length / sizeof(Persisted));
+    if (prefs_.getBytes("seen", saved.data(), length) != length)
+        return;
+
+    uint32_t now = millis();
+    size_t slot = 0;
+    for (const auto &item : saved)
+    {
+        if (slot >= entries_.size())
+            break;
+        Entry &entry = entries_[slot++];
+        entry.key = item.key;
+        memcpy(entry.response, item.response, sizeof(entry.response));
+        entry.response[sizeof(entry.response) - 1] = '\0';
+        entry.storedAtMs = now;
+        entry.valid = true;
+        entry.inFlight = false;
+    }
+}
+
+// Rewrites the paid entries; called with the lock held, from the verify worker
+void PaymentReplayCache::save()
+{
+    std::vector<Persisted> saved;
+    saved.reserve(entries_.size());
+    for (const auto &entry : entries_)
+    {
+        if (!entry.valid || entry.inFlight)
+            continue;
+        Persisted item;
+        item.key = entry.key;
+        memcpy(item.response, entry.response, sizeof(item.response));
+        saved.push_back(item);
+    }
+    prefs_.putBytes("seen", saved.data(), saved.size() * sizeof(Persisted));
+}
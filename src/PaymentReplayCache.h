@@ -0,0 +1,87 @@
+#ifndef PAYMENT_REPLAY_CACHE_H
+#define PAYMENT_REPLAY_CACHE_H
+
+#include <Arduino.h>
+#include <vector>
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Longest final reply kept per payment ("PAYMENT:COMPLETE VERIFIED:true TX:0x" + 64 hex)
+#ifndef X4PAY_REPLAY_RESPONSE_BYTES
+#define X4PAY_REPLAY_RESPONSE_BYTES 112
+#endif
+
+struct PaymentReplayStats
+{
+    uint32_t fresh;          // payloads seen for the first time and sent to the worker
+    uint32_t inFlightHits;   // duplicates of a payment still being verified/settled
+    uint32_t completedHits;  // duplicates answered from the cached result
+    uint32_t evictions;
+};
+
+enum class ReplayStatus : uint8_t
+{
+    Fresh,     // not seen: now marked in flight, go ahead and verify
+    InFlight,  // the same payment is being processed right now
+    Completed  // already paid: response holds the reply that was sent
+};
+
+// Recently seen signed payloads keyed by their authorization nonce (or a digest of the JSON).
+// A phone that resubmits the same X-PAYMENT (e.g. after a dropped notify) is answered
+// from here instead of paying for a second verify + settle that the facilitator would
+// reject anyway. Only paid results are kept; a failed payment can be retried.
+// Disabled (capacity 0) until configure() is called.
+class PaymentReplayCache
+{
+public:
+    PaymentReplayCache();
+    ~PaymentReplayCache();
+
+    // capacity 0 disables the cache; ttlMs 0 keeps results until evicted.
+    // persist keeps paid results in NVS so replays are caught across a reboot.
+    void configure(size_t capacity, uint32_t ttlMs, bool persist);
+    bool enabled() const { return capacity_ > 0; }
+
+    ReplayStatus begin(uint64_t key, char *response, size_t capacity);
+    // Paid: remember the final reply. Not paid: forget the key.
+    void complete(uint64_t key, bool paid, const char *response, size_t length);
+    void forget(uint64_t key);
+
+    PaymentReplayStats getStats() const { return stats_; }
+
+    // Nonce of the signed authorization when present, else a digest of the whole JSON. Never 0.
+    static uint64_t keyFor(const char *json, size_t length);
+
+private:
+    struct Entry
+    {
+        uint64_t key;
+        uint32_t storedAtMs;
+        bool valid;
+        bool inFlight;
+        char response[X4PAY_REPLAY_RESPONSE_BYTES];
+    };
+
+    // What goes to NVS per paid entry
+    struct Persisted
+    {
+        uint64_t key;
+        char response[X4PAY_REPLAY_RESPONSE_BYTES];
+    };
+
+    std::vector<Entry> entries_;
+    size_t capacity_;
+    uint32_t ttlMs_;
+    bool persist_;
+    Preferences prefs_;
+    PaymentReplayStats stats_;
+    SemaphoreHandle_t lock_;
+
+    bool expired(const Entry &entry, uint32_t now) const;
+    Entry *find(uint64_t key);
+    void load();
+    void save();
+};
+
+#endif // PAYMENT_REPLAY_CACHE_H
@@ -0,0 +1,226 @@
+#include "PaymentSession.h"
+#include "BleFrame.h"
+#include "TxFragmenter.h"
+
+PaymentSession PaymentSessionTable::sessions_[X4PAY_MAX_SESSIONS];
+SemaphoreHandle_t PaymentSessionTable::lock_ = nullptr;
+uint32_t PaymentSessionTable::nextGeneration_ = 1;
+
+#if X4PAY_PAYMENT_ARENA_BYTES > 0
+// Static backing for every session arena - allocated once, never returned to the heap
+static uint8_t s_arenaStorage[X4PAY_MAX_SESSIONS][X4PAY_PAYMENT_ARENA_BYTES] __attribute__((aligned(8)));
+#endif
+
+void PaymentSession::reset()
+{
+    // Clearing keeps the allocated buffers so the slot can be reused without reallocating
+    paymentPayload.clear();
+    priceRequestPayload.clear();
+    paymentAssembly.active = false;
+    priceAssembly.active = false;
+    selectedOptions.clear();
+    customContext = "";
+    arena.rewind(scratchMark);
+}
+
+void PaymentSessionTable::begin()
+{
+    if (!lock_)
+        lock_ = xSemaphoreCreateMutex();
+
+    for (size_t i = 0; i < X4PAY_MAX_SESSIONS; ++i)
+    {
+        PaymentSession &session = sessions_[i];
+        session.inUse = false;
+        session.busy = false;
+        session.connHandle = BLE_HS_CONN_HANDLE_NONE;
+        session.generation = 0;
+        session.txChar = nullptr;
+        session.protocol = 0;
+        session.paymentSequence = 0;
+
+#if X4PAY_PAYMENT_ARENA_BYTES > 0
+        // Assembly buffers are fixed carve-outs; the rest is per-payment scratch
+        session.arena.attach(s_arenaStorage[i], X4PAY_PAYMENT_ARENA_BYTES);
+        session.paymentPayload.attach(session.arena.allocateChars(X4PAY_ARENA_PAYLOAD_BYTES), X4PAY_ARENA_PAYLOAD_BYTES);
+        session.priceRequestPayload.attach(session.arena.allocateChars(X4PAY_ARENA_PRICE_BYTES), X4PAY_ARENA_PRICE_BYTES);
+#else
+        // Heap buffers: a central can't make them grow without bound
+        session.paymentPayload.setLimit(X4PAY_MAX_PAYMENT_BYTES);
+        session.priceRequestPayload.setLimit(X4PAY_MAX_PRICE_REQUEST_BYTES);
+#endif
+        session.scratchMark = session.arena.mark();
+        session.reset();
+    }
+}
+
+void PaymentSessionTable::lock()
+{
+    if (lock_)
+        xSemaphoreTake(lock_, portMAX_DELAY);
+}
+
+void PaymentSessionTable::unlock()
+{
+    if (lock_)
+        xSemaphoreGive(lock_);
+}
+
+PaymentSession *PaymentSessionTable::findLocked(uint16_t connHandle)
+{
+    for (size_t i = 0; i < X4PAY_MAX_SESSIONS; ++i)
+    {
+        if (sessions_[i].inUse && sessions_[i].connHandle == connHandle)
+            return &sessions_[i];
+    }
+    return nullptr;
+}
+
+void PaymentSessionTable::recycleLocked(PaymentSession &session)
+{
+    session.inUse = false;
+    session.connHandle = BLE_HS_CONN_HANDLE_NONE;
+    session.txChar = nullptr;
+    session.protocol = 0;
+    // The worker may still be reading the payload; finishPayment resets it then
+    if (!session.busy)
+        session.reset();
+}
+
+// Sessions are only claimed and released from the NimBLE host task, so the
+// returned pointer stays valid for the rest of the write callback.
+PaymentSession *PaymentSessionTable::acquire(uint16_t connHandle, NimBLECharacteristic *txChar)
+{
+    lock();
+    PaymentSession *session = findLocked(connHandle);
+    if (!session)
+    {
+        for (size_t i = 0; i < X4PAY_MAX_SESSIONS; ++i)
+        {
+            if (!sessions_[i].inUse && !sessions_[i].busy)
+            {
+                session = &sessions_[i];
+                session->reset();
+                session->inUse = true;
+                session->connHandle = connHandle;
+                session->generation = nextGeneration_++;
+                session->protocol = 0; // every connection starts on the text protocol
+                break;
+            }
+        }
+    }
+    if (session)
+        session->txChar = txChar;
+    unlock();
+    return session;
+}
+
+PaymentSession *PaymentSessionTable::find(uint16_t connHandle)
+{
+    lock();
+    PaymentSession *session = findLocked(connHandle);
+    unlock();
+    return session;
+}
+
+void PaymentSessionTable::release(uint16_t connHandle)
+{
+    lock();
+    PaymentSession *session = findLocked(connHandle);
+    if (session)
+        recycleLocked(*session);
+    unlock();
+}
+
+void PaymentSessionTable::releaseAll()
+{
+    lock();
+    for (size_t i = 0; i < X4PAY_MAX_SESSIONS; ++i)
+        recycleLocked(sessions_[i]);
+    unlock();
+}
+
+bool PaymentSessionTable::beginPayment(PaymentSession *session)
+{
+    bool started = false;
+    lock();
+    if (session && !session->busy)
+    {
+        session->busy = true;
+        started = true;
+    }
+    unlock();
+    return started;
+}
+
+void PaymentSessionTable::finishPayment(PaymentSession *session)
+{
+    if (!session)
+        return;
+    lock();
+    session->busy = false;
+    session->paymentPayload.clear();
+    session->arena.rewind(session->scratchMark);
+    if (!session->inUse)
+        session->reset();
+    unlock();
+}
+
+size_t PaymentSessionTable::activeCount()
+{
+    size_t count = 0;
+    lock();
+    for (size_t i = 0; i < X4PAY_MAX_SESSIONS; ++i)
+    {
+        if (sessions_[i].inUse)
+            ++count;
+    }
+    unlock();
+    return count;
+}
+
+size_t PaymentSessionTable::bufferedBytes()
+{
+    size_t total = 0;
+    lock();
+    for (size_t i = 0; i < X4PAY_MAX_SESSIONS; ++i)
+    {
+        total += sessions_[i].paymentPayload.length();
+        total += sessions_[i].priceRequestPayload.length();
+    }
+    unlock();
+    return total;
+}
+
+void PaymentSessionTable::setProtocol(uint16_t connHandle, uint8_t protocol)
+{
+    lock();
+    PaymentSession *session = findLocked(connHandle);
+    if (session)
+        session->protocol = protocol;
+    unlock();
+}
+
+bool PaymentSessionTable::notify(uint16_t connHandle, uint32_t generation, const char *data, size_t len)
+{
+    // Copy what the reply needs, then send without holding the table lock
+    NimBLECharacteristic *tx = nullptr;
+    uint8_t protocol = 0;
+    uint8_t sequence = 0;
+    lock();
+    PaymentSession *session = findLocked(connHandle);
+    if (session && session->generation == generation)
+    {
+        tx = session->txChar;
+        protocol = session->protocol;
+        sequence = session->paymentSequence;
+    }
+    unlock();
+
+    if (!tx)
+        return false;
+    if (protocol == 0)
+        return TxFragmenter::reply(tx, connHandle, (const uint8_t *)data, len);
+    return TxFragmenter::replyFramed(tx, connHandle, OpPayment, sequence, FrameResponse | FrameEvent,
+                                     (const uint8_t *)data, len);
+}
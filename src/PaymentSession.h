@@ -0,0 +1,88 @@
+#ifndef PAYMENT_SESSION_H
+#define PAYMENT_SESSION_H
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "PaymentArena.h"
+#include "BleFrame.h"
+
+// Maximum number of centrals that can assemble payments concurrently
+#ifndef X4PAY_MAX_SESSIONS
+#define X4PAY_MAX_SESSIONS 4
+#endif
+
+// Per-connection payment state - one per connected central
+struct PaymentSession
+{
+    uint16_t connHandle;                 // BLE connection handle owning this session
+    uint32_t generation;                 // bumped on every acquire, guards stale responses
+    bool inUse;
+    bool busy;                           // a payment from this session is with the worker
+    PayloadBuffer paymentPayload;        // X-PAYMENT chunks assembled so far
+    PayloadBuffer priceRequestPayload;   // [PRICE] chunks assembled so far
+    std::vector<String> selectedOptions; // options parsed from the last complete request
+    String customContext;                // custom context parsed from the last complete request
+    NimBLECharacteristic *txChar;        // TX characteristic used to answer this central
+    uint8_t protocol;                    // 0 = text commands, else negotiated BleFrame version
+    uint8_t paymentSequence;             // sequence of the frame that completed the payment (framed replies)
+    BleChunkAssembly paymentAssembly;    // ordering/length state of framed payment chunks
+    BleChunkAssembly priceAssembly;      // ordering/length state of framed price chunks
+    PaymentArena arena;                  // per-payment scratch (arena mode), rewound when the payment completes
+    size_t scratchMark;                  // arena offset where per-payment scratch starts
+
+    // Clear per-payment state but keep buffer capacity for reuse
+    void reset();
+
+    // Per-payment scratch memory; nullptr when not in arena mode or exhausted
+    char *scratch(size_t bytes) { return arena.allocateChars(bytes); }
+};
+
+// Fixed-size pool of sessions keyed by connection handle.
+// Accessed from the NimBLE host task (writes, disconnects) and the verify worker (responses).
+class PaymentSessionTable
+{
+public:
+    static void begin();
+
+    // Find the session for connHandle, or claim a free slot. Returns nullptr when the table is full.
+    static PaymentSession *acquire(uint16_t connHandle, NimBLECharacteristic *txChar);
+
+    // Find an existing session, nullptr if the connection has none
+    static PaymentSession *find(uint16_t connHandle);
+
+    // Return the session to the pool (called on disconnect).
+    // A session whose payment is still with the worker is recycled by finishPayment.
+    static void release(uint16_t connHandle);
+    static void releaseAll();
+
+    // Hand the assembled payload to the worker; the buffer stays untouched until finishPayment
+    static bool beginPayment(PaymentSession *session);
+    // Worker is done with the payload: rewind scratch and make the buffer writable again
+    static void finishPayment(PaymentSession *session);
+
+    static size_t activeCount();
+    static size_t bufferedBytes();
+
+    // Switch the connection between text (0) and a framed protocol version
+    static void setProtocol(uint16_t connHandle, uint8_t protocol);
+
+    // Send a notification to the central that owns connHandle, but only if the
+    // session is still the one identified by generation (the central may have left).
+    // Framed connections get it as an OpPayment event frame; long replies are fragmented.
+    static bool notify(uint16_t connHandle, uint32_t generation, const char *data, size_t len);
+
+private:
+    static PaymentSession sessions_[X4PAY_MAX_SESSIONS];
+    static SemaphoreHandle_t lock_;
+    static uint32_t nextGeneration_;
+
+    static PaymentSession *findLocked(uint16_t connHandle);
+    static void recycleLocked(PaymentSession &session);
+    static void lock();
+    static void unlock();
+};
+
+#endif // PAYMENT_SESSION_H
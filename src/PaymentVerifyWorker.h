@@ -1,161 +1,641 @@
 #pragma once
 #include <Arduino.h>
-#include <queue>
+#include <atomic>
 #include "NimBLEDevice.h"
 #include "x4Pay-core.h"
+#include "PaymentSession.h"
 #include "X402Aurdino.h"
+#include "SpscRing.h"
+#include "FacilitatorClient.h"
+#include "AsyncFacilitatorClient.h"
+#include "paymentutils.h"
+#include "SettlementBatch.h"
+#include "PaymentJournal.h"
+#include <new>
 
-// Job struct - will be heap-allocated to avoid shallow copies
+// 1 = drive facilitator requests from an event loop with per-phase deadlines, so each
+// worker keeps up to X4PAY_ASYNC_FACILITATOR_SLOTS payments in flight. 0 = blocking HTTPClient.
+#ifndef X4PAY_ASYNC_FACILITATOR
+#define X4PAY_ASYNC_FACILITATOR 0
+#endif
+
+// Poll interval of the async event loop while requests are in flight
+#ifndef X4PAY_ASYNC_POLL_MS
+#define X4PAY_ASYNC_POLL_MS 2
+#endif
+
+// Verification worker tasks. Each has its own ring and facilitator connection.
+#ifndef X4PAY_VERIFY_WORKERS
+#define X4PAY_VERIFY_WORKERS 1
+#endif
+
+// Facilitator requests allowed in flight across all workers
+#ifndef X4PAY_MAX_INFLIGHT_FACILITATOR
+#define X4PAY_MAX_INFLIGHT_FACILITATOR X4PAY_VERIFY_WORKERS
+#endif
+
+// Payments waiting per worker; a full ring answers PAYMENT:BUSY instead of dropping silently
+#ifndef X4PAY_VERIFY_QUEUE_DEPTH
+#define X4PAY_VERIFY_QUEUE_DEPTH 4
+#endif
+
+// Jobs live in a fixed pool; only a pointer travels through the rings.
+// Default covers every ring full plus the job each worker is processing.
+#ifndef X4PAY_VERIFY_JOB_POOL
+#define X4PAY_VERIFY_JOB_POOL (X4PAY_VERIFY_WORKERS * (X4PAY_VERIFY_QUEUE_DEPTH + 1))
+#endif
+
+// Counters for the job path: copies/moves prove nothing is copied, the rest show queue pressure
+struct VerifyJobStats
+{
+    uint32_t constructed;     // jobs filled in place in the pool
+    uint32_t copies;          // VerifyJob copy-constructions/assignments (expected 0)
+    uint32_t moves;           // VerifyJob moves (only via the enqueue(VerifyJob&&) convenience)
+    uint32_t enqueued;        // jobs accepted by the ring
+    uint32_t dropped;         // jobs refused (pool or ring full) - the central got PAYMENT:BUSY
+    uint32_t depth;           // jobs currently waiting across all rings
+    uint32_t highWaterDepth;  // deepest any ring has been
+};
+
+// Job struct - lives in the worker's pool, handed over by pointer
+// The payload is borrowed from the session, which stays busy until the worker finishes.
 struct VerifyJob
 {
-    String payload;               // assembled payment payload (JSON only)
-    String requirements;          // paymentRequirements snapshot
-    NimBLECharacteristic *txChar; // TX to respond on
-    String customContext;         // user's custom context
-    std::vector<String> selectedOptions; // user's selected options
+    const char *payload = nullptr;       // assembled payment JSON inside session->paymentPayload
+    size_t payloadLength = 0;
+    PaymentSession *session = nullptr;   // owner of payload, options, context and scratch
+    NimBLECharacteristic *txChar = nullptr; // TX to respond on
+    uint16_t connHandle = BLE_HS_CONN_HANDLE_NONE; // central that submitted the payment
+    uint32_t sessionGeneration = 0;               // session identity at submit time
+    uint32_t journalId = 0;                       // PaymentJournal id, 0 when not journaled
+    uint64_t replayKey = 0;                       // PaymentReplayCache key, 0 when not cached
+
+    VerifyJob() = default;
+    VerifyJob(const VerifyJob &other) { assign(other); copies_++; }
+    VerifyJob(VerifyJob &&other) noexcept { assign(other); moves_++; }
+    VerifyJob &operator=(const VerifyJob &other) { assign(other); copies_++; return *this; }
+    VerifyJob &operator=(VerifyJob &&other) noexcept { assign(other); moves_++; return *this; }
+
+    // Reset a recycled pool slot in place
+    void clear() { assign(VerifyJob::empty()); }
+
+    static std::atomic<uint32_t> copies_;
+    static std::atomic<uint32_t> moves_;
+
+private:
+    static const VerifyJob &empty()
+    {
+        static const VerifyJob blank;
+        return blank;
+    }
+
+    void assign(const VerifyJob &other)
+    {
+        payload = other.payload;
+        payloadLength = other.payloadLength;
+        session = other.session;
+        txChar = other.txChar;
+        connHandle = other.connHandle;
+        sessionGeneration = other.sessionGeneration;
+        journalId = other.journalId;
+        replayKey = other.replayKey;
+    }
 };
+inline std::atomic<uint32_t> VerifyJob::copies_{0};
+inline std::atomic<uint32_t> VerifyJob::moves_{0};
 
 class PaymentVerifyWorker
 {
 public:
-    static void begin(size_t stackBytes = 8192, UBaseType_t prio = 3, BaseType_t core = 1)
+    // Pass as core to begin() to alternate workers across the available cores
+    static const BaseType_t SPREAD_CORES = -2;
+
+    // Starts `workers` tasks (at most X4PAY_VERIFY_WORKERS). core pins every worker to one core,
+    // SPREAD_CORES alternates them, tskNO_AFFINITY leaves them to the scheduler.
+    static void begin(size_t stackBytes = 8192, UBaseType_t prio = 3, BaseType_t core = 1,
+                      size_t workers = X4PAY_VERIFY_WORKERS)
+    {
+        if (workerCount_ > 0)
+            return;
+        if (workers < 1)
+            workers = 1;
+        if (workers > X4PAY_VERIFY_WORKERS)
+            workers = X4PAY_VERIFY_WORKERS;
+
+        if (!inflight_)
+            inflight_ = xSemaphoreCreateCounting(X4PAY_MAX_INFLIGHT_FACILITATOR, X4PAY_MAX_INFLIGHT_FACILITATOR);
+        if (!callbackLock_)
+            callbackLock_ = xSemaphoreCreateMutex();
+
+        for (size_t i = 0; i < workers; ++i)
+        {
+            Worker &worker = workers_[i];
+            worker.index = i;
+            BaseType_t workerCore = core == SPREAD_CORES ? (BaseType_t)(i % portNUM_PROCESSORS) : core;
+            char name[16];
+            snprintf(name, sizeof(name), i == 0 ? "pay_verify" : "pay_verify%u", (unsigned)i);
+            xTaskCreatePinnedToCore(taskTrampoline, name, stackBytes / sizeof(StackType_t),
+                                    &worker, prio, &worker.task, workerCore);
+        }
+        workerCount_ = workers;
+    }
+
+    // Claim a pooled job to fill in place. nullptr when every slot is in flight.
+    static VerifyJob *acquireJob()
     {
-        if (!q_)
-            q_ = xQueueCreate(4, sizeof(VerifyJob *)); // queue of pointers, not objects
-        xTaskCreatePinnedToCore(taskTrampoline, "pay_verify", stackBytes / sizeof(StackType_t),
-                                nullptr, prio, nullptr, core);
+        for (size_t i = 0; i < X4PAY_VERIFY_JOB_POOL; ++i)
+        {
+            bool expected = false;
+            if (slotUsed_[i].compare_exchange_strong(expected, true))
+            {
+                pool_[i].clear();
+                constructed_++;
+                return &pool_[i];
+            }
+        }
+        return nullptr;
     }
 
-    static bool enqueue(VerifyJob &&job)
+    // Hand a job from acquireJob() to a worker. Ownership moves with the pointer;
+    // on failure the job has already been returned to the pool.
+    // Only the NimBLE host task submits, so every ring has a single producer.
+    // A connection always maps to the same worker, so its payments stay in order.
+    static bool submit(VerifyJob *job)
     {
-        if (!q_)
-            return false;
-        // Allocate job on heap with deep ownership transfer
-        VerifyJob *heapJob = new (std::nothrow) VerifyJob();
-        if (!heapJob)
+        Worker *worker = (job && workerCount_ > 0) ? &workers_[job->connHandle % workerCount_] : nullptr;
+        if (!worker || !worker->ring.push(job))
+        {
+            if (job)
+                releaseJob(job);
+            dropped_++;
             return false;
+        }
+        enqueued_++;
+        uint32_t depth = worker->ring.size();
+        if (depth > highWater_)
+            highWater_ = depth;
+        xTaskNotifyGive(worker->task);
+        return true;
+    }
 
-        // Move strings to avoid copies
-        heapJob->payload = job.payload;
-        heapJob->requirements = job.requirements;
-        heapJob->txChar = job.txChar;
-        heapJob->customContext = job.customContext;
-        heapJob->selectedOptions = job.selectedOptions;
-
-        // Queue the pointer (POD), not the object
-        if (xQueueSend(q_, &heapJob, 0) != pdTRUE)
+    // Convenience for callers holding a job by value: one move into the pool
+    static bool enqueue(VerifyJob &&job)
+    {
+        VerifyJob *slot = acquireJob();
+        if (!slot)
         {
-            delete heapJob;
+            dropped_++;
             return false;
         }
-        return true;
+        *slot = std::move(job);
+        return submit(slot);
+    }
+
+    static size_t workerCount() { return workerCount_; }
+
+    // Connect / first-byte / total deadlines per facilitator endpoint (async mode).
+    // Applied to requests started after the call.
+    static void setFacilitatorDeadlines(FacilitatorEndpoint endpoint, const FacilitatorDeadlines &deadlines)
+    {
+        if (endpoint < FacilitatorEndpointCount)
+            deadlines_[endpoint] = deadlines;
+    }
+    static const FacilitatorDeadlines &getFacilitatorDeadlines(FacilitatorEndpoint endpoint) { return deadlines_[endpoint]; }
+
+    static VerifyJobStats getStats()
+    {
+        VerifyJobStats stats;
+        stats.constructed = constructed_;
+        stats.copies = VerifyJob::copies_;
+        stats.moves = VerifyJob::moves_;
+        stats.enqueued = enqueued_;
+        stats.dropped = dropped_;
+        stats.depth = 0;
+        for (size_t i = 0; i < workerCount_; ++i)
+            stats.depth += workers_[i].ring.size();
+        stats.highWaterDepth = highWater_;
+        return stats;
+    }
+
+    // Serializes user callbacks and payment state updates (also used by the settlement task
+    // and x4PayCore::resolvePrice). Not recursive: don't call resolvePrice while holding it.
+    static void lockCallbacks()
+    {
+        if (callbackLock_)
+            xSemaphoreTake(callbackLock_, portMAX_DELAY);
+    }
+
+    static void unlockCallbacks()
+    {
+        if (callbackLock_)
+            xSemaphoreGive(callbackLock_);
     }
 
 private:
-    static QueueHandle_t q_;
-    static void taskTrampoline(void *)
+    struct Worker
+    {
+        TaskHandle_t task = nullptr;
+        SpscRing<VerifyJob *, X4PAY_VERIFY_QUEUE_DEPTH> ring;
+        size_t index = 0;
+    };
+
+    static Worker workers_[X4PAY_VERIFY_WORKERS];
+    static size_t workerCount_;
+    static SemaphoreHandle_t inflight_;     // counts free facilitator request slots
+    static SemaphoreHandle_t callbackLock_; // serializes user callbacks and payment state updates
+    static VerifyJob pool_[X4PAY_VERIFY_JOB_POOL];
+    static std::atomic<bool> slotUsed_[X4PAY_VERIFY_JOB_POOL];
+    static std::atomic<uint32_t> constructed_;
+    static std::atomic<uint32_t> enqueued_;
+    static std::atomic<uint32_t> dropped_;
+    static std::atomic<uint32_t> highWater_;
+    static FacilitatorDeadlines deadlines_[FacilitatorEndpointCount];
+
+    static void releaseJob(VerifyJob *job)
+    {
+        slotUsed_[job - pool_].store(false);
+    }
+
+    static void taskTrampoline(void *arg)
     {
+        Worker *worker = static_cast<Worker *>(arg);
+
+#if X4PAY_ASYNC_FACILITATOR
+        AsyncFacilitatorClient *async = new (std::nothrow) AsyncFacilitatorClient();
+        if (async)
+            runAsync(worker, *async); // never returns
+#endif
+
+        // Extra workers get their own kept-alive facilitator connection; worker 0 uses the shared one
+        FacilitatorClient *client = nullptr;
+        if (worker->index > 0)
+        {
+            client = new (std::nothrow) FacilitatorClient();
+            FacilitatorClient::bindToCurrentTask(client);
+        }
+
         for (;;)
         {
             VerifyJob *job = nullptr;
-            if (xQueueReceive(q_, &job, portMAX_DELAY) == pdTRUE && job)
+            if (!worker->ring.pop(job))
+            {
+                // Sleep until submit() signals a new job
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                continue;
+            }
+            if (job)
+            {
+                // Follow CA changes made on the shared client (setting it drops the connection)
+                const char *rootCA = FacilitatorClient::shared().getCACert();
+                if (client && client->getCACert() != rootCA)
+                    client->setCACert(rootCA);
+                process(job);
+                // Return the job slot to the pool
+                releaseJob(job);
+            }
+        }
+    }
+
+    // Requirements a payment is verified and settled against
+    struct PreparedPayment
+    {
+        const char *requirements = nullptr;
+        size_t requirementsLength = 0;
+        String heapRequirements; // only used without arena scratch; keeps its capacity
+    };
+
+    static void prepare(VerifyJob *job, x4PayCore *ble, PreparedPayment &prepared)
+    {
+        PaymentSession *session = job->session;
+
+        // Static price: the prebuilt requirements are used as-is
+        prepared.requirements = ble->paymentRequirements.c_str();
+        prepared.requirementsLength = ble->paymentRequirements.length();
+        if (!ble->getDynamicPriceCallback())
+            return;
+
+        // Same price as quoted for [PRICE] when the price cache is enabled.
+        // resolvePrice takes the callback lock itself, so it must not be held here.
+        String dynamicPrice = ble->resolvePrice(session->selectedOptions, session->customContext);
+
+        // Splice the dynamic price into the template, in session scratch when there is an arena
+        size_t needed = ble->paymentRequirementsLength(dynamicPrice.c_str()) + 1;
+        char *scratch = session->scratch(needed);
+        if (scratch)
+        {
+            prepared.requirementsLength = ble->renderPaymentRequirements(scratch, needed, dynamicPrice.c_str());
+            prepared.requirements = scratch;
+        }
+        else
+        {
+            prepared.heapRequirements = ble->buildPaymentRequirements(dynamicPrice);
+            prepared.requirements = prepared.heapRequirements.c_str();
+            prepared.requirementsLength = prepared.heapRequirements.length();
+        }
+    }
+
+    // Batch mode: persist the verified payment for the settlement task instead of settling now.
+    // A full store (or a failed write) falls through to settling directly.
+    static bool deferSettlement(VerifyJob *job, const PreparedPayment &prepared, SettlementResult &settlement)
+    {
+        if (!SettlementBatch::enabled() ||
+            !SettlementBatch::add(job->payload, job->payloadLength, prepared.requirements, prepared.requirementsLength))
+            return false;
+        PaymentJournal::deferred(job->journalId);
+        settlement.success = true;
+        return true;
+    }
+
+    // Verified payload on flash before anything acts on the verification
+    static void recordVerified(VerifyJob *job, const PreparedPayment &prepared)
+    {
+        PaymentJournal::verified(job->journalId, job->payload, job->payloadLength,
+                                 prepared.requirements, prepared.requirementsLength);
+    }
+
+    // Early acknowledgement: the central hears back after one round trip, settlement follows
+    static void announceVerified(VerifyJob *job, x4PayCore *ble)
+    {
+        if (!ble->isEarlyAcknowledgeEnabled())
+            return;
+
+        static const char kVerified[] = "PAYMENT:VERIFIED";
+        if (job->txChar)
+            PaymentSessionTable::notify(job->connHandle, job->sessionGeneration, kVerified, sizeof(kVerified) - 1);
+
+        OnPayCallback onVerified = ble->getOnVerifiedCallback();
+        if (onVerified)
+        {
+            lockCallbacks();
+            onVerified(job->session->selectedOptions, job->session->customContext);
+            unlockCallbacks();
+        }
+    }
+
+    // Record the outcome, run user callbacks, answer the central and release the session
+    static void complete(VerifyJob *job, x4PayCore *ble, bool verified, bool ok, const SettlementResult &settlement)
+    {
+        PaymentSession *session = job->session;
+        bool early = ble && ble->isEarlyAcknowledgeEnabled();
+
+        // Outcome is journaled before the app hears about it
+        if (ok && settlement.transaction[0] != '\0')
+            PaymentJournal::settled(job->journalId, settlement.transaction, settlement.payer);
+        else if (!ok)
+            PaymentJournal::failed(job->journalId);
+
+        // Update global last payment state if we have an instance
+        // Only set user context/options if payment was successful
+        if (ok && ble) {
+            lockCallbacks();
+            ble->setLastPaymentState(true, settlement.transaction, settlement.payer);
+            // Set user selections only on successful payment
+            ble->setUserCustomContext(session->customContext);
+            ble->setUserSelectedOptions(session->selectedOptions);
+
+            // Call onPay callback if set
+            if (ble->getOnPayCallback() != nullptr) {
+                ble->getOnPayCallback()(session->selectedOptions, session->customContext);
+            }
+            unlockCallbacks();
+        }
+        else if (verified && early && ble->getOnRollbackCallback()) {
+            // Verified but not settled: undo whatever the provisional callback granted
+            lockCallbacks();
+            ble->getOnRollbackCallback()(session->selectedOptions, session->customContext, settlement.errorReason);
+            unlockCallbacks();
+        }
+
+        // Build and send response with transaction hash if available
+        char resp[128];
+        int respLength;
+        if (early && verified)
+        {
+            if (ok && settlement.transaction[0] == '\0')
+                respLength = snprintf(resp, sizeof(resp), "PAYMENT:QUEUED"); // batch settlement pending
+            else if (ok)
+                respLength = snprintf(resp, sizeof(resp), "PAYMENT:SETTLED TX:%s", settlement.transaction);
+            else
+                respLength = snprintf(resp, sizeof(resp), "PAYMENT:ROLLBACK REASON:%s",
+                                      settlement.errorReason[0] != '\0' ? settlement.errorReason : "settle_failed");
+        }
+        else if (ok && settlement.transaction[0] != '\0')
+            respLength = snprintf(resp, sizeof(resp), "PAYMENT:COMPLETE VERIFIED:true TX:%s", settlement.transaction);
+        else
+            respLength = snprintf(resp, sizeof(resp), ok ? "PAYMENT:COMPLETE VERIFIED:true" : "PAYMENT:COMPLETE VERIFIED:false");
+
+        // A resubmission of this payload gets the same answer from the replay cache
+        if (ble && job->replayKey && respLength > 0)
+            ble->getReplayCache().complete(job->replayKey, ok, resp, (size_t)respLength);
+
+        // Answer only the central that paid, and only if it is still connected
+        if (job->txChar && respLength > 0)
+        {
+            PaymentSessionTable::notify(job->connHandle, job->sessionGeneration, resp, (size_t)respLength);
+        }
+
+        PaymentJournal::completed(job->journalId);
+
+        // Payload and scratch are released back to the session
+        PaymentSessionTable::finishPayment(session);
+    }
+
+    // Blocking verify then settle on this task
+    static void process(VerifyJob *job)
+    {
+        // ---- Do the heavy work OFF the NimBLE host stack ----
+        bool ok = false;
+        bool verified = false;
+        SettlementResult settlement;
+
+        // Get active x4PayCore instance (used multiple times)
+        x4PayCore* ble = x4PayCore::getActiveInstance();
+
+        if (ble && job->session)
+        {
+            // Bound concurrent facilitator traffic across workers
+            if (inflight_)
+                xSemaphoreTake(inflight_, portMAX_DELAY);
+
+            job->journalId = PaymentJournal::accepted();
+
+            // Version is located in place - the JSON is never copied
+            PaymentPayloadView payload(job->payload, job->payloadLength);
+            PreparedPayment prepared;
+            prepare(job, ble, prepared);
+
+            ok = verifyPayment(payload, prepared.requirements, prepared.requirementsLength, "", ble->getFacilitator());
+            verified = ok;
+
+            // If verification succeeded, settle the payment
+            if (ok)
             {
-                // ---- Do the heavy work OFF the NimBLE host stack ----
-                bool ok = false;
-                PaymentPayload *payload = nullptr;
-
-                // Avoid exceptions on ESP32 - use std::nothrow for safer allocation
-                payload = new (std::nothrow) PaymentPayload(job->payload);
-                String txHash = "";
-                String payer = "";
-                String dynamicRequirements = job->requirements; // Default to passed requirements
-                
-                // Get active x4PayCore instance (used multiple times)
-                x4PayCore* ble = x4PayCore::getActiveInstance();
-                
-                if (payload && ble)
+                recordVerified(job, prepared);
+                announceVerified(job, ble);
+
+                // Reply is parsed into fixed-size fields in one pass - no string searching here
+                if (!deferSettlement(job, prepared, settlement))
+                    settlement = settlePayment(payload, prepared.requirements, prepared.requirementsLength, "", ble->getFacilitator());
+                // Only consider paid if settlement succeeded and we have a hash (or it is safely queued)
+                ok = settlement.success;
+            }
+
+            if (inflight_)
+                xSemaphoreGive(inflight_);
+        }
+
+        complete(job, ble, verified, ok, settlement);
+    }
+
+#if X4PAY_ASYNC_FACILITATOR
+    // One payment moving through verify -> settle on an async worker
+    struct AsyncPayment
+    {
+        VerifyJob *job = nullptr;
+        PreparedPayment prepared;
+        SegmentedBodyStream body; // same request body for verify and settle
+        String url;
+        int request = -1;         // slot in the worker's AsyncFacilitatorClient, -1 if not started
+        bool settling = false;
+        bool holdsInflight = false;
+    };
+
+    static void finishAsync(AsyncPayment &payment, x4PayCore *ble, bool verified, bool ok, const SettlementResult &settlement)
+    {
+        if (payment.holdsInflight && inflight_)
+            xSemaphoreGive(inflight_);
+        complete(payment.job, ble, verified, ok, settlement);
+        releaseJob(payment.job);
+        payment.job = nullptr;
+        payment.request = -1;
+        payment.settling = false;
+        payment.holdsInflight = false;
+    }
+
+    // Event loop: up to X4PAY_ASYNC_FACILITATOR_SLOTS payments in flight on this one task
+    static void runAsync(Worker *worker, AsyncFacilitatorClient &client)
+    {
+        AsyncPayment payments[X4PAY_ASYNC_FACILITATOR_SLOTS];
+
+        for (;;)
+        {
+            x4PayCore *ble = x4PayCore::getActiveInstance();
+
+            // Admit queued jobs into free pipeline entries
+            for (auto &payment : payments)
+            {
+                if (payment.job)
+                    continue;
+                VerifyJob *job = nullptr;
+                if (!worker->ring.pop(job))
+                    break;
+                payment.job = job;
+                if (!ble || !job->session)
                 {
-                    // Calculate dynamic price if callback is set
-                    String dynamicPrice = ble->getPrice(); // Default to static price
-                    if (ble->getDynamicPriceCallback() != nullptr) {
-                        dynamicPrice = ble->getDynamicPriceCallback()(job->selectedOptions, job->customContext);
-                        
-                    }
-                    
-                    // Build payment requirements with dynamic price
-                    dynamicRequirements = buildDefaultPaymentRementsJson(
-                        ble->getNetwork(),      // network
-                        ble->getPayTo(),        // payTo address
-                        dynamicPrice,           // dynamic price based on options/context
-                        ble->getLogo(),         // logo
-                        ble->getDescription()   // description
-                    );
-                    
-                    
-                    ok = verifyPayment(*payload, dynamicRequirements, "", ble->getFacilitator());
-                    
-                    
-                    // If verification succeeded, settle the payment
-                    if (ok)
-                    {
-                        String txResp = settlePayment(*payload, dynamicRequirements, "", ble->getFacilitator());
-                        // Expecting JSON like: {"success":true,"transaction":"0x...","network":"...","payer":"0x..."}
-                        // Minimal, allocation-light parsing
-                        int txPos = txResp.indexOf("\"transaction\":\"");
-                        if (txPos >= 0) {
-                            txPos += 15; // length of "transaction":"
-                            int txEnd = txResp.indexOf('"', txPos);
-                            if (txEnd > txPos) txHash = txResp.substring(txPos, txEnd);
-                        }
-                        int payerPos = txResp.indexOf("\"payer\":\"");
-                        if (payerPos >= 0) {
-                            payerPos += 10; // length of "payer":"
-                            int payerEnd = txResp.indexOf('"', payerPos);
-                            if (payerEnd > payerPos) payer = txResp.substring(payerPos, payerEnd);
-                        }
-                        // Optional success flag
-                        bool settledOk = txResp.indexOf("\"success\":true") >= 0;
-                        // Only consider paid if settlement succeeded and we have a hash
-                        ok = ok && settledOk && (txHash.length() > 0);
-                    }
-                    
-                    delete payload;
-                    payload = nullptr;
+                    finishAsync(payment, ble, false, false, SettlementResult());
+                    continue;
                 }
 
-                // Update global last payment state if we have an instance
-                // Only set user context/options if payment was successful
-                if (ok && ble) {
-                    ble->setLastPaymentState(true, txHash, payer);   
-                    // Set user selections only on successful payment
-                    ble->setUserCustomContext(job->customContext);
-                    ble->setUserSelectedOptions(job->selectedOptions);
-                    
-                    // Call onPay callback if set
-                    if (ble->getOnPayCallback() != nullptr) {
-                        
-                        ble->getOnPayCallback()(job->selectedOptions, job->customContext);
-                    }
+                for (uint8_t endpoint = 0; endpoint < FacilitatorEndpointCount; ++endpoint)
+                    client.setDeadlines((FacilitatorEndpoint)endpoint, deadlines_[endpoint]);
+                const char *rootCA = FacilitatorClient::shared().getCACert();
+                if (client.getCACert() != rootCA)
+                    client.setCACert(rootCA);
+
+                job->journalId = PaymentJournal::accepted();
+                prepare(job, ble, payment.prepared);
+                PaymentPayloadView view(job->payload, job->payloadLength);
+                buildPaymentRequestBody(view, payment.prepared.requirements, payment.prepared.requirementsLength, payment.body);
+            }
+
+            // Start requests that are waiting for a facilitator slot
+            bool active = false;
+            for (auto &payment : payments)
+            {
+                if (!payment.job)
+                    continue;
+                active = true;
+                if (payment.request >= 0)
+                    continue;
+                if (!payment.holdsInflight)
+                {
+                    if (inflight_ && xSemaphoreTake(inflight_, 0) != pdTRUE)
+                        continue;
+                    payment.holdsInflight = true;
                 }
+                // Copied into the slot's String, which keeps its capacity from one payment to the next
+                char url[X4PAY_FACILITATOR_URL_BYTES];
+                const char *endpoint = payment.settling ? "settle" : "verify";
+                if (buildFacilitatorUrl(url, sizeof(url), ble->getFacilitator().c_str(), endpoint))
+                    payment.url = url;
+                else
+                    payment.url = buildFacilitatorUrl(ble->getFacilitator(), endpoint);
+                payment.request = client.start(payment.settling ? FacilitatorSettle : FacilitatorVerify, payment.url, payment.body);
+            }
+
+            if (!active)
+            {
+                // Sleep until submit() signals a new job
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                continue;
+            }
 
-                // Build and send response with transaction hash if available
-                String resp = ok ? "PAYMENT:COMPLETE VERIFIED:true" : "PAYMENT:COMPLETE VERIFIED:false";
-                if (ok && txHash.length() > 0)
+            client.poll();
+
+            for (auto &payment : payments)
+            {
+                if (!payment.job || payment.request < 0)
+                    continue;
+                AsyncFacilitatorRequest &request = client.request(payment.request);
+                if (!request.finished())
+                    continue;
+
+                HttpResponse response = request.response();
+                if (!payment.settling)
                 {
-                    resp += " TX:";
-                    resp += txHash;
+                    bool verified = verifyResultFrom(response, request.result());
+                    client.release(payment.request);
+                    payment.request = -1;
+                    if (verified)
+                    {
+                        recordVerified(payment.job, payment.prepared);
+                        announceVerified(payment.job, ble);
+                        SettlementResult queued;
+                        if (deferSettlement(payment.job, payment.prepared, queued))
+                            finishAsync(payment, ble, true, true, queued);
+                        else
+                            payment.settling = true; // settle request is started on the next pass
+                    }
+                    else
+                    {
+                        finishAsync(payment, ble, false, false, SettlementResult());
+                    }
                 }
-                
-                if (job->txChar)
+                else
                 {
-                    job->txChar->setValue((const uint8_t *)resp.c_str(), resp.length());
-                    job->txChar->notify();
+                    SettlementResult settlement = settlementResultFrom(response, request.result());
+                    client.release(payment.request);
+                    finishAsync(payment, ble, true, settlement.success, settlement);
                 }
-
-                // Free the heap-allocated job
-                delete job;
             }
+
+            // Nothing blocks above; yield briefly (a new job wakes the task early)
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(X4PAY_ASYNC_POLL_MS));
         }
     }
+#endif
+};
+inline PaymentVerifyWorker::Worker PaymentVerifyWorker::workers_[X4PAY_VERIFY_WORKERS];
+inline size_t PaymentVerifyWorker::workerCount_ = 0;
+inline SemaphoreHandle_t PaymentVerifyWorker::inflight_ = nullptr;
+inline SemaphoreHandle_t PaymentVerifyWorker::callbackLock_ = nullptr;
+inline VerifyJob PaymentVerifyWorker::pool_[X4PAY_VERIFY_JOB_POOL];
+inline std::atomic<bool> PaymentVerifyWorker::slotUsed_[X4PAY_VERIFY_JOB_POOL] = {};
+inline std::atomic<uint32_t> PaymentVerifyWorker::constructed_{0};
+inline std::atomic<uint32_t> PaymentVerifyWorker::enqueued_{0};
+inline std::atomic<uint32_t> PaymentVerifyWorker::dropped_{0};
+inline std::atomic<uint32_t> PaymentVerifyWorker::highWater_{0};
+inline FacilitatorDeadlines PaymentVerifyWorker::deadlines_[FacilitatorEndpointCount] = {
+    {10000, 15000, 30000}, // verify
+    {10000, 50000, 60000}, // settle
 };
-inline QueueHandle_t PaymentVerifyWorker::q_ = nullptr;
\ No newline at end of file
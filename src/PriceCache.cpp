@@ -0,0 +1,154 @@
+#include "PriceCache.h"
+
+static const uint64_t kFnvOffset = 1469598103934665603ULL;
+static const uint64_t kFnvPrime = 1099511628211ULL;
+
+static uint64_t fnvMix(uint64_t hash, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= (uint8_t)data[i];
+        hash *= kFnvPrime;
+    }
+    return hash;
+}
+
+static uint64_t fnvMixLength(uint64_t hash, uint32_t len)
+{
+    return fnvMix(hash, (const char *)&len, sizeof(len));
+}
+
+PriceCache::PriceCache() : capacity_(0), ttlMs_(0), clock_(0), stats_{0, 0, 0}
+{
+    lock_ = xSemaphoreCreateMutex();
+}
+
+PriceCache::~PriceCache()
+{
+    if (lock_)
+        vSemaphoreDelete(lock_);
+}
+
+uint64_t PriceCache::keyFor(const std::vector<String> &options, const String &customContext)
+{
+    uint64_t hash = kFnvOffset;
+    hash = fnvMixLength(hash, customContext.length());
+    hash = fnvMix(hash, customContext.c_str(), customContext.length());
+    hash = fnvMixLength(hash, options.size());
+    for (const auto &opt : options)
+    {
+        hash = fnvMixLength(hash, opt.length());
+        hash = fnvMix(hash, opt.c_str(), opt.length());
+    }
+    return hash;
+}
+
+void PriceCache::configure(size_t capacity, uint32_t ttlMs)
+{
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    entries_.clear();
+    entries_.shrink_to_fit();
+    capacity_ = capacity;
+    ttlMs_ = ttlMs;
+    if (capacity_ > 0)
+    {
+        // Allocate all slots up front - the cache never grows afterwards
+        entries_.resize(capacity_);
+        for (auto &entry : entries_)
+        {
+            entry.valid = false;
+            entry.key = 0;
+            entry.storedAtMs = 0;
+            entry.lastUsed = 0;
+        }
+    }
+    xSemaphoreGive(lock_);
+}
+
+bool PriceCache::expired(const Entry &entry, uint32_t now) const
+{
+    return ttlMs_ > 0 && (now - entry.storedAtMs) > ttlMs_;
+}
+
+bool PriceCache::lookup(uint64_t key, String &price)
+{
+    if (!enabled())
+        return false;
+
+    bool hit = false;
+    uint32_t now = millis();
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    for (auto &entry : entries_)
+    {
+        if (!entry.valid || entry.key != key)
+            continue;
+        if (expired(entry, now))
+        {
+            entry.valid = false;
+            break;
+        }
+        entry.lastUsed = ++clock_;
+        price = entry.price;
+        hit = true;
+        break;
+    }
+    if (hit)
+        stats_.hits++;
+    else
+        stats_.misses++;
+    xSemaphoreGive(lock_);
+    return hit;
+}
+
+void PriceCache::store(uint64_t key, const String &price)
+{
+    if (!enabled())
+        return;
+
+    uint32_t now = millis();
+    xSemaphoreTake(lock_, portMAX_DELAY);
+
+    // Reuse the key's slot, else a free or expired slot, else the least recently used
+    Entry *slot = nullptr;
+    for (auto &entry : entries_)
+    {
+        if (entry.valid && entry.key == key)
+        {
+            slot = &entry;
+            break;
+        }
+    }
+    if (!slot)
+    {
+        for (auto &entry : entries_)
+        {
+            if (!entry.valid || expired(entry, now))
+            {
+                slot = &entry;
+                break;
+            }
+            if (!slot || entry.lastUsed < slot->lastUsed)
+                slot = &entry;
+        }
+        if (slot->valid && !expired(*slot, now))
+            stats_.evictions++;
+    }
+
+    slot->key = key;
+    slot->price = price;
+    slot->storedAtMs = now;
+    slot->lastUsed = ++clock_;
+    slot->valid = true;
+    xSemaphoreGive(lock_);
+}
+
+void PriceCache::clear()
+{
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    for (auto &entry : entries_)
+    {
+        entry.valid = false;
+        entry.price = "";
+    }
+    xSemaphoreGive(lock_);
+}
@@ -0,0 +1,60 @@
+#ifndef PRICE_CACHE_H
+#define PRICE_CACHE_H
+
+#include <Arduino.h>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+struct PriceCacheStats
+{
+    uint32_t hits;
+    uint32_t misses;    // includes expired entries
+    uint32_t evictions;
+};
+
+// Bounded LRU of DynamicPriceCallback results keyed by (selectedOptions, customContext).
+// Lets the price quoted for [PRICE] be reused when the same payment is verified,
+// so the user callback runs once and the charged price matches the quote.
+// Disabled (capacity 0) until configure() is called.
+class PriceCache
+{
+public:
+    PriceCache();
+    ~PriceCache();
+
+    // capacity 0 disables the cache; ttlMs 0 means entries never expire
+    void configure(size_t capacity, uint32_t ttlMs);
+    bool enabled() const { return capacity_ > 0; }
+
+    bool lookup(uint64_t key, String &price);
+    void store(uint64_t key, const String &price);
+    void clear();
+
+    PriceCacheStats getStats() const { return stats_; }
+
+    // 64-bit FNV-1a over the options and context, each length-prefixed so
+    // ["a,b"] and ["a","b"] hash differently
+    static uint64_t keyFor(const std::vector<String> &options, const String &customContext);
+
+private:
+    struct Entry
+    {
+        uint64_t key;
+        String price;
+        uint32_t storedAtMs;
+        uint32_t lastUsed;
+        bool valid;
+    };
+
+    std::vector<Entry> entries_;
+    size_t capacity_;
+    uint32_t ttlMs_;
+    uint32_t clock_;
+    PriceCacheStats stats_;
+    SemaphoreHandle_t lock_;
+
+    bool expired(const Entry &entry, uint32_t now) const;
+};
+
+#endif // PRICE_CACHE_H
@@ -0,0 +1,294 @@
+#include "ResumableTlsClient.h"
+#include "stackmonitor.h"
+#include <string.h>
+
+static const char *kDrbgPersonalization = "x4pay-tls";
+
+ResumableTlsClient::ResumableTlsClient(TlsSessionCache &cache)
+    : cache_(cache), rootCA_(nullptr), handshakeTimeoutMs_(10000),
+      peeked_(-1), ready_(false), resumed_(false), offered_(false)
+{
+}
+
+ResumableTlsClient::~ResumableTlsClient()
+{
+    stop();
+}
+
+int ResumableTlsClient::bioSend(void *ctx, const unsigned char *buf, size_t len)
+{
+    WiFiClient *tcp = static_cast<WiFiClient *>(ctx);
+    if (!tcp->connected())
+        return MBEDTLS_ERR_NET_CONN_RESET;
+    size_t sent = tcp->write(buf, len);
+    return sent > 0 ? (int)sent : MBEDTLS_ERR_SSL_WANT_WRITE;
+}
+
+int ResumableTlsClient::bioRecv(void *ctx, unsigned char *buf, size_t len)
+{
+    WiFiClient *tcp = static_cast<WiFiClient *>(ctx);
+    if (tcp->available() <= 0)
+        return tcp->connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+    int got = tcp->read(buf, len);
+    return got > 0 ? got : MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+bool ResumableTlsClient::setup(const char *host)
+{
+    mbedtls_ssl_init(&ssl_);
+    mbedtls_ssl_config_init(&conf_);
+    mbedtls_ctr_drbg_init(&drbg_);
+    mbedtls_entropy_init(&entropy_);
+    mbedtls_x509_crt_init(&ca_);
+    ready_ = true; // contexts are live from here on and must be torn down
+
+    if (mbedtls_ctr_drbg_seed(&drbg_, mbedtls_entropy_func, &entropy_,
+                              (const unsigned char *)kDrbgPersonalization, strlen(kDrbgPersonalization)) != 0)
+        return false;
+
+    if (mbedtls_ssl_config_defaults(&conf_, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) != 0)
+        return false;
+
+    if (rootCA_)
+    {
+        if (mbedtls_x509_crt_parse(&ca_, (const unsigned char *)rootCA_, strlen(rootCA_) + 1) != 0)
+            return false;
+        mbedtls_ssl_conf_ca_chain(&conf_, &ca_, nullptr);
+        mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_REQUIRED);
+    }
+    else
+    {
+        mbedtls_ssl_conf_authmode(&conf_, MBEDTLS_SSL_VERIFY_NONE);
+    }
+
+    mbedtls_ssl_conf_rng(&conf_, mbedtls_ctr_drbg_random, &drbg_);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&conf_, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+
+    if (mbedtls_ssl_setup(&ssl_, &conf_) != 0)
+        return false;
+    if (mbedtls_ssl_set_hostname(&ssl_, host) != 0)
+        return false;
+
+    mbedtls_ssl_set_bio(&ssl_, &tcp_, bioSend, bioRecv, nullptr);
+    return true;
+}
+
+void ResumableTlsClient::teardown()
+{
+    if (!ready_)
+        return;
+    mbedtls_ssl_free(&ssl_);
+    mbedtls_ssl_config_free(&conf_);
+    mbedtls_ctr_drbg_free(&drbg_);
+    mbedtls_entropy_free(&entropy_);
+    mbedtls_x509_crt_free(&ca_);
+    ready_ = false;
+}
+
+int ResumableTlsClient::connect(IPAddress ip, uint16_t port)
+{
+    return connect(ip, port, (int32_t)handshakeTimeoutMs_);
+}
+
+int ResumableTlsClient::connect(const char *host, uint16_t port)
+{
+    return connect(host, port, (int32_t)handshakeTimeoutMs_);
+}
+
+int ResumableTlsClient::connect(IPAddress ip, uint16_t port, int32_t timeout)
+{
+    String host = ip.toString();
+    return connect(host.c_str(), port, timeout);
+}
+
+int ResumableTlsClient::connect(const char *host, uint16_t port, int32_t timeout)
+{
+    STACK_CHECKPOINT("ResumableTlsClient::connect:start");
+
+    if (!beginConnect(host, port, timeout))
+        return 0;
+
+    uint32_t start = millis();
+    int ret;
+    while ((ret = handshakeStep()) == 0)
+    {
+        if ((millis() - start) > handshakeTimeoutMs_)
+        {
+            if (offered_)
+                cache_.invalidate(host_.c_str());
+            stop();
+            return 0;
+        }
+        vTaskDelay(pdMS_TO_TICKS(2));
+    }
+
+    STACK_CHECKPOINT("ResumableTlsClient::connect:end");
+    return ret == 1 ? 1 : 0;
+}
+
+bool ResumableTlsClient::beginConnect(const char *host, uint16_t port, int32_t timeout)
+{
+    stop();
+    resumed_ = false;
+    offered_ = false;
+
+    if (!tcp_.connect(host, port, timeout))
+        return false;
+
+    if (!setup(host))
+    {
+        stop();
+        return false;
+    }
+
+    host_ = host;
+    offered_ = cache_.offer(host, &ssl_);
+    return true;
+}
+
+int ResumableTlsClient::handshakeStep()
+{
+    if (!ready_)
+        return -1;
+
+    int ret = mbedtls_ssl_handshake(&ssl_);
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+        return 0;
+
+    if (ret != 0)
+    {
+        // Don't keep offering a session the server chokes on
+        if (offered_)
+            cache_.invalidate(host_.c_str());
+        stop();
+        return -1;
+    }
+
+    if (rootCA_ && mbedtls_ssl_get_verify_result(&ssl_) != 0)
+    {
+        stop();
+        return -1;
+    }
+
+    resumed_ = cache_.store(host_.c_str(), &ssl_, offered_);
+    return 1;
+}
+
+size_t ResumableTlsClient::write(uint8_t data)
+{
+    return write(&data, 1);
+}
+
+size_t ResumableTlsClient::write(const uint8_t *buf, size_t size)
+{
+    if (!ready_)
+        return 0;
+
+    size_t written = 0;
+    uint32_t start = millis();
+    while (written < size)
+    {
+        int ret = mbedtls_ssl_write(&ssl_, buf + written, size - written);
+        if (ret > 0)
+        {
+            written += ret;
+            continue;
+        }
+        if ((ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) ||
+            (millis() - start) > handshakeTimeoutMs_)
+        {
+            stop();
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    return written;
+}
+
+int ResumableTlsClient::available()
+{
+    if (!ready_)
+        return 0;
+
+    int pending = peeked_ >= 0 ? 1 : 0;
+
+    // A zero-length read decrypts the next record if one has arrived
+    int ret = mbedtls_ssl_read(&ssl_, nullptr, 0);
+    if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+        if (mbedtls_ssl_get_bytes_avail(&ssl_) == 0 && pending == 0)
+        {
+            stop();
+            return 0;
+        }
+    }
+    return pending + (int)mbedtls_ssl_get_bytes_avail(&ssl_);
+}
+
+int ResumableTlsClient::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int ResumableTlsClient::read(uint8_t *buf, size_t size)
+{
+    if (!ready_ || size == 0)
+        return -1;
+
+    size_t got = 0;
+    if (peeked_ >= 0)
+    {
+        buf[got++] = (uint8_t)peeked_;
+        peeked_ = -1;
+        if (got == size)
+            return got;
+    }
+
+    int ret = mbedtls_ssl_read(&ssl_, buf + got, size - got);
+    if (ret > 0)
+        return got + ret;
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+        return got > 0 ? (int)got : -1;
+
+    // Peer closed (close_notify) or fatal error
+    stop();
+    return got > 0 ? (int)got : -1;
+}
+
+int ResumableTlsClient::peek()
+{
+    if (peeked_ >= 0)
+        return peeked_;
+    if (!ready_ || available() <= 0)
+        return -1;
+    uint8_t c;
+    if (mbedtls_ssl_read(&ssl_, &c, 1) != 1)
+        return -1;
+    peeked_ = c;
+    return peeked_;
+}
+
+void ResumableTlsClient::flush()
+{
+    tcp_.flush();
+}
+
+void ResumableTlsClient::stop()
+{
+    if (ready_)
+        mbedtls_ssl_close_notify(&ssl_);
+    teardown();
+    tcp_.stop();
+    peeked_ = -1;
+}
+
+uint8_t ResumableTlsClient::connected()
+{
+    if (!ready_)
+        return 0;
+    return tcp_.connected() || peeked_ >= 0 || mbedtls_ssl_get_bytes_avail(&ssl_) > 0;
+}
@@ -0,0 +1,74 @@
+#ifndef RESUMABLE_TLS_CLIENT_H
+#define RESUMABLE_TLS_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#include <mbedtls/net_sockets.h>
+#include "TlsSessionCache.h"
+
+// TLS transport for HTTPClient that resumes sessions from a TlsSessionCache.
+// WiFiClientSecure always performs a full handshake; this client drives mbedtls
+// directly over a plain WiFiClient so a saved session can be offered first.
+class ResumableTlsClient : public WiFiClient
+{
+public:
+    explicit ResumableTlsClient(TlsSessionCache &cache = TlsSessionCache::shared());
+    ~ResumableTlsClient();
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char *host, uint16_t port) override;
+    int connect(IPAddress ip, uint16_t port, int32_t timeout) override;
+    int connect(const char *host, uint16_t port, int32_t timeout) override;
+
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t *buf, size_t size) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected(); }
+
+    // Without a root CA the facilitator certificate is not verified
+    void setCACert(const char *rootCA) { rootCA_ = rootCA; }
+    void setInsecure() { rootCA_ = nullptr; }
+    void setHandshakeTimeout(uint32_t ms) { handshakeTimeoutMs_ = ms; }
+
+    // True if the current connection resumed a cached session
+    bool wasResumed() const { return resumed_; }
+
+    // Split connect for event-driven callers: beginConnect opens TCP (bounded by timeout)
+    // and prepares TLS; handshakeStep then advances the handshake without blocking.
+    bool beginConnect(const char *host, uint16_t port, int32_t timeout);
+    int handshakeStep(); // 1 = established, 0 = still in progress, -1 = failed (connection closed)
+
+private:
+    WiFiClient tcp_;
+    TlsSessionCache &cache_;
+    mbedtls_ssl_context ssl_;
+    mbedtls_ssl_config conf_;
+    mbedtls_ctr_drbg_context drbg_;
+    mbedtls_entropy_context entropy_;
+    mbedtls_x509_crt ca_;
+    const char *rootCA_;
+    uint32_t handshakeTimeoutMs_;
+    String host_;
+    int peeked_;     // byte held back by peek(), -1 if none
+    bool ready_;     // handshake completed, contexts live
+    bool resumed_;
+    bool offered_;   // a cached session was offered for the handshake in progress
+
+    bool setup(const char *host);
+    void teardown();
+
+    static int bioSend(void *ctx, const unsigned char *buf, size_t len);
+    static int bioRecv(void *ctx, unsigned char *buf, size_t len);
+};
+
+#endif // RESUMABLE_TLS_CLIENT_H
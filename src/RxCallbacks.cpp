@@ -2,332 +2,510 @@
 #include "x4Pay-core.h"
 #include "X402BleUtils.h"
 #include "PaymentVerifyWorker.h"
+#include "PaymentSession.h"
 #include "X402Aurdino.h"
+#include "BleFrame.h"
+#include "BleLink.h"
+#include "TxFragmenter.h"
 
-// Memory-optimized implementation with proper garbage collection
-void RxCallbacks::onWrite(NimBLECharacteristic *ch)
+// Fill session->customContext / selectedOptions from the envelope's context and options views.
+// Reuses the session's existing Strings so repeat payments don't reallocate them.
+static void parseRequestTail(const PaymentEnvelope &envelope, PaymentSession &session)
 {
-    // Get request directly as const char* to avoid String copy
-    std::string req_std = ch->getValue();
-    if (req_std.empty())
+    // Normalize customContext: if it's wrapped as "" (empty quoted), make empty
+    EnvelopeView context = envelope.context;
+    if (context.length == 2 && context.data[0] == '"' && context.data[1] == '"')
+        context.length = 0;
+    session.customContext = "";
+    appendUnescaped(session.customContext, context);
+
+    // Options array like [opt1,opt2]
+    size_t count = 0;
+    size_t pos = 0;
+    EnvelopeView option;
+    while (nextEnvelopeOption(envelope.options, pos, option))
+    {
+        if (count == session.selectedOptions.size())
+            session.selectedOptions.push_back(String());
+        String &item = session.selectedOptions[count++];
+        item = "";
+        appendUnescaped(item, option);
+    }
+    session.selectedOptions.resize(count);
+}
+
+// Payment fully assembled in session->paymentPayload: hand it to the worker.
+// Writes the immediate reply (PAYMENT:VERIFYING, PAYMENT:BUSY or a cached result) into reply.
+void RxCallbacks::submitPayment(PaymentSession *session, uint16_t connHandle, char *reply)
+{
+    // Immediate lightweight ACK (keeps phone happy & host stack safe)
+    strcpy(reply, "PAYMENT:VERIFYING");
+
+    // The assembled payload is: JSON -- customContext -- [options]
+    const char *combined = session->paymentPayload.c_str();
+    PaymentEnvelope envelope;
+    parsePaymentEnvelope(combined, session->paymentPayload.length(), envelope);
+    size_t jsonLength = envelope.json.length;
+    parseRequestTail(envelope, *session);
+
+#if X4PAY_DEBUG_PAYLOADS
+    Serial.print("Payment JSON: ");
+    Serial.write(combined, jsonLength);
+    Serial.println();
+    Serial.print("Custom Context: ");
+    Serial.println(session->customContext);
+    Serial.print("Selected Options: ");
+    for (const auto &opt : session->selectedOptions)
+    {
+        Serial.print(opt);
+        Serial.print(" ");
+    }
+    Serial.println();
+#endif
+
+    // Resubmitted payload: answered from the replay cache without any network I/O
+    uint64_t replayKey = 0;
+    ReplayStatus seen = ReplayStatus::Fresh;
+    if (pBle->getReplayCache().enabled())
+    {
+        replayKey = PaymentReplayCache::keyFor(combined, jsonLength);
+        seen = pBle->getReplayCache().begin(replayKey, reply, X4PAY_REPLY_BUFFER_BYTES);
+    }
+    if (seen != ReplayStatus::Fresh)
+    {
+        // In flight: keep PAYMENT:VERIFYING. Completed: reply holds the earlier result.
+        session->paymentPayload.clear();
         return;
+    }
 
-    const char *req_cstr = req_std.c_str();
+    // The job is filled once in the worker's pool and handed over by pointer.
+    // The worker reads the JSON in place; the session stays busy until it is done.
+    VerifyJob *job = PaymentVerifyWorker::acquireJob();
+    if (job)
+    {
+        job->payload = combined;                      // only payment JSON (view into the session buffer)
+        job->payloadLength = jsonLength;
+        job->session = session;                       // owns the payload and the per-payment scratch
+        job->txChar = pTxChar;                        // TX characteristic for response
+        job->connHandle = connHandle;                 // route the result back to this central
+        job->sessionGeneration = session->generation; // drop the result if the central left
+        job->replayKey = replayKey;                   // result is cached for resubmissions
+        PaymentSessionTable::beginPayment(session);
+    }
+    if (!PaymentVerifyWorker::submit(job))
+    {
+        if (job)
+            PaymentSessionTable::finishPayment(session);
+        pBle->getReplayCache().forget(replayKey);
+        strcpy(reply, "PAYMENT:BUSY");
+    }
+}
 
-    // Use stack-allocated buffer for small replies, heap for large ones
-    char reply_buffer[256];
-    String *heap_reply = nullptr;
-    const char *reply_ptr = nullptr;
+// Price request fully assembled in session->priceRequestPayload: quote it
+// Price reply in the stack reply buffer; only a reply too long for it goes on the heap
+String *RxCallbacks::quotePrice(PaymentSession *session, char *reply)
+{
+    // Parse the combined payload: customContext--[options] (no separator: both empty)
+    PaymentEnvelope envelope;
+    parsePriceEnvelope(session->priceRequestPayload.c_str(), session->priceRequestPayload.length(), envelope);
+    parseRequestTail(envelope, *session);
+
+    // Static price, or dynamic price (memoized when the price cache is enabled)
+    String dynamicPrice = pBle->resolvePrice(session->selectedOptions, session->customContext);
 
-    // Check if this is a payment chunk (X-PAYMENT:START, X-PAYMENT, X-PAYMENT:END)
-    if (strncmp(req_cstr, "X-PAYMENT", 9) == 0)
+    // Clear price request payload after processing
+    session->priceRequestPayload.clear();
+    if (pBle->buildPriceResponse(reply, X4PAY_REPLY_BUFFER_BYTES, dynamicPrice) > 0)
+        return nullptr;
+    return new String(pBle->buildPriceResponse(dynamicPrice));
+}
+
+// Metadata reply for a framed opcode
+static MetadataResponse metadataFor(uint8_t opcode)
+{
+    switch (opcode)
     {
-        if (pBle)
-        {
-            String currentPayload = pBle->getPaymentPayload();
-            String reqStr(req_cstr); // Only create String when needed
-            bool isComplete = assemblePaymentChunk(reqStr, currentPayload);
-            pBle->setPaymentPayload(currentPayload);
-
-            // Clear reqStr immediately after use
-            reqStr = String();
-
-            if (isComplete)
-            {
-                // Immediate lightweight ACK (keeps phone happy & host stack safe)
-                strcpy(reply_buffer, "PAYMENT:VERIFYING");
-                reply_ptr = reply_buffer;
-
-                // The assembled payload is: JSON -- customContext -- [options]
-                String combined = pBle->getPaymentPayload();
-                // Parse custom context
-                int firstSep = combined.indexOf("--");
-                int secondSep = firstSep >= 0 ? combined.indexOf("--", firstSep + 2) : -1;
-                String jsonPart;
-                String customContext;
-                String optionsPart;
-                if (firstSep >= 0 && secondSep > firstSep)
-                {
-                    jsonPart = combined.substring(0, firstSep);
-                    customContext = combined.substring(firstSep + 2, secondSep);
-                    optionsPart = combined.substring(secondSep + 2);
-                }
-                else
-                {
-                    // Fallback: treat whole as JSON if separators missing
-                    jsonPart = combined;
-                }
-
-                // Normalize customContext: if it's wrapped as "" (empty quoted), make empty
-                if (customContext == "\"\"")
-                    customContext = "";
-
-                // Parse options array like [opt1,opt2]
-                std::vector<String> selectedOptions;
-                if (optionsPart.length() > 1 && optionsPart[0] == '[' && optionsPart[optionsPart.length() - 1] == ']')
-                {
-                    String inner = optionsPart.substring(1, optionsPart.length() - 1);
-                    int start = 0;
-                    while (start < (int)inner.length())
-                    {
-                        int comma = inner.indexOf(',', start);
-                        String item = comma >= 0 ? inner.substring(start, comma) : inner.substring(start);
-                        item.trim();
-                        if (item.length() > 0)
-                            selectedOptions.push_back(item);
-                        if (comma < 0)
-                            break;
-                        start = comma + 1;
-                    }
-                }
-Serial.println("Payment JSON: " + jsonPart);
-Serial.println("Custom Context: " + customContext);
-Serial.print("Selected Options: ");
-for (const auto& opt : selectedOptions) {
-    Serial.print(opt + " ");
+    case OpLogo:
+        return MetadataLogo;
+    case OpBanner:
+        return MetadataBanner;
+    case OpDesc:
+        return MetadataDesc;
+    case OpConfig:
+        return MetadataConfig;
+    case OpOptions:
+        return MetadataOptions;
+    default:
+        return MetadataInfo;
+    }
 }
-Serial.println();
-
-                // Pass to worker - will only be set on x4PayCore if payment succeeds
-                // Payment requirements will be built dynamically in the worker with dynamic price
-                VerifyJob job;
-                job.payload = jsonPart;                       // only payment JSON
-                job.requirements = "";                        // Will be built dynamically in worker
-                job.txChar = pTxChar;                         // TX characteristic for response
-                job.customContext = customContext;            // parsed custom context
-                job.selectedOptions = selectedOptions;        // parsed selected options
-                PaymentVerifyWorker::enqueue(std::move(job));
-            }
-            else
-            {
-                // Still assembling
-                strcpy(reply_buffer, "PAYMENT:ACK");
-                reply_ptr = reply_buffer;
-            }
-        }
-        else
-        {
-            strcpy(reply_buffer, "ERROR:NO_CONTEXT");
-            reply_ptr = reply_buffer;
-        }
+
+// Send a prebuilt metadata reply straight from x4PayCore's buffer - nothing is built or
+// allocated here (only a reply longer than one notification is copied for fragmenting)
+void RxCallbacks::sendMetadata(MetadataResponse which, uint16_t connHandle, const BleFrame *frame)
+{
+    if (!pTxChar)
+        return;
+    pBle->lockMetadata();
+    const String &reply = pBle->getMetadataResponse(which);
+    if (frame)
+        TxFragmenter::replyFramed(pTxChar, connHandle, frame->opcode, frame->sequence, FrameResponse,
+                                  (const uint8_t *)reply.c_str(), reply.length());
+    else
+        TxFragmenter::reply(pTxChar, connHandle, (const uint8_t *)reply.c_str(), reply.length());
+    pBle->unlockMetadata();
+}
+
+// LINK://{"mtu": ..., "maxWrite": ..., "txPhy": ..., "rxPhy": ...}
+// Apps size their X-PAYMENT / [PRICE] chunks from maxWrite instead of a fixed 20 bytes.
+void RxCallbacks::linkReply(uint16_t connHandle, char *reply)
+{
+    BleLinkInfo link;
+    if (!BleLinkTable::get(connHandle, link))
+    {
+        link.mtu = X4PAY_BLE_DEFAULT_MTU;
+        link.maxPayload = X4PAY_BLE_DEFAULT_MTU - 3;
+        link.txPhy = link.rxPhy = BLE_GAP_LE_PHY_1M;
     }
-    else if (strncasecmp(req_cstr, "[LOGO]", 6) == 0)
+    snprintf(reply, X4PAY_REPLY_BUFFER_BYTES, "LINK://{\"mtu\": %u, \"maxWrite\": %u, \"txPhy\": %u, \"rxPhy\": %u}",
+             (unsigned)link.mtu, (unsigned)link.maxPayload, (unsigned)link.txPhy, (unsigned)link.rxPhy);
+}
+
+// ---- Framed protocol ----
+
+// Opcode handlers, indexed by opcode - OpInfo
+const RxCallbacks::FrameHandler RxCallbacks::kFrameHandlers[OpcodeEnd - OpInfo] = {
+    &RxCallbacks::onMetadataFrame, // OpInfo
+    &RxCallbacks::onPaymentFrame,  // OpPayment
+    &RxCallbacks::onPriceFrame,    // OpPrice
+    &RxCallbacks::onMetadataFrame, // OpLogo
+    &RxCallbacks::onMetadataFrame, // OpBanner
+    &RxCallbacks::onMetadataFrame, // OpDesc
+    &RxCallbacks::onMetadataFrame, // OpConfig
+    &RxCallbacks::onMetadataFrame, // OpOptions
+    &RxCallbacks::onLinkFrame,     // OpLink
+    &RxCallbacks::onResumeFrame,   // OpResume
+};
+
+// Reply for a framed chunk that did not complete its request; NACKs name the chunk to resend
+static void chunkReply(ChunkStatus status, const char *kind, const BleChunkAssembly &assembly, char *reply)
+{
+    switch (status)
     {
-        // Return logo string - use heap for potentially large content
-        if (pBle && pBle->getLogo().length() > 0)
-        {
-            heap_reply = new String("LOGO://" + pBle->getLogo());
-            reply_ptr = heap_reply->c_str();
-        }
-        else
-        {
-            strcpy(reply_buffer, "LOGO://");
-            reply_ptr = reply_buffer;
-        }
+    case ChunkGap:
+        snprintf(reply, X4PAY_REPLY_BUFFER_BYTES, "%s:NACK %u", kind, (unsigned)assembly.nextSequence);
+        break;
+    case ChunkNoStart:
+        strcpy(reply, "ERROR:NO_START");
+        break;
+    case ChunkTooLarge:
+        strcpy(reply, "ERROR:PAYLOAD_TOO_LARGE");
+        break;
+    case ChunkLengthMismatch:
+        strcpy(reply, "ERROR:LENGTH_MISMATCH");
+        break;
+    default:
+        // Pending, or a duplicate that was already appended
+        snprintf(reply, X4PAY_REPLY_BUFFER_BYTES, "%s:ACK", kind);
+        break;
     }
-    else if (strncasecmp(req_cstr, "[BANNER]", 8) == 0)
+}
+
+void RxCallbacks::onPaymentFrame(PaymentSession *session, const BleFrame &frame, uint16_t connHandle, char *reply, String *& /*heapReply*/)
+{
+    if (session->busy)
     {
-        // Return banner string
-        if (pBle && pBle->getBanner().length() > 0)
-        {
-            heap_reply = new String("BANNER://" + pBle->getBanner());
-            reply_ptr = heap_reply->c_str();
-        }
-        else
-        {
-            strcpy(reply_buffer, "BANNER://");
-            reply_ptr = reply_buffer;
-        }
+        // Previous payment from this central is still being verified; its buffer is in use
+        strcpy(reply, "PAYMENT:BUSY");
+        return;
     }
-    else if (strncasecmp(req_cstr, "[DESC]", 6) == 0)
+    ChunkStatus status = assembleSequencedChunk(frame, session->protocol >= 2, X4PAY_MAX_PAYMENT_BYTES,
+                                                session->paymentPayload, session->paymentAssembly);
+    if (status == ChunkComplete)
     {
-        // Return description string
-        if (pBle && pBle->getDescription().length() > 0)
-        {
-            heap_reply = new String("DESC://" + pBle->getDescription());
-            reply_ptr = heap_reply->c_str();
-        }
+        // Worker results for this payment are framed with the END sequence
+        session->paymentSequence = frame.sequence;
+        submitPayment(session, connHandle, reply);
+    }
+    else
+    {
+        chunkReply(status, "PAYMENT", session->paymentAssembly, reply);
+    }
+}
+
+void RxCallbacks::onPriceFrame(PaymentSession *session, const BleFrame &frame, uint16_t /*connHandle*/, char *reply, String *&heapReply)
+{
+    if (session->busy)
+    {
+        // Options/context of the in-flight payment live in the session until it completes
+        strcpy(reply, "PAYMENT:BUSY");
+        return;
+    }
+    ChunkStatus status = assembleSequencedChunk(frame, session->protocol >= 2, X4PAY_MAX_PRICE_REQUEST_BYTES,
+                                                session->priceRequestPayload, session->priceAssembly);
+    if (status == ChunkComplete)
+        heapReply = quotePrice(session, reply);
+    else
+        chunkReply(status, "PRICE", session->priceAssembly, reply);
+}
+
+void RxCallbacks::onMetadataFrame(PaymentSession * /*session*/, const BleFrame &frame, uint16_t connHandle, char * /*reply*/, String *& /*heapReply*/)
+{
+    sendMetadata(metadataFor(frame.opcode), connHandle, &frame);
+}
+
+void RxCallbacks::onLinkFrame(PaymentSession * /*session*/, const BleFrame & /*frame*/, uint16_t connHandle, char *reply, String *& /*heapReply*/)
+{
+    linkReply(connHandle, reply);
+}
+
+void RxCallbacks::onResumeFrame(PaymentSession * /*session*/, const BleFrame &frame, uint16_t connHandle, char *reply, String *& /*heapReply*/)
+{
+    // Success is the resent fragments themselves; only a miss gets a reply
+    size_t offset = frame.length >= 2 ? (size_t)(frame.payload[0] | (frame.payload[1] << 8)) : 0;
+    if (!TxFragmenter::resume(connHandle, offset))
+        strcpy(reply, "ERROR:NOTHING_TO_RESUME");
+}
+
+// One frame in, one frame out: same opcode and sequence, body is the text protocol reply
+void RxCallbacks::handleFrame(PaymentSession *session, const uint8_t *data, size_t size, uint16_t connHandle)
+{
+    char reply_buffer[X4PAY_REPLY_BUFFER_BYTES];
+    reply_buffer[0] = '\0';
+    String *heap_reply = nullptr;
+
+    BleFrame frame;
+    uint8_t opcode = data[0];
+    uint8_t sequence = size > 1 ? data[1] : 0;
+    if (!parseBleFrame(data, size, frame))
+        strcpy(reply_buffer, "ERROR:BAD_FRAME");
+    else if (frame.opcode >= OpcodeEnd)
+        strcpy(reply_buffer, "ERROR:UNKNOWN_OPCODE");
+    else
+        (this->*kFrameHandlers[frame.opcode - OpInfo])(session, frame, connHandle, reply_buffer, heap_reply);
+
+    const char *body = heap_reply ? heap_reply->c_str() : reply_buffer;
+    size_t length = strlen(body);
+    uint8_t flags = FrameResponse | (strncmp(body, "ERROR:", 6) == 0 ? FrameError : 0);
+
+    // Split into MTU-sized fragments when the reply doesn't fit one notification
+    if (pTxChar && length > 0)
+        TxFragmenter::replyFramed(pTxChar, connHandle, opcode, sequence, flags, (const uint8_t *)body, length);
+
+    delete heap_reply;
+}
+
+// ---- Text protocol ----
+
+// Built-in "[NAME]" commands, sorted by name (case-insensitive) for binary search.
+// Application commands registered with x4PayCore::registerCommand are looked up after these.
+const RxCallbacks::TextCommand RxCallbacks::kTextCommands[] = {
+    {"[BANNER]", 8, &RxCallbacks::onMetadataCommand, MetadataBanner},
+    {"[CONFIG]", 8, &RxCallbacks::onMetadataCommand, MetadataConfig},
+    {"[DESC]", 6, &RxCallbacks::onMetadataCommand, MetadataDesc},
+    {"[LINK]", 6, &RxCallbacks::onLinkCommand, 0},
+    {"[LOGO]", 6, &RxCallbacks::onMetadataCommand, MetadataLogo},
+    {"[OPTIONS]", 9, &RxCallbacks::onMetadataCommand, MetadataOptions},
+    {"[PRICE]", 7, &RxCallbacks::onPriceCommand, 0},
+    {"[PROTO]", 7, &RxCallbacks::onProtoCommand, 0},
+    {"[RESUME]", 8, &RxCallbacks::onResumeCommand, 0},
+};
+const size_t RxCallbacks::kTextCommandCount = sizeof(kTextCommands) / sizeof(kTextCommands[0]);
+
+const RxCallbacks::TextCommand *RxCallbacks::findBuiltin(const char *key, size_t length)
+{
+    size_t lo = 0;
+    size_t hi = kTextCommandCount;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        int cmp = compareCommandKey(key, length, kTextCommands[mid].prefix, kTextCommands[mid].length);
+        if (cmp == 0)
+            return &kTextCommands[mid];
+        if (cmp < 0)
+            hi = mid;
         else
-        {
-            strcpy(reply_buffer, "DESC://");
-            reply_ptr = reply_buffer;
-        }
+            lo = mid + 1;
+    }
+    return nullptr;
+}
+
+bool RxCallbacks::isBuiltinCommand(const char *key, size_t length)
+{
+    return findBuiltin(key, length) != nullptr;
+}
+
+// X-PAYMENT:START<data>, X-PAYMENT<data>, X-PAYMENT:END<data>
+void RxCallbacks::onPaymentCommand(const char *req, uint16_t connHandle, uint8_t /*arg*/, char *reply, String *& /*heapReply*/)
+{
+    // Chunked requests are per connection so concurrent centrals don't interleave
+    PaymentSession *session = PaymentSessionTable::acquire(connHandle, pTxChar);
+    if (!session)
+    {
+        strcpy(reply, "ERROR:NO_SESSION");
     }
-    else if (strncasecmp(req_cstr, "[CONFIG]", 8) == 0)
+    else if (session->busy)
     {
-        // Build CONFIG response efficiently
-        heap_reply = new String();
-        heap_reply->reserve(128); // Pre-allocate memory
-        *heap_reply = "CONFIG://{\"frequency\": ";
-        *heap_reply += String(pBle->getFrequency());
-        *heap_reply += ", \"allowCustomContent\": ";
-        *heap_reply += (pBle->isCustomContentAllowed() ? "true" : "false");
-        *heap_reply += "}";
-        reply_ptr = heap_reply->c_str();
+        // Previous payment from this central is still being verified; its buffer is in use
+        strcpy(reply, "PAYMENT:BUSY");
     }
-    else if (strncasecmp(req_cstr, "[OPTIONS]", 9) == 0)
+    else
     {
-        // Handle options request - build comma-separated string
-        if (pBle)
+        // Appended straight into the session buffer - no String temporaries
+        bool isComplete = assemblePaymentChunk(req, session->paymentPayload);
+
+        if (session->paymentPayload.overflowed())
+        {
+            // Payload larger than the session buffer (arena mode); drop it and make the central restart
+            session->paymentPayload.clear();
+            strcpy(reply, "ERROR:PAYLOAD_TOO_LARGE");
+        }
+        else if (isComplete)
         {
-            const auto &opts = pBle->getOptions();
-            heap_reply = new String();
-            heap_reply->reserve(256); // Pre-allocate for options
-            *heap_reply = "OPTIONS://";
-            for (size_t i = 0; i < opts.size(); ++i)
-            {
-                *heap_reply += opts[i];
-                if (i + 1 < opts.size())
-                    *heap_reply += ",";
-            }
-            reply_ptr = heap_reply->c_str();
+            submitPayment(session, connHandle, reply);
         }
         else
         {
-            strcpy(reply_buffer, "OPTIONS://");
-            reply_ptr = reply_buffer;
+            // Still assembling
+            strcpy(reply, "PAYMENT:ACK");
         }
     }
-    else if (strncasecmp(req_cstr, "[PRICE]", 7) == 0)
+}
+
+// [PRICE]:START<data>, [PRICE]:<data>, [PRICE]:END<data>
+void RxCallbacks::onPriceCommand(const char *req, uint16_t connHandle, uint8_t /*arg*/, char *reply, String *&heapReply)
+{
+    PaymentSession *session = PaymentSessionTable::acquire(connHandle, pTxChar);
+    if (!session)
+    {
+        strcpy(reply, "ERROR:NO_SESSION");
+    }
+    else if (session->busy)
     {
-        // Handle [PRICE] chunked data: [PRICE]:START, [PRICE]:, [PRICE]:END
-        
-        if (pBle)
+        // Options/context of the in-flight payment live in the session until it completes
+        strcpy(reply, "PAYMENT:BUSY");
+    }
+    else
+    {
+        bool isComplete = assemblePriceRequestChunk(req, session->priceRequestPayload);
+
+        if (session->priceRequestPayload.overflowed())
         {
-            String currentPricePayload = pBle->getPriceRequestPayload();
-            String reqStr(req_cstr); // Only create String when needed
-            bool isComplete = assemblePriceRequestChunk(reqStr, currentPricePayload);
-            pBle->setPriceRequestPayload(currentPricePayload);
-
-            // Clear reqStr immediately after use
-            reqStr = String();
-
-            if (isComplete)
-            {
-                
-                // Parse the combined payload: customContext--[options]
-                String combined = pBle->getPriceRequestPayload();
-                
-                
-                
-                int firstSep = combined.indexOf("--");
-                String customContext;
-                String optionsPart;
-
-                if (firstSep >= 0)
-                {
-                    customContext = combined.substring(0, firstSep);
-                    optionsPart = combined.substring(firstSep + 2);
-                }
-                else
-                {
-                    // No separator, treat as empty
-                    customContext = "";
-                    optionsPart = "";
-                }
-
-                // Normalize customContext: if it's wrapped as "" (empty quoted), make empty
-                if (customContext == "\"\"")
-                    customContext = "";
-
-                
-
-                // Parse options array like [opt1,opt2]
-                std::vector<String> selectedOptions;
-                if (optionsPart.length() > 1 && optionsPart[0] == '[' && optionsPart[optionsPart.length() - 1] == ']')
-                {
-                    String inner = optionsPart.substring(1, optionsPart.length() - 1);
-                    int start = 0;
-                    while (start < (int)inner.length())
-                    {
-                        int comma = inner.indexOf(',', start);
-                        String item = comma >= 0 ? inner.substring(start, comma) : inner.substring(start);
-                        item.trim();
-                        if (item.length() > 0)
-                            selectedOptions.push_back(item);
-                        if (comma < 0)
-                            break;
-                        start = comma + 1;
-                    }
-                }
-
-                
-
-                // Call dynamic price callback if set
-                String dynamicPrice = pBle->getPrice(); // Default to static price
-                
-                
-                if (pBle->getDynamicPriceCallback() != nullptr)
-                {
-                    
-                    dynamicPrice = pBle->getDynamicPriceCallback()(selectedOptions, customContext);
-                    
-                }
-                else
-                {
-                    
-                }
-
-                // Build response with dynamic price
-                heap_reply = new String();
-                heap_reply->reserve(256);
-                *heap_reply = "402://{\"price\": \"";
-                *heap_reply += dynamicPrice;
-                *heap_reply += "\", \"payTo\": \"";
-                *heap_reply += pBle->getPayTo();
-                *heap_reply += "\", \"network\": \"";
-                *heap_reply += pBle->getNetwork();
-                *heap_reply += "\"}";
-                reply_ptr = heap_reply->c_str();
-
-                // Clear price request payload after processing
-                pBle->clearPriceRequestPayload();
-            }
-            else
-            {
-                // Still assembling
-                strcpy(reply_buffer, "PRICE:ACK");
-                reply_ptr = reply_buffer;
-            }
+            session->priceRequestPayload.clear();
+            strcpy(reply, "ERROR:PAYLOAD_TOO_LARGE");
+        }
+        else if (isComplete)
+        {
+            heapReply = quotePrice(session, reply);
         }
         else
         {
-            strcpy(reply_buffer, "ERROR:NO_CONTEXT");
-            reply_ptr = reply_buffer;
+            // Still assembling
+            strcpy(reply, "PRICE:ACK");
         }
     }
+}
+
+// "[PROTO]<version>": switch this connection to framed writes; the answer is still text
+void RxCallbacks::onProtoCommand(const char *req, uint16_t connHandle, uint8_t /*arg*/, char *reply, String *& /*heapReply*/)
+{
+    int requested = atoi(req + 7);
+    uint8_t version = requested <= 0 ? 0 : (requested > X4PAY_FRAME_VERSION ? X4PAY_FRAME_VERSION : (uint8_t)requested);
+    if (PaymentSessionTable::acquire(connHandle, pTxChar))
+    {
+        PaymentSessionTable::setProtocol(connHandle, version);
+        snprintf(reply, X4PAY_REPLY_BUFFER_BYTES, "PROTO://%u", (unsigned)version);
+    }
     else
     {
-        // Send price, payTo, and network from x4PayCore instance
-        if (pBle)
+        strcpy(reply, "ERROR:NO_SESSION");
+    }
+}
+
+// "[RESUME]<offset>": resend the last fragmented reply from that byte offset
+void RxCallbacks::onResumeCommand(const char *req, uint16_t connHandle, uint8_t /*arg*/, char *reply, String *& /*heapReply*/)
+{
+    // Success is the resent fragments themselves; only a miss gets a reply
+    if (!TxFragmenter::resume(connHandle, strtoul(req + 8, nullptr, 10)))
+        strcpy(reply, "ERROR:NOTHING_TO_RESUME");
+}
+
+void RxCallbacks::onLinkCommand(const char * /*req*/, uint16_t connHandle, uint8_t /*arg*/, char *reply, String *& /*heapReply*/)
+{
+    linkReply(connHandle, reply);
+}
+
+void RxCallbacks::onMetadataCommand(const char * /*req*/, uint16_t connHandle, uint8_t which, char * /*reply*/, String *& /*heapReply*/)
+{
+    sendMetadata((MetadataResponse)which, connHandle, nullptr);
+}
+
+// "[NAME]..." to its built-in or application handler; anything else gets the payment info
+void RxCallbacks::dispatchCommand(const char *req, uint16_t connHandle, char *reply, String *&heapReply)
+{
+    const char *close = req[0] == '[' ? (const char *)memchr(req, ']', strnlen(req, X4PAY_COMMAND_PREFIX_BYTES)) : nullptr;
+    if (close)
+    {
+        size_t keyLength = close - req + 1;
+        const TextCommand *command = findBuiltin(req, keyLength);
+        if (command)
         {
-            // Build JSON efficiently with pre-allocation
-            heap_reply = new String();
-            heap_reply->reserve(256);
-            *heap_reply = "402://{\"price\": \"";
-            *heap_reply += pBle->getPrice();
-            *heap_reply += "\", \"payTo\": \"";
-            *heap_reply += pBle->getPayTo();
-            *heap_reply += "\", \"network\": \"";
-            *heap_reply += pBle->getNetwork();
-            *heap_reply += "\"}";
-            reply_ptr = heap_reply->c_str();
+            (this->*command->handler)(req, connHandle, command->arg, reply, heapReply);
+            return;
         }
-        else
+        CommandHandler handler = pBle->findCommand(req, keyLength);
+        if (handler)
         {
-            strcpy(reply_buffer, "{\"error\": \"Unknown command\"}");
-            reply_ptr = reply_buffer;
+            heapReply = new String(handler(req + keyLength, connHandle));
+            return;
         }
     }
 
-    // Send response back to client via TX characteristic (notify)
-    if (pTxChar && reply_ptr && strlen(reply_ptr) > 0)
+    // Send price, payTo, and network from x4PayCore instance
+    sendMetadata(MetadataInfo, connHandle, nullptr);
+}
+
+// Memory-optimized implementation with proper garbage collection
+void RxCallbacks::handleWrite(NimBLECharacteristic *ch, uint16_t connHandle)
+{
+    // Get request directly as const char* to avoid String copy
+    std::string req_std = ch->getValue();
+    if (req_std.empty())
+        return;
+
+    // Framed write on a connection that negotiated the binary protocol
+    if ((uint8_t)req_std[0] >= OpInfo && pBle)
     {
-        size_t len = strlen(reply_ptr);
-        pTxChar->setValue((uint8_t *)reply_ptr, len);
-        pTxChar->notify();
+        PaymentSession *framed = PaymentSessionTable::find(connHandle);
+        if (framed && framed->protocol > 0)
+        {
+            handleFrame(framed, (const uint8_t *)req_std.data(), req_std.size(), connHandle);
+            return;
+        }
     }
 
+    const char *req_cstr = req_std.c_str();
+
+    // Use stack-allocated buffer for small replies, heap for large ones
+    char reply_buffer[X4PAY_REPLY_BUFFER_BYTES];
+    reply_buffer[0] = '\0';
+    String *heap_reply = nullptr;
+
+    if (!pBle)
+        strcpy(reply_buffer, "ERROR:NO_CONTEXT");
+    else if (strncmp(req_cstr, "X-PAYMENT", 9) == 0)
+        onPaymentCommand(req_cstr, connHandle, 0, reply_buffer, heap_reply); // hot path, no brackets to look up
+    else
+        dispatchCommand(req_cstr, connHandle, reply_buffer, heap_reply);
+
+    const char *reply_ptr = heap_reply ? heap_reply->c_str() : reply_buffer;
+
+    // Send response back to the requesting central only via TX characteristic (notify).
+    // Replies longer than the MTU allows go out as fragments instead of being truncated.
+    size_t len = strlen(reply_ptr);
+    if (pTxChar && len > 0)
+        TxFragmenter::reply(pTxChar, connHandle, (const uint8_t *)reply_ptr, len);
+
     // Proper garbage collection - clean up heap allocations
     if (heap_reply)
     {
@@ -4,19 +4,76 @@
 #include <Arduino.h>
 #include <NimBLEDevice.h>
 #include "X402Aurdino.h"
+#include "BleFrame.h"
+
+// Immediate replies are built on the stack; metadata and price replies on the heap
+#define X4PAY_REPLY_BUFFER_BYTES 256
+
+// Echo signed payment payloads to Serial; they carry signatures, so keep off in production
+#ifndef X4PAY_DEBUG_PAYLOADS
+#define X4PAY_DEBUG_PAYLOADS 0
+#endif
 
 
 class x4PayCore; // Forward declaration
+enum MetadataResponse : uint8_t;
+struct PaymentSession;
 
 class RxCallbacks : public NimBLECharacteristicCallbacks {
 public:
     RxCallbacks(NimBLECharacteristic* txChar, x4PayCore* ble) : pTxChar(txChar), pBle(ble) {}
 
-    void onWrite(NimBLECharacteristic *ch);
-    // Compatibility overload (some NimBLE versions provide connection info)
-    void onWrite(NimBLECharacteristic* ch, NimBLEConnInfo& /*info*/) { onWrite(ch); }
+    // Legacy overload without connection info - all writes share one session
+    void onWrite(NimBLECharacteristic *ch) { handleWrite(ch, BLE_HS_CONN_HANDLE_NONE); }
+    // Connection-aware overload - each central gets its own payment session
+    void onWrite(NimBLECharacteristic* ch, NimBLEConnInfo& info) { handleWrite(ch, info.getConnHandle()); }
+
+    // Built-in "[NAME]" prefixes can't be taken by application commands
+    static bool isBuiltinCommand(const char *key, size_t length);
 
 private:
+    // Text command handler: req is the whole write, arg the table entry's argument
+    typedef void (RxCallbacks::*TextHandler)(const char *req, uint16_t connHandle, uint8_t arg, char *reply,
+                                             String *&heapReply);
+    struct TextCommand
+    {
+        const char *prefix;
+        uint8_t length;
+        TextHandler handler;
+        uint8_t arg;
+    };
+    static const TextCommand kTextCommands[];
+    static const size_t kTextCommandCount;
+
+    // Framed opcode handler: fills reply (stack) or heapReply
+    typedef void (RxCallbacks::*FrameHandler)(PaymentSession *session, const BleFrame &frame, uint16_t connHandle,
+                                              char *reply, String *&heapReply);
+    static const FrameHandler kFrameHandlers[OpcodeEnd - OpInfo];
+
+    void handleWrite(NimBLECharacteristic *ch, uint16_t connHandle);
+    void dispatchCommand(const char *req, uint16_t connHandle, char *reply, String *&heapReply);
+    static const TextCommand *findBuiltin(const char *key, size_t length);
+
+    void onPaymentCommand(const char *req, uint16_t connHandle, uint8_t arg, char *reply, String *&heapReply);
+    void onPriceCommand(const char *req, uint16_t connHandle, uint8_t arg, char *reply, String *&heapReply);
+    void onProtoCommand(const char *req, uint16_t connHandle, uint8_t arg, char *reply, String *&heapReply);
+    void onResumeCommand(const char *req, uint16_t connHandle, uint8_t arg, char *reply, String *&heapReply);
+    void onLinkCommand(const char *req, uint16_t connHandle, uint8_t arg, char *reply, String *&heapReply);
+    void onMetadataCommand(const char *req, uint16_t connHandle, uint8_t arg, char *reply, String *&heapReply);
+    void handleFrame(PaymentSession *session, const uint8_t *data, size_t size, uint16_t connHandle);
+
+    void onPaymentFrame(PaymentSession *session, const BleFrame &frame, uint16_t connHandle, char *reply, String *&heapReply);
+    void onPriceFrame(PaymentSession *session, const BleFrame &frame, uint16_t connHandle, char *reply, String *&heapReply);
+    void onMetadataFrame(PaymentSession *session, const BleFrame &frame, uint16_t connHandle, char *reply, String *&heapReply);
+    void onLinkFrame(PaymentSession *session, const BleFrame &frame, uint16_t connHandle, char *reply, String *&heapReply);
+    void onResumeFrame(PaymentSession *session, const BleFrame &frame, uint16_t connHandle, char *reply, String *&heapReply);
+
+    // Shared by both protocols
+    void submitPayment(PaymentSession *session, uint16_t connHandle, char *reply);
+    String *quotePrice(PaymentSession *session, char *reply);
+    void sendMetadata(MetadataResponse which, uint16_t connHandle, const BleFrame *frame);
+    void linkReply(uint16_t connHandle, char *reply);
+
     NimBLECharacteristic* pTxChar;  // TX characteristic for sending responses
     x4PayCore* pBle;                   // Pointer to x4PayCore instance
 };
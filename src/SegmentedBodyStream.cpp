@@ -0,0 +1,88 @@
+#include "SegmentedBodyStream.h"
+
+SegmentedBodyStream::SegmentedBodyStream() : segments_(inline_), capacity_(X4PAY_BODY_MAX_SEGMENTS)
+{
+    clear();
+}
+
+SegmentedBodyStream::SegmentedBodyStream(Segment *segments, size_t capacity)
+    : segments_(segments), capacity_(capacity)
+{
+    clear();
+}
+
+bool SegmentedBodyStream::append(const char *data, size_t len)
+{
+    if (count_ >= capacity_)
+        return false;
+    if (len == 0)
+        return true;
+    segments_[count_].data = data;
+    segments_[count_].len = len;
+    count_++;
+    total_ += len;
+    return true;
+}
+
+void SegmentedBodyStream::rewind()
+{
+    index_ = 0;
+    offset_ = 0;
+    consumed_ = 0;
+}
+
+void SegmentedBodyStream::clear()
+{
+    count_ = 0;
+    total_ = 0;
+    rewind();
+}
+
+int SegmentedBodyStream::available()
+{
+    return (int)(total_ - consumed_);
+}
+
+int SegmentedBodyStream::peek()
+{
+    if (index_ >= count_)
+        return -1;
+    return (uint8_t)segments_[index_].data[offset_];
+}
+
+int SegmentedBodyStream::read()
+{
+    int c = peek();
+    if (c < 0)
+        return -1;
+    consumed_++;
+    if (++offset_ >= segments_[index_].len)
+    {
+        index_++;
+        offset_ = 0;
+    }
+    return c;
+}
+
+// Copy straight out of the borrowed segments into the caller's (socket) buffer
+size_t SegmentedBodyStream::readBytes(char *buffer, size_t length)
+{
+    size_t copied = 0;
+    while (copied < length && index_ < count_)
+    {
+        const Segment &seg = segments_[index_];
+        size_t n = seg.len - offset_;
+        if (n > length - copied)
+            n = length - copied;
+        memcpy(buffer + copied, seg.data + offset_, n);
+        copied += n;
+        offset_ += n;
+        if (offset_ >= seg.len)
+        {
+            index_++;
+            offset_ = 0;
+        }
+    }
+    consumed_ += copied;
+    return copied;
+}
@@ -0,0 +1,65 @@
+#ifndef SEGMENTED_BODY_STREAM_H
+#define SEGMENTED_BODY_STREAM_H
+
+#include <Arduino.h>
+
+// Most segments a single request body can be made of
+#ifndef X4PAY_BODY_MAX_SEGMENTS
+#define X4PAY_BODY_MAX_SEGMENTS 8
+#endif
+
+// Read-only Stream over a list of existing buffers.
+// Lets HTTPClient::sendRequest() send a body made of several pieces
+// (literals, payload, requirements) without concatenating them first.
+// The buffers are borrowed - they must outlive the request.
+class SegmentedBodyStream : public Stream
+{
+public:
+    struct Segment
+    {
+        const char *data;
+        size_t len;
+    };
+
+    SegmentedBodyStream();
+    // Segment list in caller storage, for bodies of more than X4PAY_BODY_MAX_SEGMENTS pieces
+    SegmentedBodyStream(Segment *segments, size_t capacity);
+
+    // segments_ may point into the object itself
+    SegmentedBodyStream(const SegmentedBodyStream &) = delete;
+    SegmentedBodyStream &operator=(const SegmentedBodyStream &) = delete;
+
+    // Append a segment; returns false once the segment list is full
+    bool append(const char *data, size_t len);
+    bool append(const char *literal) { return append(literal, strlen(literal)); }
+    bool append(const String &s) { return append(s.c_str(), s.length()); }
+
+    // Total body size, used as Content-Length
+    size_t size() const { return total_; }
+
+    // Start reading from the first byte again (for a retry on a fresh connection)
+    void rewind();
+    void clear();
+
+    // Stream
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t readBytes(char *buffer, size_t length) override;
+
+    // Print (read-only stream)
+    size_t write(uint8_t) override { return 0; }
+    void flush() override {}
+
+private:
+    Segment inline_[X4PAY_BODY_MAX_SEGMENTS];
+    Segment *segments_;
+    size_t capacity_;
+    size_t count_;
+    size_t total_;
+    size_t index_;  // current segment
+    size_t offset_; // position inside the current segment
+    size_t consumed_;
+};
+
+#endif // SEGMENTED_BODY_STREAM_H
@@ -1,4 +1,7 @@
 #include "ServerCallbacks.h"
+#include "PaymentSession.h"
+#include "BleLink.h"
+#include "TxFragmenter.h"
 #include "X402Aurdino.h"
 
 // Global pointer to advertising (defined in x4Pay-core.cpp)
@@ -25,20 +28,49 @@ void ServerCallbacks::onDisconnect(NimBLEServer * /*srv*/)
 // Compatibility overloads (some NimBLE versions use these)
 void ServerCallbacks::onConnect(NimBLEServer *s, NimBLEConnInfo &i)
 {
+    // Track the link and ask for DLE / 2M PHY before the central starts writing
+    BleLinkTable::open(s, i.getConnHandle(), i.getMTU());
     onConnect(s);
 }
 
 void ServerCallbacks::onDisconnect(NimBLEServer *s, NimBLEConnInfo &i)
 {
+    // Return the central's payment session to the pool
+    PaymentSessionTable::release(i.getConnHandle());
+    BleLinkTable::close(i.getConnHandle());
+    TxFragmenter::release(i.getConnHandle());
     onDisconnect(s);
 }
 
+void ServerCallbacks::onDisconnect(NimBLEServer *s, NimBLEConnInfo &i, int /*reason*/)
+{
+    onDisconnect(s, i);
+}
+
 void ServerCallbacks::onConnect(NimBLEServer *s, ble_gap_conn_desc *d)
 {
+    if (d)
+        BleLinkTable::open(s, d->conn_handle, X4PAY_BLE_DEFAULT_MTU);
     onConnect(s);
 }
 
 void ServerCallbacks::onDisconnect(NimBLEServer *s, ble_gap_conn_desc *d)
 {
+    if (d)
+    {
+        PaymentSessionTable::release(d->conn_handle);
+        BleLinkTable::close(d->conn_handle);
+        TxFragmenter::release(d->conn_handle);
+    }
     onDisconnect(s);
 }
+
+void ServerCallbacks::onMTUChange(uint16_t MTU, NimBLEConnInfo &i)
+{
+    BleLinkTable::setMtu(i.getConnHandle(), MTU);
+}
+
+void ServerCallbacks::onPhyUpdate(NimBLEConnInfo &i, uint8_t txPhy, uint8_t rxPhy)
+{
+    BleLinkTable::setPhy(i.getConnHandle(), txPhy, rxPhy);
+}
@@ -17,8 +17,13 @@ public:
     // Compatibility overloads (some NimBLE versions use these)
     void onConnect(NimBLEServer* s, NimBLEConnInfo& i);
     void onDisconnect(NimBLEServer* s, NimBLEConnInfo& i);
+    void onDisconnect(NimBLEServer* s, NimBLEConnInfo& i, int reason);
     void onConnect(NimBLEServer* s, ble_gap_conn_desc* d);
     void onDisconnect(NimBLEServer* s, ble_gap_conn_desc* d);
+
+    // Link parameters negotiated by the central
+    void onMTUChange(uint16_t MTU, NimBLEConnInfo& i);
+    void onPhyUpdate(NimBLEConnInfo& i, uint8_t txPhy, uint8_t rxPhy);
 };
 
 #endif // SERVERCALLBACKS_H
@@ -0,0 +1,484 @@
+#include "SettlementBatch.h"
+#include "PaymentVerifyWorker.h"
+#include "FacilitatorClient.h"
+#include "paymentutils.h"
+#include <new>
+
+static const uint32_t kRecordMagic = 0x58345342; // "X4SB"
+
+Preferences SettlementBatch::prefs_;
+SemaphoreHandle_t SettlementBatch::lock_ = nullptr;
+TaskHandle_t SettlementBatch::task_ = nullptr;
+SettlementBatch::Slot SettlementBatch::slots_[X4PAY_SETTLE_BATCH_CAPACITY] = {};
+size_t SettlementBatch::count_ = 0;
+uint32_t SettlementBatch::nextSequence_ = 1;
+uint32_t SettlementBatch::oldestMs_ = 0;
+uint32_t SettlementBatch::retryAtMs_ = 0;
+bool SettlementBatch::flushRequested_ = false;
+size_t SettlementBatch::batchSize_ = 0;
+uint32_t SettlementBatch::intervalMs_ = 0;
+bool SettlementBatch::facilitatorBatch_ = false;
+SettlementBatchStats SettlementBatch::stats_ = {};
+OnBatchSettledCallback SettlementBatch::onSettled_ = nullptr;
+UBaseType_t SettlementBatch::prio_ = 2;
+BaseType_t SettlementBatch::core_ = 1;
+
+void SettlementBatch::configure(size_t batchSize, uint32_t intervalMs, bool facilitatorBatch)
+{
+    if (batchSize > X4PAY_SETTLE_BATCH_CAPACITY)
+        batchSize = X4PAY_SETTLE_BATCH_CAPACITY;
+    batchSize_ = batchSize;
+    intervalMs_ = intervalMs;
+    facilitatorBatch_ = facilitatorBatch;
+}
+
+void SettlementBatch::lock()
+{
+    if (lock_)
+        xSemaphoreTake(lock_, portMAX_DELAY);
+}
+
+void SettlementBatch::unlock()
+{
+    if (lock_)
+        xSemaphoreGive(lock_);
+}
+
+void SettlementBatch::keyFor(size_t slot, char *key)
+{
+    snprintf(key, 8, "b%u", (unsigned)slot);
+}
+
+void SettlementBatch::begin(UBaseType_t prio, BaseType_t core)
+{
+    if (task_)
+        return;
+    if (!lock_)
+        lock_ = xSemaphoreCreateMutex();
+    if (!prefs_.begin("x4pay_settle", false))
+    {
+        Serial.println("ERROR: Settlement store unavailable");
+        return;
+    }
+
+    // Pick up verified payments that were still waiting when the device went down
+    lock();
+    for (size_t i = 0; i < X4PAY_SETTLE_BATCH_CAPACITY; ++i)
+    {
+        char key[8];
+        keyFor(i, key);
+        slots_[i].used = false;
+        size_t length = prefs_.getBytesLength(key);
+        if (length == 0)
+            continue;
+
+        RecordHeader header = {};
+        uint8_t *record = (uint8_t *)malloc(length);
+        bool valid = record && length >= sizeof(header) && prefs_.getBytes(key, record, length) == length;
+        if (valid)
+        {
+            memcpy(&header, record, sizeof(header));
+            valid = header.magic == kRecordMagic &&
+                    sizeof(header) + header.payloadLength + header.requirementsLength == length;
+        }
+        free(record);
+        if (!valid)
+        {
+            prefs_.remove(key);
+            continue;
+        }
+
+        slots_[i].used = true;
+        slots_[i].sequence = header.sequence;
+        if (header.sequence >= nextSequence_)
+            nextSequence_ = header.sequence + 1;
+        count_++;
+        stats_.recovered++;
+    }
+    // Anything recovered is overdue
+    flushRequested_ = count_ > 0;
+    oldestMs_ = millis();
+    unlock();
+
+    if (count_ > 0)
+    {
+        Serial.print("Settlement: recovered ");
+        Serial.print((unsigned)count_);
+        Serial.println(" verified payment(s)");
+    }
+
+    prio_ = prio;
+    core_ = core;
+    if (enabled() || count_ > 0)
+        startTask();
+}
+
+void SettlementBatch::startTask()
+{
+    if (task_)
+        return;
+    xTaskCreatePinnedToCore(taskLoop, "pay_settle", X4PAY_SETTLE_BATCH_STACK / sizeof(StackType_t),
+                            nullptr, prio_, &task_, core_);
+}
+
+bool SettlementBatch::add(const char *payload, size_t payloadLength, const char *requirements, size_t requirementsLength)
+{
+    if (!enabled() || !task_)
+        return false;
+    return store(payload, payloadLength, requirements, requirementsLength);
+}
+
+bool SettlementBatch::adopt(const char *payload, size_t payloadLength, const char *requirements, size_t requirementsLength)
+{
+    if (!lock_)
+        return false;
+    bool stored = store(payload, payloadLength, requirements, requirementsLength);
+    if (stored)
+    {
+        // Recovered payments settle right away
+        lock();
+        flushRequested_ = true;
+        unlock();
+        startTask();
+        xTaskNotifyGive(task_);
+    }
+    return stored;
+}
+
+bool SettlementBatch::store(const char *payload, size_t payloadLength, const char *requirements, size_t requirementsLength)
+{
+    if (payloadLength > 0xFFFF || requirementsLength > 0xFFFF)
+        return false;
+
+    lock();
+    size_t slot = X4PAY_SETTLE_BATCH_CAPACITY;
+    for (size_t i = 0; i < X4PAY_SETTLE_BATCH_CAPACITY; ++i)
+    {
+        if (!slots_[i].used)
+        {
+            slot = i;
+            break;
+        }
+    }
+
+    bool stored = false;
+    size_t length = sizeof(RecordHeader) + payloadLength + requirementsLength;
+    uint8_t *record = slot < X4PAY_SETTLE_BATCH_CAPACITY ? (uint8_t *)malloc(length) : nullptr;
+    if (record)
+    {
+        RecordHeader header = {kRecordMagic, nextSequence_, (uint16_t)payloadLength, (uint16_t)requirementsLength};
+        memcpy(record, &header, sizeof(header));
+        memcpy(record + sizeof(header), payload, payloadLength);
+        memcpy(record + sizeof(header) + payloadLength, requirements, requirementsLength);
+
+        char key[8];
+        keyFor(slot, key);
+        stored = prefs_.putBytes(key, record, length) == length;
+        free(record);
+    }
+
+    bool trigger = false;
+    if (stored)
+    {
+        slots_[slot].used = true;
+        slots_[slot].sequence = nextSequence_++;
+        if (count_++ == 0)
+            oldestMs_ = millis();
+        stats_.queued++;
+        trigger = task_ && count_ >= batchSize_;
+    }
+    else
+    {
+        stats_.persistFailures++;
+    }
+    unlock();
+
+    if (trigger)
+        xTaskNotifyGive(task_);
+    return stored;
+}
+
+void SettlementBatch::flush()
+{
+    lock();
+    flushRequested_ = count_ > 0;
+    retryAtMs_ = millis();
+    unlock();
+    if (task_)
+        xTaskNotifyGive(task_);
+}
+
+size_t SettlementBatch::pending()
+{
+    lock();
+    size_t count = count_;
+    unlock();
+    return count;
+}
+
+SettlementBatchStats SettlementBatch::getStats()
+{
+    lock();
+    SettlementBatchStats stats = stats_;
+    stats.pending = count_;
+    unlock();
+    return stats;
+}
+
+// Time until the interval trigger (or the retry back-off) fires
+uint32_t SettlementBatch::waitTicks()
+{
+    lock();
+    uint32_t now = millis();
+    TickType_t ticks = portMAX_DELAY;
+    if (count_ > 0)
+    {
+        uint32_t dueAt = oldestMs_ + intervalMs_;
+        if ((int32_t)(retryAtMs_ - dueAt) > 0)
+            dueAt = retryAtMs_;
+        int32_t remaining = (int32_t)(dueAt - now);
+        ticks = pdMS_TO_TICKS(remaining > 0 ? remaining : 1);
+    }
+    unlock();
+    return ticks;
+}
+
+bool SettlementBatch::due()
+{
+    lock();
+    uint32_t now = millis();
+    bool ready = count_ > 0 && (int32_t)(now - retryAtMs_) >= 0 &&
+                 (flushRequested_ || !enabled() || count_ >= batchSize_ || now - oldestMs_ >= intervalMs_);
+    unlock();
+    return ready;
+}
+
+// Load up to max of the oldest records
+size_t SettlementBatch::take(Loaded *batch, size_t max)
+{
+    size_t count = 0;
+    bool picked[X4PAY_SETTLE_BATCH_CAPACITY] = {};
+
+    lock();
+    while (count < max)
+    {
+        size_t oldest = X4PAY_SETTLE_BATCH_CAPACITY;
+        for (size_t i = 0; i < X4PAY_SETTLE_BATCH_CAPACITY; ++i)
+        {
+            if (slots_[i].used && !picked[i] &&
+                (oldest == X4PAY_SETTLE_BATCH_CAPACITY || slots_[i].sequence < slots_[oldest].sequence))
+                oldest = i;
+        }
+        if (oldest == X4PAY_SETTLE_BATCH_CAPACITY)
+            break;
+        picked[oldest] = true;
+
+        char key[8];
+        keyFor(oldest, key);
+        size_t length = prefs_.getBytesLength(key);
+        char *record = length > sizeof(RecordHeader) ? (char *)malloc(length) : nullptr;
+        if (!record || prefs_.getBytes(key, record, length) != length)
+        {
+            // Unreadable now; leave it for the next attempt
+            free(record);
+            continue;
+        }
+
+        RecordHeader header;
+        memcpy(&header, record, sizeof(header));
+        Loaded &item = batch[count++];
+        item.slot = oldest;
+        item.record = record;
+        item.payload = record + sizeof(header);
+        item.payloadLength = header.payloadLength;
+        item.requirements = item.payload + header.payloadLength;
+        item.requirementsLength = header.requirementsLength;
+        item.result = SettlementResult();
+        item.retry = false;
+    }
+    unlock();
+    return count;
+}
+
+// Facilitator unreachable or overloaded: try the same records again later
+static bool shouldRetry(int statusCode)
+{
+    return statusCode <= 0 || statusCode >= 500;
+}
+
+// One /settle per payment, back to back on the task's kept-alive connection
+void SettlementBatch::settleEach(Loaded *batch, size_t count, const String &facilitator)
+{
+    bool reachable = true;
+    for (size_t i = 0; i < count; ++i)
+    {
+        Loaded &item = batch[i];
+        if (!reachable)
+        {
+            // Don't hammer a facilitator that just failed
+            item.retry = true;
+            continue;
+        }
+        PaymentPayloadView view(item.payload, item.payloadLength);
+        item.result = settlePayment(view, item.requirements, item.requirementsLength, "", facilitator);
+        lock();
+        stats_.requests++;
+        unlock();
+        item.retry = shouldRetry(item.result.statusCode);
+        reachable = !item.retry;
+    }
+}
+
+// Segments per payment in a batch body: literal, version, literal, payload, literal, requirements
+static const size_t kSegmentsPerItem = 6;
+
+// Hands each entry of the batch reply's results[] to the record it belongs to
+void SettlementBatch::onBatchResult(void *context, size_t index, const FacilitatorResult &parsed)
+{
+    BatchReply *reply = (BatchReply *)context;
+    if (index >= reply->count)
+        return;
+    HttpResponse item;
+    item.statusCode = 200;
+    item.success = true;
+    reply->batch[index].result = settlementResultFrom(item, parsed);
+    reply->received = index + 1;
+}
+
+// Whole batch in one POST. false when the facilitator does not take batches -
+// the caller then settles the records one by one.
+bool SettlementBatch::settleTogether(Loaded *batch, size_t count, const String &facilitator)
+{
+    char url[X4PAY_FACILITATOR_URL_BYTES];
+    if (buildFacilitatorUrl(url, sizeof(url), facilitator.c_str(), "settle/batch") == 0)
+        return false; // too long for the stack buffer; settleEach reports it per payment
+
+    // {"items":[{"x402Version":..,"paymentPayload":..,"paymentRequirements":..},...]}
+    // streamed straight from the loaded records (only the settlement task gets here)
+    static SegmentedBodyStream::Segment segments[X4PAY_SETTLE_BATCH_CAPACITY * kSegmentsPerItem + 1];
+    SegmentedBodyStream body(segments, sizeof(segments) / sizeof(segments[0]));
+    for (size_t i = 0; i < count; ++i)
+    {
+        PaymentPayloadView view(batch[i].payload, batch[i].payloadLength);
+        body.append(i == 0 ? "{\"items\":[{\"x402Version\":" : "},{\"x402Version\":");
+        body.append(view.x402Version, view.versionLength);
+        body.append(",\"paymentPayload\":");
+        body.append(view.json, view.jsonLength);
+        body.append(",\"paymentRequirements\":");
+        body.append(batch[i].requirements, batch[i].requirementsLength);
+    }
+    body.append("}]}");
+
+    // {"results":[{...settle reply...}, ...]} in request order, parsed as it arrives
+    BatchReply reply = {batch, count, 0};
+    FacilitatorResponseParser parser;
+    parser.walkItems("results", onBatchResult, &reply);
+    HttpResponse response = FacilitatorClient::current().post(url, body, parser);
+
+    lock();
+    stats_.requests++;
+    unlock();
+
+    if (response.statusCode == 404 || response.statusCode == 405)
+    {
+        Serial.println("Settlement: facilitator has no batch endpoint, settling one by one");
+        facilitatorBatch_ = false;
+        return false;
+    }
+    if (shouldRetry(response.statusCode))
+    {
+        for (size_t i = 0; i < count; ++i)
+            batch[i].retry = true;
+        return true;
+    }
+    if (response.statusCode != 200)
+        return false;
+
+    // Results the facilitator left out (or a reply cut short) are asked for again later
+    for (size_t i = reply.received; i < count; ++i)
+        batch[i].retry = true;
+    return true;
+}
+
+// Drop settled and rejected records, report them, free the loaded copies
+void SettlementBatch::finish(Loaded *batch, size_t count)
+{
+    bool retried = false;
+    lock();
+    for (size_t i = 0; i < count; ++i)
+    {
+        Loaded &item = batch[i];
+        if (item.retry)
+        {
+            retried = true;
+            continue;
+        }
+        char key[8];
+        keyFor(item.slot, key);
+        prefs_.remove(key);
+        slots_[item.slot].used = false;
+        count_--;
+        if (item.result.success)
+            stats_.settled++;
+        else
+            stats_.failed++;
+    }
+    if (retried)
+    {
+        stats_.retries++;
+        retryAtMs_ = millis() + X4PAY_SETTLE_RETRY_MS;
+    }
+    if (count_ == 0)
+        flushRequested_ = false;
+    unlock();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        Loaded &item = batch[i];
+        if (!item.retry && onSettled_)
+        {
+            PaymentVerifyWorker::lockCallbacks();
+            onSettled_(item.result);
+            PaymentVerifyWorker::unlockCallbacks();
+        }
+        free(item.record);
+        item.record = nullptr;
+    }
+}
+
+void SettlementBatch::taskLoop(void *)
+{
+    // Own kept-alive connection so batches don't queue behind verify traffic
+    FacilitatorClient *client = new (std::nothrow) FacilitatorClient();
+    FacilitatorClient::bindToCurrentTask(client);
+
+    static Loaded batch[X4PAY_SETTLE_BATCH_CAPACITY];
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, waitTicks());
+        if (!due())
+            continue;
+
+        x4PayCore *ble = x4PayCore::getActiveInstance();
+        if (!ble)
+        {
+            retryAtMs_ = millis() + X4PAY_SETTLE_RETRY_MS;
+            continue;
+        }
+        const char *rootCA = FacilitatorClient::shared().getCACert();
+        if (client && client->getCACert() != rootCA)
+            client->setCACert(rootCA);
+
+        size_t count = take(batch, enabled() ? batchSize_ : X4PAY_SETTLE_BATCH_CAPACITY);
+        if (count == 0)
+        {
+            // Records could not be read back; don't spin on them
+            retryAtMs_ = millis() + X4PAY_SETTLE_RETRY_MS;
+            continue;
+        }
+        if (!facilitatorBatch_ || count == 1 || !settleTogether(batch, count, ble->getFacilitator()))
+            settleEach(batch, count, ble->getFacilitator());
+        finish(batch, count);
+    }
+}
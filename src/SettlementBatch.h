@@ -0,0 +1,140 @@
+#ifndef SETTLEMENT_BATCH_H
+#define SETTLEMENT_BATCH_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "X402Aurdino.h"
+
+// Verified payments that can wait for settlement. Each one holds an NVS record until it settles.
+#ifndef X4PAY_SETTLE_BATCH_CAPACITY
+#define X4PAY_SETTLE_BATCH_CAPACITY 16
+#endif
+
+// Stack of the settlement task (same headroom as a verify worker)
+#ifndef X4PAY_SETTLE_BATCH_STACK
+#define X4PAY_SETTLE_BATCH_STACK 8192
+#endif
+
+// Delay before a batch whose requests failed to reach the facilitator is retried
+#ifndef X4PAY_SETTLE_RETRY_MS
+#define X4PAY_SETTLE_RETRY_MS 30000
+#endif
+
+struct SettlementBatchStats
+{
+    uint32_t queued;          // verified payments persisted for later settlement
+    uint32_t settled;         // settled by the facilitator
+    uint32_t failed;          // rejected by the facilitator, record dropped
+    uint32_t retries;         // batches put back because the facilitator was unreachable
+    uint32_t requests;        // HTTP requests issued (one per batch in facilitator-batch mode)
+    uint32_t recovered;       // records found in flash at boot
+    uint32_t persistFailures; // add() refused: store full or flash write failed
+    uint32_t pending;         // records waiting right now
+};
+
+// Called once per payment settled (or rejected) by the batch task
+typedef void (*OnBatchSettledCallback)(const SettlementResult &result);
+
+// Deferred settlement for high-volume, low-value payments.
+// A verified payment is written to NVS before the central is answered, so a reboot
+// never loses it; a background task settles the records when batchSize are waiting or
+// the oldest is intervalMs old. With facilitatorBatch the whole batch goes out as one
+// POST <facilitator>/settle/batch; otherwise (or when the facilitator answers 404/405)
+// the /settle requests are sent back to back over one kept-alive connection.
+class SettlementBatch
+{
+public:
+    // batchSize 0 turns batching off; records already in flash are still settled
+    static void configure(size_t batchSize, uint32_t intervalMs, bool facilitatorBatch = false);
+    static bool enabled() { return batchSize_ > 0; }
+
+    // Load records left over from the last run and start the settlement task
+    static void begin(UBaseType_t prio = 2, BaseType_t core = 1);
+
+    // Persist a verified payment. false when the store is full or the write failed -
+    // the caller then settles it directly.
+    static bool add(const char *payload, size_t payloadLength, const char *requirements, size_t requirementsLength);
+
+    // Take over a verified payment recovered from elsewhere (the journal), batching on or off
+    static bool adopt(const char *payload, size_t payloadLength, const char *requirements, size_t requirementsLength);
+
+    // Settle everything pending now instead of waiting for the size or time trigger
+    static void flush();
+
+    static size_t pending();
+    static SettlementBatchStats getStats();
+
+    static void setOnSettled(OnBatchSettledCallback callback) { onSettled_ = callback; }
+
+private:
+    struct Slot
+    {
+        bool used;
+        uint32_t sequence; // arrival order, persisted so the order survives a reboot
+    };
+
+    // Stored in front of the payload and requirements bytes
+    struct RecordHeader
+    {
+        uint32_t magic;
+        uint32_t sequence;
+        uint16_t payloadLength;
+        uint16_t requirementsLength;
+    };
+
+    // One record loaded back from flash for settlement
+    struct Loaded
+    {
+        size_t slot;
+        char *record; // header, payload, requirements as stored
+        const char *payload;
+        size_t payloadLength;
+        const char *requirements;
+        size_t requirementsLength;
+        SettlementResult result;
+        bool retry; // facilitator unreachable - keep the record
+    };
+
+    // Batch reply being matched back to the records, in request order
+    struct BatchReply
+    {
+        Loaded *batch;
+        size_t count;
+        size_t received;
+    };
+
+    static Preferences prefs_;
+    static SemaphoreHandle_t lock_;
+    static TaskHandle_t task_;
+    static Slot slots_[X4PAY_SETTLE_BATCH_CAPACITY];
+    static size_t count_;
+    static uint32_t nextSequence_;
+    static uint32_t oldestMs_;   // when the oldest pending record was added (or loaded)
+    static uint32_t retryAtMs_;  // no attempt before this after a failed batch
+    static bool flushRequested_;
+    static size_t batchSize_;
+    static uint32_t intervalMs_;
+    static bool facilitatorBatch_;
+    static SettlementBatchStats stats_;
+    static OnBatchSettledCallback onSettled_;
+    static UBaseType_t prio_;
+    static BaseType_t core_;
+
+    static void lock();
+    static void unlock();
+    static void keyFor(size_t slot, char *key);
+    static void startTask();
+    static bool store(const char *payload, size_t payloadLength, const char *requirements, size_t requirementsLength);
+    static void taskLoop(void *arg);
+    static uint32_t waitTicks();
+    static bool due();
+    static size_t take(Loaded *batch, size_t max);
+    static void settleEach(Loaded *batch, size_t count, const String &facilitator);
+    static bool settleTogether(Loaded *batch, size_t count, const String &facilitator);
+    static void onBatchResult(void *context, size_t index, const FacilitatorResult &parsed);
+    static void finish(Loaded *batch, size_t count);
+};
+
+#endif // SETTLEMENT_BATCH_H
@@ -0,0 +1,47 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// Fixed-capacity single-producer / single-consumer ring.
+// push() is only called from one task and pop() from one other task; no locks are taken.
+// head_/tail_ are free-running counters, so size() stays correct across wraparound.
+template <typename T, size_t Capacity>
+class SpscRing
+{
+public:
+    static_assert(Capacity > 0, "SpscRing needs at least one slot");
+
+    bool push(const T &item)
+    {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        if (head - tail >= Capacity)
+            return false;
+        slots_[head % Capacity] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        if (head == tail)
+            return false;
+        item = slots_[tail % Capacity];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    T slots_[Capacity];
+    std::atomic<uint32_t> head_{0}; // written by the producer only
+    std::atomic<uint32_t> tail_{0}; // written by the consumer only
+};
+
+#endif // SPSC_RING_H
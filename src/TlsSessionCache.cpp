@@ -0,0 +1,147 @@
+#include "TlsSessionCache.h"
+#include <mbedtls/version.h>
+#include <string.h>
+
+// Session ID fields became private in mbedtls 3.x
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+#define X4PAY_SESSION_ID(s) ((s).MBEDTLS_PRIVATE(id))
+#define X4PAY_SESSION_ID_LEN(s) ((s).MBEDTLS_PRIVATE(id_len))
+#else
+#define X4PAY_SESSION_ID(s) ((s).id)
+#define X4PAY_SESSION_ID_LEN(s) ((s).id_len)
+#endif
+
+TlsSessionCache::TlsSessionCache() : clock_(0), stats_{0, 0, 0, 0}
+{
+    lock_ = xSemaphoreCreateMutex();
+    for (size_t i = 0; i < X4PAY_TLS_SESSION_CACHE_SIZE; ++i)
+    {
+        mbedtls_ssl_session_init(&entries_[i].session);
+        entries_[i].idLen = 0;
+        entries_[i].lastUsed = 0;
+        entries_[i].valid = false;
+    }
+}
+
+TlsSessionCache::~TlsSessionCache()
+{
+    clear();
+    if (lock_)
+        vSemaphoreDelete(lock_);
+}
+
+TlsSessionCache &TlsSessionCache::shared()
+{
+    static TlsSessionCache cache;
+    return cache;
+}
+
+void TlsSessionCache::freeEntry(Entry &entry)
+{
+    mbedtls_ssl_session_free(&entry.session);
+    mbedtls_ssl_session_init(&entry.session);
+    entry.host = "";
+    entry.idLen = 0;
+    entry.valid = false;
+}
+
+TlsSessionCache::Entry *TlsSessionCache::findLocked(const char *host)
+{
+    for (size_t i = 0; i < X4PAY_TLS_SESSION_CACHE_SIZE; ++i)
+    {
+        if (entries_[i].valid && entries_[i].host == host)
+            return &entries_[i];
+    }
+    return nullptr;
+}
+
+// Free slot if there is one, otherwise the least recently used host
+TlsSessionCache::Entry *TlsSessionCache::victimLocked()
+{
+    Entry *victim = &entries_[0];
+    for (size_t i = 0; i < X4PAY_TLS_SESSION_CACHE_SIZE; ++i)
+    {
+        if (!entries_[i].valid)
+            return &entries_[i];
+        if (entries_[i].lastUsed < victim->lastUsed)
+            victim = &entries_[i];
+    }
+    stats_.evictions++;
+    return victim;
+}
+
+bool TlsSessionCache::offer(const char *host, mbedtls_ssl_context *ssl)
+{
+    bool offered = false;
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    Entry *entry = findLocked(host);
+    if (entry)
+    {
+        entry->lastUsed = ++clock_;
+        offered = mbedtls_ssl_set_session(ssl, &entry->session) == 0;
+        if (!offered)
+            freeEntry(*entry);
+    }
+    xSemaphoreGive(lock_);
+    return offered;
+}
+
+bool TlsSessionCache::store(const char *host, const mbedtls_ssl_context *ssl, bool offered)
+{
+    mbedtls_ssl_session fresh;
+    mbedtls_ssl_session_init(&fresh);
+    if (mbedtls_ssl_get_session(ssl, &fresh) != 0)
+    {
+        mbedtls_ssl_session_free(&fresh);
+        return false;
+    }
+
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    Entry *entry = findLocked(host);
+
+    // TLS 1.2 servers echo the offered session ID when they accept a resumption
+    bool resumed = offered && entry && entry->idLen > 0 &&
+                   entry->idLen == X4PAY_SESSION_ID_LEN(fresh) &&
+                   memcmp(entry->id, X4PAY_SESSION_ID(fresh), entry->idLen) == 0;
+    if (resumed)
+        stats_.hits++;
+    else
+        stats_.misses++;
+
+    if (!entry)
+        entry = victimLocked();
+    freeEntry(*entry);
+
+    // Take ownership of the session (including any ticket) without another copy
+    entry->session = fresh;
+    entry->host = host;
+    entry->idLen = X4PAY_SESSION_ID_LEN(fresh);
+    if (entry->idLen > sizeof(entry->id))
+        entry->idLen = sizeof(entry->id);
+    memcpy(entry->id, X4PAY_SESSION_ID(fresh), entry->idLen);
+    entry->lastUsed = ++clock_;
+    entry->valid = true;
+    stats_.stores++;
+    xSemaphoreGive(lock_);
+    return resumed;
+}
+
+void TlsSessionCache::invalidate(const char *host)
+{
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    Entry *entry = findLocked(host);
+    if (entry)
+        freeEntry(*entry);
+    xSemaphoreGive(lock_);
+}
+
+void TlsSessionCache::clear()
+{
+    xSemaphoreTake(lock_, portMAX_DELAY);
+    for (size_t i = 0; i < X4PAY_TLS_SESSION_CACHE_SIZE; ++i)
+    {
+        if (entries_[i].valid)
+            freeEntry(entries_[i]);
+    }
+    xSemaphoreGive(lock_);
+}
@@ -0,0 +1,68 @@
+#ifndef TLS_SESSION_CACHE_H
+#define TLS_SESSION_CACHE_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <mbedtls/ssl.h>
+
+// Number of facilitator hosts whose TLS sessions are remembered
+#ifndef X4PAY_TLS_SESSION_CACHE_SIZE
+#define X4PAY_TLS_SESSION_CACHE_SIZE 2
+#endif
+
+struct TlsSessionCacheStats
+{
+    uint32_t hits;      // handshakes resumed from a cached session
+    uint32_t misses;    // full handshakes (nothing cached, or the server refused resumption)
+    uint32_t stores;    // sessions saved after a handshake
+    uint32_t evictions; // entries dropped to make room for another host
+};
+
+// TLS session ID / ticket cache keyed by host name.
+// A reconnect to the facilitator offers the saved session so the server can
+// resume it with an abbreviated handshake instead of a full key exchange.
+class TlsSessionCache
+{
+public:
+    TlsSessionCache();
+    ~TlsSessionCache();
+
+    // Offer the cached session for host on ssl before the handshake.
+    // Returns true if a session was offered.
+    bool offer(const char *host, mbedtls_ssl_context *ssl);
+
+    // Save the negotiated session after a successful handshake.
+    // Returns true if the handshake resumed the offered session.
+    bool store(const char *host, const mbedtls_ssl_context *ssl, bool offered);
+
+    // Forget the session for host (e.g. after a handshake failure)
+    void invalidate(const char *host);
+    void clear();
+
+    TlsSessionCacheStats getStats() const { return stats_; }
+
+    static TlsSessionCache &shared();
+
+private:
+    struct Entry
+    {
+        String host;
+        mbedtls_ssl_session session;
+        unsigned char id[32];
+        size_t idLen;
+        uint32_t lastUsed;
+        bool valid;
+    };
+
+    Entry entries_[X4PAY_TLS_SESSION_CACHE_SIZE];
+    uint32_t clock_;
+    TlsSessionCacheStats stats_;
+    SemaphoreHandle_t lock_;
+
+    Entry *findLocked(const char *host);
+    Entry *victimLocked();
+    static void freeEntry(Entry &entry);
+};
+
+#endif // TLS_SESSION_CACHE_H
@@ -0,0 +1,284 @@
+#include "TxFragmenter.h"
+#include "BleFrame.h"
+
+TxFragmenter::Pending TxFragmenter::pending_[X4PAY_MAX_LINKS * X4PAY_TX_QUEUE_DEPTH] = {};
+uint32_t TxFragmenter::order_ = 0;
+SemaphoreHandle_t TxFragmenter::lock_ = nullptr;
+TaskHandle_t TxFragmenter::task_ = nullptr;
+TxFragmenterStats TxFragmenter::stats_ = {};
+
+void TxFragmenter::lock()
+{
+    if (lock_)
+        xSemaphoreTake(lock_, portMAX_DELAY);
+}
+
+void TxFragmenter::unlock()
+{
+    if (lock_)
+        xSemaphoreGive(lock_);
+}
+
+void TxFragmenter::begin(UBaseType_t prio, BaseType_t core)
+{
+    if (task_)
+        return;
+    if (!lock_)
+        lock_ = xSemaphoreCreateMutex();
+    xTaskCreatePinnedToCore(taskLoop, "pay_tx", X4PAY_TX_STACK / sizeof(StackType_t), nullptr, prio, &task_, core);
+}
+
+// The connection's current reply: the oldest one it holds
+TxFragmenter::Pending *TxFragmenter::findLocked(uint16_t connHandle)
+{
+    Pending *found = nullptr;
+    for (Pending &p : pending_)
+    {
+        if (p.used && p.connHandle == connHandle && (!found || (int32_t)(p.order - found->order) < 0))
+            found = &p;
+    }
+    return found;
+}
+
+size_t TxFragmenter::countLocked(uint16_t connHandle)
+{
+    size_t count = 0;
+    for (Pending &p : pending_)
+    {
+        if (p.used && p.connHandle == connHandle)
+            count++;
+    }
+    return count;
+}
+
+bool TxFragmenter::reply(NimBLECharacteristic *tx, uint16_t connHandle, const uint8_t *data, size_t length)
+{
+    if (!tx || length == 0)
+        return false;
+    if (length <= BleLinkTable::maxPayload(connHandle) || !task_)
+    {
+        lock();
+        stats_.direct++;
+        unlock();
+        return tx->notify(data, length, connHandle);
+    }
+    return queue(tx, connHandle, false, 0, 0, 0, data, length);
+}
+
+bool TxFragmenter::replyFramed(NimBLECharacteristic *tx, uint16_t connHandle, uint8_t opcode, uint8_t sequence,
+                               uint8_t flags, const uint8_t *data, size_t length)
+{
+    if (!tx || length > 0xFFFF)
+        return false;
+    size_t maxPayload = BleLinkTable::maxPayload(connHandle);
+    if (X4PAY_FRAME_HEADER_BYTES + length <= maxPayload || !task_)
+    {
+        uint8_t frame[X4PAY_BLE_MTU];
+        if (X4PAY_FRAME_HEADER_BYTES + length > sizeof(frame))
+            length = sizeof(frame) - X4PAY_FRAME_HEADER_BYTES;
+        writeBleFrameHeader(frame, opcode, sequence, flags, (uint16_t)length);
+        memcpy(frame + X4PAY_FRAME_HEADER_BYTES, data, length);
+        lock();
+        stats_.direct++;
+        unlock();
+        return tx->notify(frame, X4PAY_FRAME_HEADER_BYTES + length, connHandle);
+    }
+    return queue(tx, connHandle, true, opcode, sequence, flags, data, length);
+}
+
+// Keep a copy of the reply for the task (and for resume). It replaces the connection's
+// previous reply only once that one is done; otherwise it waits behind it.
+bool TxFragmenter::queue(NimBLECharacteristic *tx, uint16_t connHandle, bool framed, uint8_t opcode,
+                         uint8_t sequence, uint8_t flags, const uint8_t *data, size_t length)
+{
+    // Offsets are 16-bit on the wire
+    if (length > 0xFFFF)
+        return false;
+    uint8_t *copy = (uint8_t *)malloc(length);
+    if (!copy)
+        return false;
+    memcpy(copy, data, length);
+
+    lock();
+    // Replies already sent (or given up on) are only kept for resume
+    for (Pending &old : pending_)
+    {
+        if (old.used && old.connHandle == connHandle && old.next >= old.length)
+        {
+            free(old.data);
+            old.data = nullptr;
+            old.used = false;
+        }
+    }
+    Pending *p = nullptr;
+    if (countLocked(connHandle) < X4PAY_TX_QUEUE_DEPTH)
+    {
+        for (size_t i = 0; !p && i < X4PAY_MAX_LINKS * X4PAY_TX_QUEUE_DEPTH; ++i)
+        {
+            if (!pending_[i].used)
+                p = &pending_[i];
+        }
+    }
+    if (p)
+    {
+        p->used = true;
+        p->connHandle = connHandle;
+        p->tx = tx;
+        p->data = copy;
+        p->length = length;
+        p->next = 0;
+        p->retries = 0;
+        p->framed = framed;
+        p->opcode = opcode;
+        p->sequence = sequence;
+        p->flags = flags;
+        p->order = order_++;
+        stats_.fragmented++;
+    }
+    unlock();
+
+    if (!p)
+    {
+        free(copy);
+        return false;
+    }
+    xTaskNotifyGive(task_);
+    return true;
+}
+
+bool TxFragmenter::resume(uint16_t connHandle, size_t offset)
+{
+    lock();
+    Pending *p = findLocked(connHandle);
+    bool resumed = p && offset < p->length;
+    if (resumed)
+    {
+        p->next = offset;
+        p->retries = 0;
+        stats_.resumed++;
+    }
+    unlock();
+    if (resumed)
+        xTaskNotifyGive(task_);
+    return resumed;
+}
+
+void TxFragmenter::release(uint16_t connHandle)
+{
+    lock();
+    for (Pending &p : pending_)
+    {
+        if (p.used && p.connHandle == connHandle)
+        {
+            free(p.data);
+            p.data = nullptr;
+            p.used = false;
+        }
+    }
+    unlock();
+}
+
+TxFragmenterStats TxFragmenter::getStats()
+{
+    lock();
+    TxFragmenterStats stats = stats_;
+    unlock();
+    return stats;
+}
+
+// Next fragment of p into out; chunk receives the number of reply bytes it carries
+size_t TxFragmenter::build(Pending &p, uint8_t *out, size_t maxPayload, size_t &chunk)
+{
+    size_t header = p.framed ? X4PAY_FRAME_HEADER_BYTES + 2 : X4PAY_TX_FRAGMENT_HEADER_BYTES;
+    size_t remaining = p.length - p.next;
+    chunk = maxPayload - header < remaining ? maxPayload - header : remaining;
+    bool last = chunk == remaining;
+
+    uint8_t *body = out;
+    if (p.framed)
+    {
+        uint8_t flags = p.flags | FrameFragment | (p.next == 0 ? FrameStart : 0) | (last ? FrameEnd : 0);
+        writeBleFrameHeader(out, p.opcode, p.sequence, flags, (uint16_t)(chunk + 2));
+        body = out + X4PAY_FRAME_HEADER_BYTES;
+    }
+    else
+    {
+        *body++ = last ? X4PAY_TX_LAST : X4PAY_TX_MORE;
+    }
+    body[0] = (uint8_t)(p.next & 0xFF);
+    body[1] = (uint8_t)(p.next >> 8);
+    memcpy(body + 2, p.data + p.next, chunk);
+    return header + chunk;
+}
+
+void TxFragmenter::taskLoop(void *)
+{
+    uint8_t out[X4PAY_BLE_MTU];
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Round-robin one fragment per connection so a long reply can't starve the others
+        bool active = true;
+        while (active)
+        {
+            active = false;
+            bool congested = false;
+            for (Pending &p : pending_)
+            {
+                lock();
+                // Replies waiting behind the connection's current one go out after it
+                if (!p.used || p.next >= p.length || findLocked(p.connHandle) != &p)
+                {
+                    unlock();
+                    continue;
+                }
+                const uint8_t *data = p.data;
+                size_t start = p.next;
+                uint16_t connHandle = p.connHandle;
+                NimBLECharacteristic *tx = p.tx;
+                size_t chunk = 0;
+                size_t size = build(p, out, BleLinkTable::maxPayload(connHandle), chunk);
+                unlock();
+
+                bool sent = tx->notify(out, size, connHandle);
+
+                lock();
+                // Resumed or released while we were sending: leave it as it is now
+                if (p.used && p.data == data && p.next == start)
+                {
+                    if (sent)
+                    {
+                        p.next = start + chunk;
+                        p.retries = 0;
+                        stats_.fragments++;
+                    }
+                    else if (++p.retries > X4PAY_TX_MAX_RETRIES)
+                    {
+                        // Central gone quiet or link saturated; it can ask for the rest
+                        p.next = p.length;
+                        stats_.stalled++;
+                    }
+                    else
+                    {
+                        stats_.congested++;
+                        congested = true;
+                    }
+                    // Done: make way for the next reply of the connection, if one is waiting
+                    if (p.next >= p.length && countLocked(connHandle) > 1)
+                    {
+                        free(p.data);
+                        p.data = nullptr;
+                        p.used = false;
+                    }
+                }
+                Pending *current = findLocked(connHandle);
+                active = active || (current && current->next < current->length);
+                unlock();
+            }
+            if (congested)
+                vTaskDelay(pdMS_TO_TICKS(X4PAY_TX_RETRY_MS));
+        }
+    }
+}
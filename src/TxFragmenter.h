@@ -0,0 +1,108 @@
+#ifndef TX_FRAGMENTER_H
+#define TX_FRAGMENTER_H
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "BleLink.h"
+
+// Continuation markers of a fragmented text reply. Each notification is
+// marker, little-endian byte offset of the data, then the data itself.
+#define X4PAY_TX_MORE 0x1F // more fragments follow
+#define X4PAY_TX_LAST 0x1E // last fragment of the reply
+#define X4PAY_TX_FRAGMENT_HEADER_BYTES 3
+
+// Stack of the task that paces fragments out (holds one MTU-sized fragment)
+#ifndef X4PAY_TX_STACK
+#define X4PAY_TX_STACK 3072
+#endif
+
+// Back-off when the stack is out of notification buffers, and how many times to
+// back off before the rest of the reply is left for the central to resume
+#ifndef X4PAY_TX_RETRY_MS
+#define X4PAY_TX_RETRY_MS 5
+#endif
+#ifndef X4PAY_TX_MAX_RETRIES
+#define X4PAY_TX_MAX_RETRIES 40
+#endif
+
+// Long replies held per connection: the one going out plus those waiting behind it.
+// A reply that finds the queue full is refused (reply() returns false).
+#ifndef X4PAY_TX_QUEUE_DEPTH
+#define X4PAY_TX_QUEUE_DEPTH 2
+#endif
+
+struct TxFragmenterStats
+{
+    uint32_t direct;     // replies that fit one notification
+    uint32_t fragmented; // replies split into fragments
+    uint32_t fragments;  // fragment notifications sent
+    uint32_t congested;  // notify attempts refused by the stack (backed off)
+    uint32_t stalled;    // replies abandoned after X4PAY_TX_MAX_RETRIES, left to resume
+    uint32_t resumed;    // resume requests served
+};
+
+// Sends replies on the TX characteristic in notifications that fit the connection's MTU.
+// A reply that fits goes out as before, in one notification. A longer one is copied,
+// and a background task sends it fragment by fragment, backing off whenever the stack
+// runs out of buffers (the NimBLE host task must not wait on its own TX queue).
+// A long reply queued while an earlier one is still going out waits until that one is
+// done, so replies are never cut off halfway. The last long reply of each connection is
+// kept until the next one or the disconnect, so a central that saw a gap in the offsets
+// can ask for the rest with [RESUME]<offset>.
+class TxFragmenter
+{
+public:
+    static void begin(UBaseType_t prio = 2, BaseType_t core = 0);
+
+    // Text reply: one plain notification, or X4PAY_TX_MORE/X4PAY_TX_LAST fragments
+    static bool reply(NimBLECharacteristic *tx, uint16_t connHandle, const uint8_t *data, size_t length);
+
+    // Framed reply: frame header on every notification. Fragments carry FrameFragment,
+    // FrameStart / FrameEnd on the first / last, and a 2-byte offset in front of the data.
+    static bool replyFramed(NimBLECharacteristic *tx, uint16_t connHandle, uint8_t opcode, uint8_t sequence,
+                            uint8_t flags, const uint8_t *data, size_t length);
+
+    // Send the current (going out or kept) reply again from offset; false when there is nothing to resume
+    static bool resume(uint16_t connHandle, size_t offset);
+
+    // Drop the connection's replies (disconnect)
+    static void release(uint16_t connHandle);
+
+    static TxFragmenterStats getStats();
+
+private:
+    struct Pending
+    {
+        uint16_t connHandle;
+        NimBLECharacteristic *tx;
+        uint8_t *data;
+        size_t length;
+        size_t next;   // offset of the next fragment; == length when done
+        uint16_t retries;
+        bool framed;
+        uint8_t opcode;
+        uint8_t sequence;
+        uint8_t flags;
+        uint32_t order; // queue position; the connection's lowest is its current reply
+        bool used;
+    };
+
+    static Pending pending_[X4PAY_MAX_LINKS * X4PAY_TX_QUEUE_DEPTH];
+    static uint32_t order_;
+    static SemaphoreHandle_t lock_;
+    static TaskHandle_t task_;
+    static TxFragmenterStats stats_;
+
+    static void lock();
+    static void unlock();
+    static bool queue(NimBLECharacteristic *tx, uint16_t connHandle, bool framed, uint8_t opcode,
+                      uint8_t sequence, uint8_t flags, const uint8_t *data, size_t length);
+    static Pending *findLocked(uint16_t connHandle);
+    static size_t countLocked(uint16_t connHandle);
+    static size_t build(Pending &p, uint8_t *out, size_t maxPayload, size_t &chunk);
+    static void taskLoop(void *arg);
+};
+
+#endif // TX_FRAGMENTER_H
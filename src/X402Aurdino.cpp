@@ -18,6 +18,17 @@ PaymentPayload::PaymentPayload(const String& paymentJsonStr) {
     payloadJson = paymentJsonStr;
 }
 
+PaymentPayloadView::PaymentPayloadView(const char *paymentJson, size_t length)
+    : x402Version("1"), versionLength(1), json(paymentJson), jsonLength(length)
+{
+    const char *value;
+    size_t valueLength;
+    if (findJsonValue(paymentJson, length, "x402Version", &value, &valueLength) && valueLength > 0) {
+        x402Version = value;
+        versionLength = valueLength;
+    }
+}
+
 AssetInfo getAssetForNetwork(const String &network)
 {
     // Check if the network exists in our mapping
@@ -89,48 +100,145 @@ String buildDefaultPaymentRementsJson(const String network, const String payTo,
     return result;
 }
 
-bool verifyPayment(const PaymentPayload &decodedSignedPayload, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri)
+void PaymentRequirementsTemplate::build(const String &network, const String &payTo, const String &resource, const String &description)
 {
-    STACK_CHECKPOINT("verifyPayment:start");
+    // Render with an empty amount and cut at the (now empty) value slot
+    String json = buildDefaultPaymentRementsJson(network, payTo, "", resource, description);
     
-    // Make API call using utility function
-    HttpResponse response = makePaymentApiCall("verify", decodedSignedPayload, paymentRequirements, customHeaders, facilitatorUri);
-    STACK_CHECKPOINT("verifyPayment:after_api_call");
+    const char *slotKey = "\"maxAmountRequired\":\"";
+    int slot = json.indexOf(slotKey);
+    if (slot < 0) {
+        prefix_ = "";
+        suffix_ = "";
+        return;
+    }
+    slot += strlen(slotKey);
     
+    prefix_ = json.substring(0, slot);
+    suffix_ = json.substring(slot);
+}
+
+String PaymentRequirementsTemplate::render(const String &maxAmountRequired) const
+{
+    String json;
+    json.reserve(prefix_.length() + maxAmountRequired.length() + suffix_.length());
+    json = prefix_;
+    json += maxAmountRequired;
+    json += suffix_;
+    return json;
+}
+
+size_t PaymentRequirementsTemplate::renderInto(char *out, size_t capacity, const char *maxAmountRequired) const
+{
+    size_t amountLength = strlen(maxAmountRequired);
+    size_t total = prefix_.length() + amountLength + suffix_.length();
+    if (!out || total + 1 > capacity)
+        return 0;
+    memcpy(out, prefix_.c_str(), prefix_.length());
+    memcpy(out + prefix_.length(), maxAmountRequired, amountLength);
+    memcpy(out + prefix_.length() + amountLength, suffix_.c_str(), suffix_.length());
+    out[total] = '\0';
+    return total;
+}
+
+static void copyField(char *dest, size_t capacity, const char *src)
+{
+    strncpy(dest, src, capacity - 1);
+    dest[capacity - 1] = '\0';
+}
+
+static void appendJsonMember(String &json, const char *key, const char *value)
+{
+    json += ",\"";
+    json += key;
+    json += "\":\"";
+    for (const char *p = value; *p; ++p) {
+        if (*p == '"' || *p == '\\') {
+            json += '\\';
+        }
+        json += *p;
+    }
+    json += '"';
+}
+
+SettlementResult::operator String() const
+{
+    if (!success) {
+        return String();
+    }
+    String json;
+    json.reserve(40 + strlen(transaction) + strlen(network) + strlen(payer));
+    json = "{\"success\":true";
+    appendJsonMember(json, "transaction", transaction);
+    appendJsonMember(json, "network", network);
+    appendJsonMember(json, "payer", payer);
+    json += '}';
+    return json;
+}
+
+// Shared by both settlePayment flavours
+SettlementResult settlementResultFrom(const HttpResponse &response, const FacilitatorResult &parsed)
+{
+    SettlementResult result;
+    result.statusCode = response.statusCode;
+    copyField(result.transaction, sizeof(result.transaction), parsed.transaction);
+    copyField(result.payer, sizeof(result.payer), parsed.payer);
+    copyField(result.network, sizeof(result.network), parsed.network);
+    copyField(result.errorReason, sizeof(result.errorReason), parsed.errorReason);
+    
+    // Only consider settled if the facilitator said so and gave us a hash
+    result.success = response.success && response.statusCode == 200 &&
+                     parsed.hasSuccess && parsed.success && result.transaction[0] != '\0';
+    
+    if (result.success) {
+        return result;
+    }
+    
+    Serial.print("ERROR: Settlement failed - Code: ");
+    Serial.println(response.statusCode);
+    if (result.errorReason[0] != '\0') {
+        Serial.print("ERROR: ");
+        Serial.println(result.errorReason);
+    } else if (parsed.malformed) {
+        copyField(result.errorReason, sizeof(result.errorReason), "malformed_response");
+    } else if (response.statusCode <= 0) {
+        copyField(result.errorReason, sizeof(result.errorReason), "request_failed");
+    }
+    return result;
+}
+
+// Shared by both verifyPayment flavours
+bool verifyResultFrom(const HttpResponse &response, const FacilitatorResult &result)
+{
     if (response.success && response.statusCode > 0) {
-        // Parse response manually
-        String isValidStr = extractJsonValue(response.body, "isValid");
-        bool isValid = (isValidStr == "true");
-        
-        // Free memory immediately after use
-        isValidStr = "";
-        
-        STACK_CHECKPOINT("verifyPayment:after_parse");
+        bool isValid = result.hasIsValid && result.isValid;
         
-        if (!isValid) {
-            String invalidReason = extractJsonValue(response.body, "invalidReason");
-            if (invalidReason.length() > 0) {
-                Serial.print("ERROR: Payment verification failed - ");
-                Serial.println(invalidReason);
-            }
-            invalidReason = "";  // Free memory
+        if (!isValid && result.invalidReason[0] != '\0') {
+            Serial.print("ERROR: Payment verification failed - ");
+            Serial.println(result.invalidReason);
         }
-        
-        // Clear response body to free memory
-        response.body = "";
-        
-        STACK_CHECKPOINT("verifyPayment:end");
         return isValid;
     }
     
     Serial.print("ERROR: HTTP request failed - Code: ");
     Serial.println(response.statusCode);
-    response.body = "";  // Free memory
-    
-    STACK_CHECKPOINT("verifyPayment:end_error");
     return false;
 }
 
+bool verifyPayment(const PaymentPayload &decodedSignedPayload, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri)
+{
+    STACK_CHECKPOINT("verifyPayment:start");
+    
+    // Make API call using utility function - reply is parsed as it streams in
+    FacilitatorResult result;
+    HttpResponse response = makePaymentApiCall("verify", decodedSignedPayload, paymentRequirements, customHeaders, facilitatorUri, result);
+    STACK_CHECKPOINT("verifyPayment:after_api_call");
+    
+    bool isValid = verifyResultFrom(response, result);
+    STACK_CHECKPOINT("verifyPayment:end");
+    return isValid;
+}
+
 // Overloaded verifyPayment that accepts raw JSON strings
 bool verifyPayment(const String &paymentPayloadJson, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri)
 {
@@ -141,34 +249,41 @@ bool verifyPayment(const String &paymentPayloadJson, const String &paymentRequir
     return verifyPayment(payload, paymentRequirements, customHeaders, facilitatorUri);
 }
 
-String settlePayment(const PaymentPayload &decodedSignedPayload, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri)
+SettlementResult settlePayment(const PaymentPayload &decodedSignedPayload, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri)
 {
     STACK_CHECKPOINT("settlePayment:start");
     
-    // Make API call using utility function
-    HttpResponse response = makePaymentApiCall("settle", decodedSignedPayload, paymentRequirements, customHeaders, facilitatorUri);
+    // Make API call using utility function - reply is parsed as it streams in
+    FacilitatorResult parsed;
+    HttpResponse response = makePaymentApiCall("settle", decodedSignedPayload, paymentRequirements, customHeaders, facilitatorUri, parsed);
     
     STACK_CHECKPOINT("settlePayment:after_api_call");
-    Serial.println("Settlement response : " + String(response.body));
-    if (response.success && response.statusCode == 200) {
-        // Return a copy and free the response
-        String result = response.body;
-        response.body = "";
-        
-        STACK_CHECKPOINT("settlePayment:end_success");
-        return result;
-    } else {
-        Serial.print("ERROR: Settlement failed - Code: ");
-        Serial.println(response.statusCode);
-        if (response.success && response.body.length() > 0) {
-            Serial.print("ERROR: ");
-            Serial.println(response.body);
-        }
-        
-        // Free memory before returning
-        response.body = "";
-        
-        STACK_CHECKPOINT("settlePayment:end_error");
-        return "";
-    }
+    
+    SettlementResult result = settlementResultFrom(response, parsed);
+    STACK_CHECKPOINT("settlePayment:end");
+    return result;
+}
+
+bool verifyPayment(const PaymentPayloadView &payload, const char *paymentRequirements, size_t requirementsLength, const String &customHeaders, const String &facilitatorUri)
+{
+    STACK_CHECKPOINT("verifyPayment(view):start");
+    
+    FacilitatorResult result;
+    HttpResponse response = makePaymentApiCall("verify", payload, paymentRequirements, requirementsLength, customHeaders, facilitatorUri, result);
+    
+    bool isValid = verifyResultFrom(response, result);
+    STACK_CHECKPOINT("verifyPayment(view):end");
+    return isValid;
+}
+
+SettlementResult settlePayment(const PaymentPayloadView &payload, const char *paymentRequirements, size_t requirementsLength, const String &customHeaders, const String &facilitatorUri)
+{
+    STACK_CHECKPOINT("settlePayment(view):start");
+    
+    FacilitatorResult parsed;
+    HttpResponse response = makePaymentApiCall("settle", payload, paymentRequirements, requirementsLength, customHeaders, facilitatorUri, parsed);
+    
+    SettlementResult result = settlementResultFrom(response, parsed);
+    STACK_CHECKPOINT("settlePayment(view):end");
+    return result;
 }
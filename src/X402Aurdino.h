@@ -38,6 +38,36 @@ struct PaymentPayload
     PaymentPayload(const String& paymentJsonStr);
 };
 
+// Borrowed view of a payment JSON held elsewhere (e.g. a session buffer).
+// The version points into the JSON itself, so building it copies nothing.
+struct PaymentPayloadView
+{
+    const char *x402Version;
+    size_t versionLength;
+    const char *json;
+    size_t jsonLength;
+
+    PaymentPayloadView(const char *paymentJson, size_t length);
+};
+
+// Outcome of a /settle call, parsed in a single pass over the reply.
+// Fixed-size fields so a settlement never touches the heap.
+struct SettlementResult
+{
+    bool success;           // facilitator reported success:true and returned a transaction hash
+    int statusCode;         // HTTP status, or negative HTTPClient error
+    char transaction[80];   // on-chain transaction hash
+    char payer[48];         // payer address
+    char network[32];       // network the payment settled on
+    char errorReason[64];   // facilitator errorReason, or a local reason when the request failed
+
+    SettlementResult() : success(false), statusCode(0), transaction{0}, payer{0}, network{0}, errorReason{0} {}
+
+    // settlePayment used to return the reply body as a String, empty on failure.
+    // Callers written that way still compile and get the parsed fields as JSON.
+    operator String() const;
+};
+
 const std::map<String, uint32_t> EvmNetworkToChainId = {
     {"base-sepolia", 84532},
     {"base", 8453},
@@ -70,12 +100,43 @@ String buildRequirementsJson(const String &network, const String &payTo, const S
 
 String buildDefaultPaymentRementsJson(const String network, const String payTo, const String maxAmountRequired, const String resource, const String description = "");
 
+// Default payment requirements JSON pre-split around the maxAmountRequired value.
+// Built once; a payment at another price only splices the new amount in.
+class PaymentRequirementsTemplate
+{
+public:
+    void build(const String &network, const String &payTo, const String &resource, const String &description = "");
+
+    // Requirements JSON for this amount: one allocation and three copies
+    String render(const String &maxAmountRequired) const;
+
+    // Same JSON written into caller storage; returns its length, 0 if it does not fit
+    size_t renderInto(char *out, size_t capacity, const char *maxAmountRequired) const;
+    size_t renderedLength(const char *maxAmountRequired) const { return prefix_.length() + strlen(maxAmountRequired) + suffix_.length(); }
+
+    bool isBuilt() const { return prefix_.length() > 0; }
+
+private:
+    String prefix_; // everything up to and including "maxAmountRequired":"
+    String suffix_; // everything from the closing quote of the amount
+};
+
 // Verify payment using PaymentPayload struct
 bool verifyPayment(const PaymentPayload &decodedSignedPayload, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri);
 
 // Verify payment using raw JSON strings (convenience method)
 bool verifyPayment(const String &paymentPayloadJson, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri);
 
-String settlePayment(const PaymentPayload &decodedSignedPayload, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri);
+SettlementResult settlePayment(const PaymentPayload &decodedSignedPayload, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri);
+
+// Interpret a parsed facilitator reply (used by the synchronous calls above and the async worker)
+struct HttpResponse;
+struct FacilitatorResult;
+bool verifyResultFrom(const HttpResponse &response, const FacilitatorResult &result);
+SettlementResult settlementResultFrom(const HttpResponse &response, const FacilitatorResult &parsed);
+
+// Zero-copy variants used by the payment worker: payload and requirements stay in their buffers
+bool verifyPayment(const PaymentPayloadView &payload, const char *paymentRequirements, size_t requirementsLength, const String &customHeaders, const String &facilitatorUri);
+SettlementResult settlePayment(const PaymentPayloadView &payload, const char *paymentRequirements, size_t requirementsLength, const String &customHeaders, const String &facilitatorUri);
 
 #endif
\ No newline at end of file
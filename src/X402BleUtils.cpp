@@ -20,6 +20,18 @@ bool startsWithIgnoreCase(const String &s, const char *prefix)
     return true;
 }
 
+int compareCommandKey(const char *a, size_t aLength, const char *b, size_t bLength)
+{
+    size_t n = aLength < bLength ? aLength : bLength;
+    for (size_t i = 0; i < n; ++i)
+    {
+        int diff = toupper((unsigned char)a[i]) - toupper((unsigned char)b[i]);
+        if (diff != 0)
+            return diff;
+    }
+    return (int)aLength - (int)bLength;
+}
+
 // Memory-optimized payment chunk assembly with proper capacity management
 // Frontend sends: "X-PAYMENT:START<data>", "X-PAYMENT<data>", ..., "X-PAYMENT:END<data>"
 // Returns true when complete (END received), false while still assembling
@@ -31,7 +43,7 @@ bool assemblePaymentChunk(const String &chunk, String &paymentPayload)
     {
         // Start of new payment - clear existing and start fresh
         paymentPayload = "";
-        paymentPayload.reserve(1024); // Pre-allocate expected payload size
+        paymentPayload.reserve(X4PAY_MAX_PAYMENT_BYTES); // Pre-allocate expected payload size
         paymentPayload += (chunk_ptr + 15); // Skip "X-PAYMENT:START"
         return false; // Not complete yet
     }
@@ -67,7 +79,7 @@ bool assemblePriceRequestChunk(const String &chunk, String &priceRequestPayload)
         // Start of new price request - clear existing and start fresh
         
         priceRequestPayload = "";
-        priceRequestPayload.reserve(512); // Pre-allocate expected payload size
+        priceRequestPayload.reserve(X4PAY_MAX_PRICE_REQUEST_BYTES); // Pre-allocate expected payload size
         priceRequestPayload += (chunk_ptr + 13); // Skip "[PRICE]:START"
         
         return false; // Not complete yet
@@ -93,3 +105,235 @@ bool assemblePriceRequestChunk(const String &chunk, String &priceRequestPayload)
     
     return false;
 }
+
+bool assemblePaymentChunk(const char *chunk, PayloadBuffer &paymentPayload)
+{
+    if (strncmp(chunk, "X-PAYMENT:START", 15) == 0)
+    {
+        paymentPayload.clear();
+        paymentPayload.reserve(X4PAY_MAX_PAYMENT_BYTES); // no-op for arena-backed buffers
+        paymentPayload.append(chunk + 15);
+        return false;
+    }
+    else if (strncmp(chunk, "X-PAYMENT:END", 13) == 0)
+    {
+        paymentPayload.append(chunk + 13);
+        return true;
+    }
+    else if (strncmp(chunk, "X-PAYMENT", 9) == 0)
+    {
+        paymentPayload.append(chunk + 9);
+        return false;
+    }
+    return false;
+}
+
+bool assemblePriceRequestChunk(const char *chunk, PayloadBuffer &priceRequestPayload)
+{
+    if (strncmp(chunk, "[PRICE]:START", 13) == 0)
+    {
+        priceRequestPayload.clear();
+        priceRequestPayload.reserve(X4PAY_MAX_PRICE_REQUEST_BYTES);
+        priceRequestPayload.append(chunk + 13);
+        return false;
+    }
+    else if (strncmp(chunk, "[PRICE]:END", 11) == 0)
+    {
+        priceRequestPayload.append(chunk + 11);
+        return true;
+    }
+    else if (strncmp(chunk, "[PRICE]:", 8) == 0)
+    {
+        priceRequestPayload.append(chunk + 8);
+        return false;
+    }
+    return false;
+}
+
+// Offset just past the JSON object at the start of data, 0 if data does not start with a complete object
+static size_t jsonObjectEnd(const char *data, size_t length)
+{
+    if (length == 0 || data[0] != '{')
+        return 0;
+    int depth = 0;
+    bool inString = false;
+    for (size_t i = 0; i < length; ++i)
+    {
+        char c = data[i];
+        if (inString)
+        {
+            if (c == '\\')
+                ++i;
+            else if (c == '"')
+                inString = false;
+        }
+        else if (c == '"')
+            inString = true;
+        else if (c == '{')
+            ++depth;
+        else if (c == '}' && --depth == 0)
+            return i + 1;
+    }
+    return 0;
+}
+
+// Offset of the first "--" at or after from, or length; escaped honours backslash escapes
+static size_t findDelimiter(const char *data, size_t length, size_t from, bool escaped)
+{
+    for (size_t i = from; i + 1 < length; ++i)
+    {
+        if (escaped && data[i] == '\\')
+            ++i;
+        else if (data[i] == '-' && data[i + 1] == '-')
+            return i;
+    }
+    return length;
+}
+
+// Split "context--options"; false when there is no delimiter
+static bool splitTail(const char *data, size_t length, PaymentEnvelope &envelope)
+{
+    size_t sep = findDelimiter(data, length, 0, true);
+    if (sep == length)
+        return false;
+    envelope.context = {data, sep};
+    envelope.options = {data + sep + 2, length - sep - 2};
+    return true;
+}
+
+void parsePaymentEnvelope(const char *data, size_t length, PaymentEnvelope &envelope)
+{
+    envelope.json = {data, length};
+    envelope.context = {data + length, 0};
+    envelope.options = {data + length, 0};
+
+    // The first "--" after the JSON object ends it; the context may not contain an unescaped one
+    size_t sep = findDelimiter(data, length, jsonObjectEnd(data, length), false);
+    PaymentEnvelope tail;
+    if (sep < length && splitTail(data + sep + 2, length - sep - 2, tail))
+    {
+        envelope.json.length = sep;
+        envelope.context = tail.context;
+        envelope.options = tail.options;
+    }
+}
+
+void parsePriceEnvelope(const char *data, size_t length, PaymentEnvelope &envelope)
+{
+    envelope.json = {data, 0};
+    envelope.context = {data + length, 0};
+    envelope.options = {data + length, 0};
+    splitTail(data, length, envelope); // no separator: no context, no options
+}
+
+bool nextEnvelopeOption(const EnvelopeView &options, size_t &pos, EnvelopeView &item)
+{
+    if (options.length < 2 || options.data[0] != '[' || options.data[options.length - 1] != ']')
+        return false;
+    size_t end = options.length - 1;
+    if (pos == 0)
+        pos = 1;
+
+    while (pos < end)
+    {
+        size_t start = pos;
+        size_t stop = pos;
+        while (stop < end && options.data[stop] != ',')
+            stop += options.data[stop] == '\\' && stop + 1 < end ? 2 : 1;
+        pos = stop + 1;
+
+        while (start < stop && isspace((unsigned char)options.data[start]))
+            start++;
+        while (stop > start && isspace((unsigned char)options.data[stop - 1]))
+            stop--;
+        if (stop > start)
+        {
+            item = {options.data + start, stop - start};
+            return true;
+        }
+    }
+    return false;
+}
+
+void appendUnescaped(String &out, const EnvelopeView &view)
+{
+    const char *p = view.data;
+    const char *end = view.data + view.length;
+    while (p < end)
+    {
+        const char *slash = (const char *)memchr(p, '\\', end - p);
+        if (!slash)
+        {
+            out.concat(p, end - p);
+            return;
+        }
+        // Only \- \, and \\ are escapes; any other backslash is part of the text
+        bool escape = slash + 1 < end && (slash[1] == '-' || slash[1] == ',' || slash[1] == '\\');
+        out.concat(p, slash - p);
+        out.concat(escape ? slash + 1 : slash, 1);
+        p = escape ? slash + 2 : slash + 1;
+    }
+}
+
+ChunkStatus assembleSequencedChunk(const BleFrame &frame, bool declaredTotal, size_t maxLength,
+                                   PayloadBuffer &buffer, BleChunkAssembly &assembly)
+{
+    const char *data = (const char *)frame.payload;
+    size_t length = frame.length;
+
+    if (frame.flags & FrameStart)
+    {
+        uint16_t total = 0;
+        if (declaredTotal)
+        {
+            if (length < 2)
+                return ChunkLengthMismatch;
+            total = (uint16_t)(frame.payload[0] | (frame.payload[1] << 8));
+            data += 2;
+            length -= 2;
+        }
+        buffer.clear();
+        assembly.total = total;
+        assembly.nextSequence = frame.sequence;
+        // A declared total past the limit is refused before anything is allocated for it
+        assembly.active = total <= maxLength && (buffer.reserve(total ? total : maxLength) || !total);
+        if (!assembly.active)
+            return ChunkTooLarge; // known before the rest is even sent
+    }
+    else if (!assembly.active)
+    {
+        return ChunkNoStart;
+    }
+
+    if (frame.sequence != assembly.nextSequence)
+    {
+        // Up to half the sequence space behind: a resend of something already appended
+        uint8_t behind = (uint8_t)(assembly.nextSequence - frame.sequence);
+        return behind < 128 ? ChunkDuplicate : ChunkGap;
+    }
+
+    if (assembly.total && buffer.length() + length > assembly.total)
+    {
+        assembly.active = false;
+        buffer.clear();
+        return ChunkLengthMismatch;
+    }
+    if (buffer.length() + length > maxLength || !buffer.append(data, length))
+    {
+        assembly.active = false;
+        buffer.clear();
+        return ChunkTooLarge;
+    }
+    assembly.nextSequence++;
+
+    if (!(frame.flags & FrameEnd))
+        return ChunkPending;
+
+    assembly.active = false;
+    if (assembly.total && buffer.length() != assembly.total)
+    {
+        buffer.clear();
+        return ChunkLengthMismatch;
+    }
+    return ChunkComplete;
+}
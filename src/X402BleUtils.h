@@ -3,10 +3,15 @@
 
 #include <Arduino.h>
 #include "X402Aurdino.h"
+#include "PaymentArena.h"
+#include "BleFrame.h"
 
 // Case-insensitive string comparison utility
 bool startsWithIgnoreCase(const String &s, const char *prefix);
 
+// Case-insensitive ordering of two command keys (<0, 0, >0), for sorted command tables
+int compareCommandKey(const char *a, size_t aLength, const char *b, size_t bLength);
+
 // Payment chunk assembly - handles X-PAYMENT:START, X-PAYMENT, X-PAYMENT:END chunks
 // Returns true when assembly is complete (END received), false if still assembling
 bool assemblePaymentChunk(const String &chunk, String &paymentPayload);
@@ -15,4 +20,58 @@ bool assemblePaymentChunk(const String &chunk, String &paymentPayload);
 // Returns true when assembly is complete (END received), false if still assembling
 bool assemblePriceRequestChunk(const String &chunk, String &priceRequestPayload);
 
+// Same, appending the raw chunk into a session buffer (no String temporaries).
+// A chunk that does not fit a fixed buffer sets paymentPayload.overflowed().
+bool assemblePaymentChunk(const char *chunk, PayloadBuffer &paymentPayload);
+bool assemblePriceRequestChunk(const char *chunk, PayloadBuffer &priceRequestPayload);
+
+// View into an assembled request buffer (not NUL-terminated, not owned)
+struct EnvelopeView
+{
+    const char *data;
+    size_t length;
+};
+
+// Parts of an assembled "JSON--customContext--[opt1,opt2]" payment (or
+// "customContext--[opt1,opt2]" price request), found in one pass without copying.
+// "--" inside the JSON object is skipped by tracking its strings and braces. In the
+// context and options "\-", "\," and "\\" are escapes, so an escaped '-' or ','
+// never delimits; views keep the escapes, appendUnescaped() removes them. Any other
+// backslash is literal text.
+struct PaymentEnvelope
+{
+    EnvelopeView json;    // whole buffer when the separators are missing
+    EnvelopeView context;
+    EnvelopeView options; // "[...]" or empty
+};
+
+void parsePaymentEnvelope(const char *data, size_t length, PaymentEnvelope &envelope);
+void parsePriceEnvelope(const char *data, size_t length, PaymentEnvelope &envelope);
+
+// Next non-empty, whitespace-trimmed item of a "[a,b]" options view; pos starts at 0
+bool nextEnvelopeOption(const EnvelopeView &options, size_t &pos, EnvelopeView &item);
+
+// Append a context or option view to out with "\-", "\," and "\\" unescaped
+void appendUnescaped(String &out, const EnvelopeView &view);
+
+enum ChunkStatus
+{
+    ChunkPending,        // appended, more to come
+    ChunkComplete,       // END appended, length matches the declared total
+    ChunkDuplicate,      // retransmission of a chunk already appended - ignored
+    ChunkGap,            // a chunk was lost or reordered; retransmit from assembly.nextSequence
+    ChunkNoStart,        // continuation without a START
+    ChunkTooLarge,       // declared total or data does not fit the buffer
+    ChunkLengthMismatch  // more or less data than the START chunk declared
+};
+
+// Framed chunk assembly with sequence and length checks.
+// START resets the buffer and (declaredTotal) reads the 2-byte total in front of its data,
+// reserving the buffer for it up front; otherwise maxLength is reserved. A request
+// longer than maxLength (declared or appended) is refused with ChunkTooLarge.
+// Chunks must carry consecutive sequence numbers. Failures other than gaps and duplicates
+// drop the request, so a corrupt payload never reaches the facilitator.
+ChunkStatus assembleSequencedChunk(const BleFrame &frame, bool declaredTotal, size_t maxLength,
+                                   PayloadBuffer &buffer, BleChunkAssembly &assembly);
+
 #endif // X4PAY_BLE_UTILS_H
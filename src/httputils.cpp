@@ -1,4 +1,5 @@
 #include "httputils.h"
+#include "FacilitatorClient.h"
 #include "stackmonitor.h"
 #include <HTTPClient.h>
 #include <WiFi.h>
@@ -7,100 +8,32 @@ HttpResponse postJson(const String &url, const String &jsonPayload, const String
 {
     STACK_CHECKPOINT("postJson:start");
 
-    HTTPClient http;
-    HttpResponse response;
-
-    // Initialize response with minimal memory allocation
-    response.success = false;
-    response.statusCode = 0;
-    response.body = "";
-    response.body.reserve(512); // Pre-allocate expected response size
-
-    // Begin HTTP connection
-    if (!http.begin(url))
-    {
-        return response;
-    }
-
-    // Enable redirect following (important for 301/302/307/308 responses)
-    http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS);
-
-    // Set timeout to 60 seconds for blockchain operations (settle can take 30-45s)
-    http.setTimeout(60000);  // 60 seconds in milliseconds
-
-    // Default content type
-    http.addHeader("Content-Type", "application/json");
-
-    // Add custom headers if provided - Memory optimized
-    if (customHeaders.length() > 0)
-    {
-        int startIndex = 0;
-        int endIndex = customHeaders.indexOf('\n');
-
-        while (startIndex < customHeaders.length())
-        {
-            String headerLine;
-            headerLine.reserve(100); // Pre-allocate for header line
-
-            if (endIndex == -1)
-            {
-                headerLine = customHeaders.substring(startIndex);
-                startIndex = customHeaders.length();
-            }
-            else
-            {
-                headerLine = customHeaders.substring(startIndex, endIndex);
-                startIndex = endIndex + 1;
-                endIndex = customHeaders.indexOf('\n', startIndex);
-            }
-
-            // Parse individual header (format: "HeaderName: HeaderValue")
-            int colonIndex = headerLine.indexOf(':');
-            if (colonIndex > 0)
-            {
-                String headerName = headerLine.substring(0, colonIndex);
-                String headerValue = headerLine.substring(colonIndex + 1);
-                headerName.trim();
-                headerValue.trim();
-                http.addHeader(headerName, headerValue);
-
-                // Free memory immediately
-                headerName = "";
-                headerValue = "";
-            }
-            headerLine = ""; // Free memory
-        }
-    }
-
+    // Reuse the kept-alive facilitator connection instead of a fresh TCP + TLS handshake per call
+    HttpResponse response = FacilitatorClient::current().post(url, jsonPayload, customHeaders);
 
+    STACK_CHECKPOINT("postJson:end");
 
-    // Perform POST request
-    int httpResponseCode = http.POST(jsonPayload);
+    return response;
+}
 
-    STACK_CHECKPOINT("postJson:after_post");
+HttpResponse postJson(const char *url, SegmentedBodyStream &body, const String &customHeaders)
+{
+    STACK_CHECKPOINT("postJson(stream):start");
 
-    // Set response data
-    response.statusCode = httpResponseCode;
+    HttpResponse response = FacilitatorClient::current().post(url, body, customHeaders);
 
-    if (httpResponseCode > 0)
-    {
-        response.body = http.getString();
-        response.success = (httpResponseCode >= 200 && httpResponseCode < 300);
+    STACK_CHECKPOINT("postJson(stream):end");
 
-        
+    return response;
+}
 
-    }
-    else
-    {
-        // Handle HTTP errors (connection errors, negative codes)
-        response.success = false;
-        
-    }
+HttpResponse postJson(const char *url, SegmentedBodyStream &body, FacilitatorResponseParser &parser, const String &customHeaders)
+{
+    STACK_CHECKPOINT("postJson(parsed):start");
 
-    // Clean up HTTP client - This releases connection resources
-    http.end();
+    HttpResponse response = FacilitatorClient::current().post(url, body, parser, customHeaders);
 
-    STACK_CHECKPOINT("postJson:end");
+    STACK_CHECKPOINT("postJson(parsed):end");
 
     return response;
-}
\ No newline at end of file
+}
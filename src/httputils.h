@@ -2,6 +2,8 @@
 #define HTTPUTILS_H
 
 #include <Arduino.h>
+#include "SegmentedBodyStream.h"
+#include "FacilitatorResponseParser.h"
 
 struct HttpResponse {
     int statusCode;
@@ -12,4 +14,18 @@ struct HttpResponse {
 // Function to perform HTTP POST request with JSON payload
 HttpResponse postJson(const String &url, const String &jsonPayload, const String &customHeaders = "");
 
+// Same, but the body is streamed from existing buffers without being concatenated
+HttpResponse postJson(const char *url, SegmentedBodyStream &body, const String &customHeaders = "");
+inline HttpResponse postJson(const String &url, SegmentedBodyStream &body, const String &customHeaders = "")
+{
+    return postJson(url.c_str(), body, customHeaders);
+}
+
+// Stream the body out and parse the reply as it arrives; response.body is left empty
+HttpResponse postJson(const char *url, SegmentedBodyStream &body, FacilitatorResponseParser &parser, const String &customHeaders = "");
+inline HttpResponse postJson(const String &url, SegmentedBodyStream &body, FacilitatorResponseParser &parser, const String &customHeaders = "")
+{
+    return postJson(url.c_str(), body, parser, customHeaders);
+}
+
 #endif
\ No newline at end of file
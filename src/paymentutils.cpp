@@ -1,6 +1,7 @@
 #include "paymentutils.h"
 #include "X402Aurdino.h"
 #include "stackmonitor.h"
+#include <HTTPClient.h>
 
 // Helper function to escape JSON strings - Memory optimized
 String escapeJsonString(const String& str) {
@@ -82,6 +83,48 @@ String extractJsonValue(const String& json, const String& key) {
     }
 }
 
+bool findJsonValue(const char *json, size_t length, const char *key, const char **value, size_t *valueLength)
+{
+    size_t keyLength = strlen(key);
+    const char *end = json + length;
+
+    for (const char *p = json; p + keyLength + 3 <= end; ++p) {
+        // Match "key":
+        if (p[0] != '"' || memcmp(p + 1, key, keyLength) != 0 || p[keyLength + 1] != '"' || p[keyLength + 2] != ':') {
+            continue;
+        }
+        const char *v = p + keyLength + 3;
+        while (v < end && (*v == ' ' || *v == '\t')) {
+            v++;
+        }
+        if (v >= end) {
+            return false;
+        }
+
+        const char *valueEnd = v;
+        if (*v == '"') {
+            // String value - skip escaped characters
+            v++;
+            valueEnd = v;
+            while (valueEnd < end && *valueEnd != '"') {
+                valueEnd += (*valueEnd == '\\') ? 2 : 1;
+            }
+            if (valueEnd > end) {
+                valueEnd = end;
+            }
+        } else {
+            // Number / literal - up to the next delimiter
+            while (valueEnd < end && *valueEnd != ',' && *valueEnd != '}' && *valueEnd != ' ' && *valueEnd != ']') {
+                valueEnd++;
+            }
+        }
+        *value = v;
+        *valueLength = valueEnd - v;
+        return true;
+    }
+    return false;
+}
+
 // Parse a complete payment JSON string into PaymentPayload struct
 PaymentPayload parsePaymentString(const String& paymentJsonStr) {
 
@@ -146,11 +189,48 @@ String createPaymentRequestJson(const PaymentPayload &decodedSignedPayload, cons
     return json;
 }
 
-HttpResponse makePaymentApiCall(const String &endpoint, const PaymentPayload &decodedSignedPayload, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri)
+void buildPaymentRequestBody(const PaymentPayload &decodedSignedPayload, const String &paymentRequirements,
+                             SegmentedBodyStream &body, String &versionScratch)
+{
+    const String *version = &decodedSignedPayload.x402Version;
+    const String *payloadJson = &decodedSignedPayload.payloadJson;
+
+    // AUTO-FIX: same swapped-field detection as createPaymentRequestJson
+    if (decodedSignedPayload.payloadJson.length() == 0 && decodedSignedPayload.x402Version.length() > 10) {
+        payloadJson = &decodedSignedPayload.x402Version;
+        versionScratch = extractJsonValue(*payloadJson, "x402Version");
+        if (versionScratch.length() == 0) {
+            versionScratch = "1";
+        }
+        version = &versionScratch;
+    }
+
+    body.clear();
+    body.append("{\"x402Version\":");
+    body.append(*version);  // Add as unquoted number
+    body.append(",\"paymentPayload\":");
+    body.append(*payloadJson);
+    body.append(",\"paymentRequirements\":");
+    body.append(paymentRequirements);
+    body.append("}");
+}
+
+void buildPaymentRequestBody(const PaymentPayloadView &payload, const char *paymentRequirements, size_t requirementsLength,
+                             SegmentedBodyStream &body)
+{
+    body.clear();
+    body.append("{\"x402Version\":");
+    body.append(payload.x402Version, payload.versionLength);
+    body.append(",\"paymentPayload\":");
+    body.append(payload.json, payload.jsonLength);
+    body.append(",\"paymentRequirements\":");
+    body.append(paymentRequirements, requirementsLength);
+    body.append("}");
+}
+
+// Build URL without concatenation - Memory optimized
+String buildFacilitatorUrl(const String &facilitatorUri, const String &endpoint)
 {
-    STACK_CHECKPOINT("makePaymentApiCall:start");
-    
-    // Build URL without concatenation - Memory optimized
     String url;
     url.reserve(facilitatorUri.length() + endpoint.length() + 2);
     url = facilitatorUri;
@@ -158,22 +238,104 @@ HttpResponse makePaymentApiCall(const String &endpoint, const PaymentPayload &de
         url += '/';
     }
     url += endpoint;
+    return url;
+}
+
+size_t buildFacilitatorUrl(char *out, size_t capacity, const char *facilitatorUri, const char *endpoint)
+{
+    size_t uriLength = strlen(facilitatorUri);
+    size_t endpointLength = strlen(endpoint);
+    bool slash = uriLength == 0 || facilitatorUri[uriLength - 1] != '/';
+    size_t total = uriLength + (slash ? 1 : 0) + endpointLength;
+    if (!out || total + 1 > capacity)
+        return 0;
+    memcpy(out, facilitatorUri, uriLength);
+    if (slash)
+        out[uriLength] = '/';
+    memcpy(out + total - endpointLength, endpoint, endpointLength);
+    out[total] = '\0';
+    return total;
+}
+
+// Failed request for a facilitator URI too long for X4PAY_FACILITATOR_URL_BYTES
+static HttpResponse urlTooLong(const String &facilitatorUri)
+{
+    Serial.print("ERROR: Facilitator URL too long: ");
+    Serial.println(facilitatorUri);
+    HttpResponse response;
+    response.statusCode = HTTPC_ERROR_TOO_LESS_RAM;
+    response.success = false;
+    return response;
+}
+
+HttpResponse makePaymentApiCall(const String &endpoint, const PaymentPayload &decodedSignedPayload, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri)
+{
+    STACK_CHECKPOINT("makePaymentApiCall:start");
+    
+    char url[X4PAY_FACILITATOR_URL_BYTES];
+    if (buildFacilitatorUrl(url, sizeof(url), facilitatorUri.c_str(), endpoint.c_str()) == 0) {
+        return urlTooLong(facilitatorUri);
+    }
     
     STACK_CHECKPOINT("makePaymentApiCall:after_url");
     
-    // Create payload
-    String jsonPayload = createPaymentRequestJson(decodedSignedPayload, paymentRequirements);
+    // Describe the body as segments over the existing buffers - it is never concatenated
+    String versionScratch;
+    SegmentedBodyStream body;
+    buildPaymentRequestBody(decodedSignedPayload, paymentRequirements, body, versionScratch);
     
     STACK_CHECKPOINT("makePaymentApiCall:after_payload");
     
     // Make request and get response
-    HttpResponse response = postJson(url, jsonPayload, customHeaders);
-    
-    // Free temporary strings immediately
-    url = "";
-    jsonPayload = "";
+    HttpResponse response = postJson(url, body, customHeaders);
     
     STACK_CHECKPOINT("makePaymentApiCall:end");
     
     return response;
-}
\ No newline at end of file
+}
+
+HttpResponse makePaymentApiCall(const String &endpoint, const PaymentPayload &decodedSignedPayload, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri, FacilitatorResult &result)
+{
+    STACK_CHECKPOINT("makePaymentApiCall(parsed):start");
+    
+    char url[X4PAY_FACILITATOR_URL_BYTES];
+    if (buildFacilitatorUrl(url, sizeof(url), facilitatorUri.c_str(), endpoint.c_str()) == 0) {
+        result.clear();
+        return urlTooLong(facilitatorUri);
+    }
+    
+    String versionScratch;
+    SegmentedBodyStream body;
+    buildPaymentRequestBody(decodedSignedPayload, paymentRequirements, body, versionScratch);
+    
+    // Single pass over the reply stream - no body String, no repeated scans
+    FacilitatorResponseParser parser;
+    HttpResponse response = postJson(url, body, parser, customHeaders);
+    result = parser.result();
+    
+    STACK_CHECKPOINT("makePaymentApiCall(parsed):end");
+    
+    return response;
+}
+
+HttpResponse makePaymentApiCall(const String &endpoint, const PaymentPayloadView &payload, const char *paymentRequirements, size_t requirementsLength, const String &customHeaders, const String &facilitatorUri, FacilitatorResult &result)
+{
+    STACK_CHECKPOINT("makePaymentApiCall(view):start");
+    
+    char url[X4PAY_FACILITATOR_URL_BYTES];
+    if (buildFacilitatorUrl(url, sizeof(url), facilitatorUri.c_str(), endpoint.c_str()) == 0) {
+        result.clear();
+        return urlTooLong(facilitatorUri);
+    }
+    
+    SegmentedBodyStream body;
+    buildPaymentRequestBody(payload, paymentRequirements, requirementsLength, body);
+    
+    FacilitatorResponseParser parser;
+    HttpResponse response = postJson(url, body, parser, customHeaders);
+    result = parser.result();
+    
+    STACK_CHECKPOINT("makePaymentApiCall(view):end");
+    
+    return response;
+}
@@ -4,8 +4,14 @@
 #include <Arduino.h>
 #include "httputils.h"
 
-// Forward declaration
+// Facilitator endpoint URLs are built on the stack in buffers of this size
+#ifndef X4PAY_FACILITATOR_URL_BYTES
+#define X4PAY_FACILITATOR_URL_BYTES 160
+#endif
+
+// Forward declarations
 struct PaymentPayload;
+struct PaymentPayloadView;
 
 // Helper function to escape JSON strings
 String escapeJsonString(const String& str);
@@ -13,13 +19,37 @@ String escapeJsonString(const String& str);
 // Helper function to extract value from JSON string
 String extractJsonValue(const String& json, const String& key);
 
+// Zero-copy lookup: points value at the raw value (string contents without quotes) inside json
+bool findJsonValue(const char *json, size_t length, const char *key, const char **value, size_t *valueLength);
+
 // Helper function to parse payment JSON string into PaymentPayload struct
 PaymentPayload parsePaymentString(const String& paymentJsonStr);
 
 // Helper function to create payment request JSON payload
 String createPaymentRequestJson(const PaymentPayload &decodedSignedPayload, const String &paymentRequirements);
 
+// Describe the same payment request JSON as segments pointing into the existing buffers.
+// versionScratch holds the extracted version when the payload fields were swapped.
+void buildPaymentRequestBody(const PaymentPayload &decodedSignedPayload, const String &paymentRequirements,
+                             SegmentedBodyStream &body, String &versionScratch);
+
+// Body segments for a borrowed payload view and requirements buffer
+void buildPaymentRequestBody(const PaymentPayloadView &payload, const char *paymentRequirements, size_t requirementsLength,
+                             SegmentedBodyStream &body);
+
+// facilitatorUri + "/" + endpoint
+String buildFacilitatorUrl(const String &facilitatorUri, const String &endpoint);
+
+// Same URL written into caller storage; returns its length, 0 if it does not fit
+size_t buildFacilitatorUrl(char *out, size_t capacity, const char *facilitatorUri, const char *endpoint);
+
 // Helper function to make payment API call
 HttpResponse makePaymentApiCall(const String &endpoint, const PaymentPayload &decodedSignedPayload, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri);
 
+// Same, but the reply is parsed while it streams in; the fields land in result and response.body stays empty
+HttpResponse makePaymentApiCall(const String &endpoint, const PaymentPayload &decodedSignedPayload, const String &paymentRequirements, const String &customHeaders, const String &facilitatorUri, FacilitatorResult &result);
+
+// Same, for the zero-copy worker path
+HttpResponse makePaymentApiCall(const String &endpoint, const PaymentPayloadView &payload, const char *paymentRequirements, size_t requirementsLength, const String &customHeaders, const String &facilitatorUri, FacilitatorResult &result);
+
 #endif
\ No newline at end of file
@@ -2,13 +2,26 @@
 #include "ServerCallbacks.h"
 #include "RxCallbacks.h"
 #include "PaymentVerifyWorker.h"
+#include "PaymentJournal.h"
+#include "PaymentSession.h"
+#include "TxFragmenter.h"
 #include "X402Aurdino.h"
+#include "X402BleUtils.h"
 #include <algorithm>
+#include <utility>
 #include <cctype>
 
 const char *x4PayCore::SERVICE_UUID = "6e400002-b5a3-f393-e0a9-e50e24dcca9e";
 const char *x4PayCore::TX_CHAR_UUID = "6e400003-b5a3-f393-e0a9-e50e24dcca9e";
 const char *x4PayCore::RX_CHAR_UUID = "6e400004-b5a3-f393-e0a9-e50e24dcca9e";
+const char *x4PayCore::METADATA_CHAR_UUIDS[MetadataResponseCount] = {
+    "6e400005-b5a3-f393-e0a9-e50e24dcca9e", // info (price, payTo, network)
+    "6e400006-b5a3-f393-e0a9-e50e24dcca9e", // logo
+    "6e400007-b5a3-f393-e0a9-e50e24dcca9e", // banner
+    "6e400008-b5a3-f393-e0a9-e50e24dcca9e", // description
+    "6e400009-b5a3-f393-e0a9-e50e24dcca9e", // config
+    "6e40000a-b5a3-f393-e0a9-e50e24dcca9e", // options
+};
 
 // Memory-optimized constructor with move semantics where possible
 x4PayCore::x4PayCore(const String &device_name,
@@ -27,8 +40,6 @@ x4PayCore::x4PayCore(const String &device_name,
     // Reserve space for vectors to avoid reallocation
     options_.reserve(8); // Reserve space for typical number of options
 
-    // Initialize payment payload with reasonable capacity
-    paymentPayload_ = "";
     // Initialize last payment state
     lastPaid_ = false;
     lastTransactionhash_ = "";
@@ -38,26 +49,164 @@ x4PayCore::x4PayCore(const String &device_name,
     userSelectedOptions_.reserve(8);
     userCustomContext_ = "";
 
-    // Initialize price request payload and callback
-    priceRequestPayload_ = "";
+    // Initialize callbacks
     dynamicPriceCallback_ = nullptr;
     onPayCallback_ = nullptr;
 
-    // Build payment requirements once during construction
-    paymentRequirements = buildDefaultPaymentRementsJson(
+    // Build the payment requirements template once during construction
+    requirementsTemplate_.build(
         network_,    // network
         payTo_,      // payTo address
-        price_,      // amount (1 USDC)
         logo_,       // logo
         description_ // description
         // banner is not used in paymentRequirements, but available as member
     );
+    paymentRequirements = requirementsTemplate_.render(price_);
+
+    // Metadata replies are served from prebuilt Strings; setters rebuild them
+    metadataLock_ = xSemaphoreCreateMutex();
+    rebuildMetadata();
+}
+
+void x4PayCore::lockMetadata() const
+{
+    if (metadataLock_)
+        xSemaphoreTake(metadataLock_, portMAX_DELAY);
+}
+
+void x4PayCore::unlockMetadata() const
+{
+    if (metadataLock_)
+        xSemaphoreGive(metadataLock_);
+}
+
+String x4PayCore::buildPriceResponse(const String &price) const
+{
+    // Build JSON efficiently with pre-allocation
+    String reply;
+    reply.reserve(64 + price.length() + payTo_.length() + network_.length());
+    reply = "402://{\"price\": \"";
+    reply += price;
+    reply += "\", \"payTo\": \"";
+    reply += payTo_;
+    reply += "\", \"network\": \"";
+    reply += network_;
+    reply += "\"}";
+    return reply;
+}
+
+size_t x4PayCore::buildPriceResponse(char *out, size_t capacity, const String &price) const
+{
+    int written = snprintf(out, capacity, "402://{\"price\": \"%s\", \"payTo\": \"%s\", \"network\": \"%s\"}",
+                           price.c_str(), payTo_.c_str(), network_.c_str());
+    if (written < 0 || (size_t)written >= capacity)
+    {
+        if (capacity > 0)
+            out[0] = '\0';
+        return 0;
+    }
+    return (size_t)written;
+}
+
+// Serialize every metadata reply once; the BLE host task only sends them
+void x4PayCore::rebuildMetadata()
+{
+    String built[MetadataResponseCount];
+    built[MetadataInfo] = buildPriceResponse(price_);
+    built[MetadataLogo] = "LOGO://" + logo_;
+    built[MetadataBanner] = "BANNER://" + banner_;
+    built[MetadataDesc] = "DESC://" + description_;
+
+    built[MetadataConfig].reserve(64);
+    built[MetadataConfig] = "CONFIG://{\"frequency\": ";
+    built[MetadataConfig] += String(frequency_);
+    built[MetadataConfig] += ", \"allowCustomContent\": ";
+    built[MetadataConfig] += (allowCustomContent_ ? "true" : "false");
+    built[MetadataConfig] += "}";
+
+    // Comma-separated options
+    String &options = built[MetadataOptions];
+    size_t length = 10;
+    for (const auto &opt : options_)
+        length += opt.length() + 1;
+    options.reserve(length);
+    options = "OPTIONS://";
+    for (size_t i = 0; i < options_.size(); ++i)
+    {
+        options += options_[i];
+        if (i + 1 < options_.size())
+            options += ",";
+    }
+
+    // Swap under the lock so a reader never sees a half-built reply
+    lockMetadata();
+    for (size_t i = 0; i < MetadataResponseCount; ++i)
+        metadata_[i] = std::move(built[i]);
+    unlockMetadata();
+
+    publishMetadata();
+}
+
+// The characteristics hold the value after "XXX://". Centrals read them with Read / Read Blob
+// and the stack answers from the stored value, without any callback on our side.
+void x4PayCore::publishMetadata()
+{
+    lockMetadata();
+    for (size_t i = 0; i < MetadataResponseCount; ++i)
+    {
+        if (!pMetadataCharacteristics[i])
+            continue;
+        const String &reply = metadata_[i];
+        int prefix = reply.indexOf("://");
+        size_t offset = prefix >= 0 ? prefix + 3 : 0;
+        size_t length = reply.length() - offset;
+        // Past the ATT limit a read would return a cut-off data URI or JSON, so publish
+        // nothing and leave the value to the text command, which fragments it
+        if (length > BLE_ATT_ATTR_MAX_LEN)
+            length = 0;
+        pMetadataCharacteristics[i]->setValue((const uint8_t *)reply.c_str() + offset, length);
+    }
+    unlockMetadata();
+}
+
+// Resolve the price for a selection, consulting the memo cache before the user callback
+String x4PayCore::resolvePrice(const std::vector<String> &options, const String &customContext)
+{
+    if (dynamicPriceCallback_ == nullptr)
+        return price_; // Static price
+
+    uint64_t key = 0;
+    String price;
+    if (priceCache_.enabled())
+    {
+        key = PriceCache::keyFor(options, customContext);
+        if (priceCache_.lookup(key, price))
+            return price;
+    }
+
+    // [PRICE] on the BLE host task and verify workers both get here; the user callback runs on one at a time
+    PaymentVerifyWorker::lockCallbacks();
+    price = dynamicPriceCallback_(options, customContext);
+    PaymentVerifyWorker::unlockCallbacks();
+
+    if (priceCache_.enabled())
+        priceCache_.store(key, price);
+    return price;
+}
+
+// Splice a price into the prebuilt requirements instead of rebuilding them
+String x4PayCore::buildPaymentRequirements(const String &price) const
+{
+    if (price == price_)
+        return paymentRequirements;
+    return requirementsTemplate_.render(price);
 }
 
 // Set recurring frequency (0 clears/means unset)
 void x4PayCore::enableRecuring(uint32_t frequency)
 {
     frequency_ = frequency;
+    rebuildMetadata();
 }
 
 // Memory-optimized options management
@@ -72,12 +221,14 @@ void x4PayCore::enableOptions(const String options[], size_t count)
             options_.push_back(options[i]);
         }
     }
+    rebuildMetadata();
 }
 
 // Allow custom content
 void x4PayCore::allowCustomised()
 {
     allowCustomContent_ = true;
+    rebuildMetadata();
 }
 
 void x4PayCore::begin()
@@ -88,11 +239,29 @@ void x4PayCore::begin()
     NimBLEDevice::setDeviceName(device_name_.c_str());
     NimBLEDevice::setPower(ESP_PWR_LVL_P7);
     NimBLEDevice::setSecurityAuth(false, false, false);
-    NimBLEDevice::setMTU(150);
+    // Largest MTU the central will take, then DLE / 2M PHY per connection (BleLinkTable::open)
+    NimBLEDevice::setMTU(X4PAY_BLE_MTU);
+#if X4PAY_BLE_2M_PHY
+    NimBLEDevice::setDefaultPhy(BLE_GAP_LE_PHY_1M_MASK | BLE_GAP_LE_PHY_2M_MASK,
+                                BLE_GAP_LE_PHY_1M_MASK | BLE_GAP_LE_PHY_2M_MASK);
+#endif
+
+    // Per-connection payment sessions (payload assembly, selections, response routing)
+    PaymentSessionTable::begin();
+    BleLinkTable::begin();
+
+    // Paces replies longer than one notification out in MTU-sized fragments (next to the host task)
+    TxFragmenter::begin(/*prio=*/2, /*core=*/0);
 
     // Start payment verification worker with large stack on core 1
     PaymentVerifyWorker::begin(/*stackBytes=*/8192, /*prio=*/3, /*core=*/1);
 
+    // Settle verified payments left in flash by the last run (and batches from now on)
+    SettlementBatch::begin(/*prio=*/2, /*core=*/1);
+
+    // Resume payments the journal shows were cut off by a reset (needs SettlementBatch)
+    PaymentJournal::begin(this);
+
     pServer = NimBLEDevice::createServer();
     pServer->setCallbacks(new ServerCallbacks());
 
@@ -119,6 +288,12 @@ void x4PayCore::begin()
     // Pass TX characteristic and X402Ble instance so RxCallbacks can send notifications and access config
     pRxCharacteristic->setCallbacks(new RxCallbacks(pTxCharacteristic, this));
 
+    // Metadata (read-only, long reads): centrals can fetch these in parallel without RX/TX round trips
+    for (size_t i = 0; i < MetadataResponseCount; ++i)
+        pMetadataCharacteristics[i] = pService->createCharacteristic(METADATA_CHAR_UUIDS[i], NIMBLE_PROPERTY::READ,
+                                                                     BLE_ATT_ATTR_MAX_LEN);
+    publishMetadata();
+
     if (!pService)
     {
 
@@ -136,13 +311,15 @@ void x4PayCore::begin()
 x4PayCore::~x4PayCore()
 {
     cleanup();
+    if (metadataLock_)
+        vSemaphoreDelete(metadataLock_);
 }
 
 // Manual cleanup method for proper garbage collection
 void x4PayCore::cleanup()
 {
-    // Clear payment payload to free memory
-    paymentPayload_ = "";
+    // Drop any partially assembled payments
+    PaymentSessionTable::releaseAll();
 
     // Clear options vector and free memory
     options_.clear();
@@ -156,10 +333,13 @@ void x4PayCore::cleanup()
     userSelectedOptions_.shrink_to_fit();
     userCustomContext_ = "";
 
-    // Clear price request payload and callback
-    priceRequestPayload_ = "";
+    // Clear callbacks and memoized prices
+    priceCache_.clear();
     dynamicPriceCallback_ = nullptr;
     onPayCallback_ = nullptr;
+    onVerifiedCallback_ = nullptr;
+    onRollbackCallback_ = nullptr;
+    SettlementBatch::setOnSettled(nullptr);
 
     // Stop BLE advertising if active
     if (pAdvertising)
@@ -179,6 +359,11 @@ void x4PayCore::cleanup()
         pTxCharacteristic = nullptr;
     }
 
+    lockMetadata();
+    for (size_t i = 0; i < MetadataResponseCount; ++i)
+        pMetadataCharacteristics[i] = nullptr;
+    unlockMetadata();
+
     if (pService)
     {
         pService = nullptr;
@@ -201,6 +386,78 @@ void x4PayCore::printMemoryUsage() const
     }
 }
 
+size_t x4PayCore::getPaymentPayloadSize() const
+{
+    return PaymentSessionTable::bufferedBytes();
+}
+
+bool x4PayCore::registerCommand(const char *prefix, CommandHandler handler)
+{
+    size_t length = prefix ? strlen(prefix) : 0;
+    if (!handler || length < 3 || length > X4PAY_COMMAND_PREFIX_BYTES || prefix[0] != '[' ||
+        prefix[length - 1] != ']' || memchr(prefix, ']', length - 1))
+        return false;
+    if (RxCallbacks::isBuiltinCommand(prefix, length))
+        return false;
+
+    // Insert in order; an existing registration of the same prefix is replaced
+    size_t at = 0;
+    while (at < commandCount_ && compareCommandKey(commands_[at].prefix, commands_[at].length, prefix, length) < 0)
+        ++at;
+    if (at < commandCount_ && compareCommandKey(commands_[at].prefix, commands_[at].length, prefix, length) == 0)
+    {
+        commands_[at].handler = handler;
+        return true;
+    }
+    if (commandCount_ == X4PAY_MAX_APP_COMMANDS)
+        return false;
+    for (size_t i = commandCount_; i > at; --i)
+        commands_[i] = commands_[i - 1];
+    memcpy(commands_[at].prefix, prefix, length + 1);
+    commands_[at].length = length;
+    commands_[at].handler = handler;
+    commandCount_++;
+    return true;
+}
+
+CommandHandler x4PayCore::findCommand(const char *key, size_t length) const
+{
+    size_t lo = 0;
+    size_t hi = commandCount_;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        int cmp = compareCommandKey(key, length, commands_[mid].prefix, commands_[mid].length);
+        if (cmp == 0)
+            return commands_[mid].handler;
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return nullptr;
+}
+
+bool x4PayCore::getLinkInfo(uint16_t connHandle, BleLinkInfo &info) const
+{
+    return BleLinkTable::get(connHandle, info);
+}
+
+size_t x4PayCore::getLinks(BleLinkInfo *out, size_t max) const
+{
+    return BleLinkTable::list(out, max);
+}
+
+TxFragmenterStats x4PayCore::getTxFragmenterStats() const
+{
+    return TxFragmenter::getStats();
+}
+
+size_t x4PayCore::getActiveSessionCount() const
+{
+    return PaymentSessionTable::activeCount();
+}
+
 // Set user selected options from C-style array
 void x4PayCore::setUserSelectedOptions(const String options[], size_t count)
 {
@@ -262,6 +519,18 @@ void x4PayCore::setLastPaymentState(bool paid, const String &txHash, const Strin
     }
 }
 
+void x4PayCore::setLastPaymentState(bool paid, const char *txHash, const char *payer)
+{
+    // Assigning a C string reuses the existing String buffers once they are large enough
+    lastPaid_ = paid;
+    lastTransactionhash_ = txHash;
+    lastPayer_ = payer;
+    if (paid)
+    {
+        lastPaymentTimestamp_ = micros();
+    }
+}
+
 // Returns microseconds elapsed since last successful payment
 unsigned long x4PayCore::getMicrosSinceLastPayment() const
 {
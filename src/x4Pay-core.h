@@ -6,6 +6,11 @@
 #include <vector>
 
 #include "X402Aurdino.h"
+#include "PriceCache.h"
+#include "PaymentReplayCache.h"
+#include "SettlementBatch.h"
+#include "BleLink.h"
+#include "TxFragmenter.h"
 
 // Forward declaration to avoid circular include
 class PaymentVerifyWorker;
@@ -19,6 +24,38 @@ typedef String (*DynamicPriceCallback)(const std::vector<String>& options, const
 // Receives selected options and custom context from the user
 typedef void (*OnPayCallback)(const std::vector<String>& options, const String& customContext);
 
+// OnRollback callback typedef
+// Called in early-acknowledge mode when a payment that was already verified fails to settle
+// reason is the facilitator errorReason (or a local reason such as "request_failed")
+typedef void (*OnRollbackCallback)(const std::vector<String>& options, const String& customContext, const char* reason);
+
+// Metadata replies kept prebuilt by x4PayCore (see getMetadataResponse)
+enum MetadataResponse : uint8_t
+{
+    MetadataInfo,    // 402://{"price": ..., "payTo": ..., "network": ...} at the static price
+    MetadataLogo,    // LOGO://...
+    MetadataBanner,  // BANNER://...
+    MetadataDesc,    // DESC://...
+    MetadataConfig,  // CONFIG://{"frequency": ..., "allowCustomContent": ...}
+    MetadataOptions, // OPTIONS://opt1,opt2
+    MetadataResponseCount
+};
+
+// Application command handler typedef
+// Called on the BLE host task for a write that starts with the registered "[NAME]" prefix.
+// args is the rest of the write after the prefix; the returned String is sent back on TX.
+typedef String (*CommandHandler)(const char* args, uint16_t connHandle);
+
+// Application commands that can be registered
+#ifndef X4PAY_MAX_APP_COMMANDS
+#define X4PAY_MAX_APP_COMMANDS 8
+#endif
+
+// Longest "[NAME]" command prefix, brackets included
+#ifndef X4PAY_COMMAND_PREFIX_BYTES
+#define X4PAY_COMMAND_PREFIX_BYTES 24
+#endif
+
 class x4PayCore
 {
 public:
@@ -39,9 +76,19 @@ public:
     
     // Memory monitoring functions
     void printMemoryUsage() const;
-    size_t getPaymentPayloadSize() const { return paymentPayload_.length(); }
+    size_t getPaymentPayloadSize() const; // bytes buffered across all payment sessions
+    size_t getActiveSessionCount() const; // centrals currently holding a payment session
+    bool getLinkInfo(uint16_t connHandle, BleLinkInfo &info) const; // negotiated MTU / PHY of one central
+    size_t getLinks(BleLinkInfo *out, size_t max) const;            // every connected central, returns the count
+    TxFragmenterStats getTxFragmenterStats() const;                  // replies split to fit the MTU, congestion back-offs
 
-    String paymentRequirements;
+    String paymentRequirements; // requirements at the static price
+
+    // Requirements JSON for a (dynamic) price, spliced from the prebuilt template
+    String buildPaymentRequirements(const String &price) const;
+    // Same JSON rendered into caller storage (e.g. a session arena); 0 if it does not fit
+    size_t renderPaymentRequirements(char *out, size_t capacity, const char *price) const { return requirementsTemplate_.renderInto(out, capacity, price); }
+    size_t paymentRequirementsLength(const char *price) const { return requirementsTemplate_.renderedLength(price); }
 
     // Public getters for RxCallbacks
     String getPrice() const { return price_; }
@@ -50,7 +97,7 @@ public:
     String getLogo() const { return logo_; }
     String getDescription() const { return description_; }
     String getBanner() const { return banner_; }
-    String getFacilitator() const { return facilitator_; }
+    const String &getFacilitator() const { return facilitator_; }
 
     // Last payment state getters
     bool getLastPaid() const { return lastPaid_; }
@@ -73,7 +120,6 @@ public:
     uint32_t getFrequency() const { return frequency_; }
     const std::vector<String> &getOptions() const { return options_; }
     bool isCustomContentAllowed() const { return allowCustomContent_; }
-    String getPaymentPayload() const { return paymentPayload_; }
 
     // User-provided selection/context
     const std::vector<String>& getUserSelectedOptions() const { return userSelectedOptions_; }
@@ -84,33 +130,82 @@ public:
     void setUserCustomContext(const String &ctx) { userCustomContext_ = ctx; }
     void clearUserCustomContext() { userCustomContext_ = ""; }
 
-    // Payment payload assembly (used by RxCallbacks)
-    void setPaymentPayload(const String &payload) { paymentPayload_ = payload; }
-    void clearPaymentPayload() { paymentPayload_ = ""; }
-
-    // Price request payload assembly (for [PRICE] chunks)
-    void setPriceRequestPayload(const String &payload) { priceRequestPayload_ = payload; }
-    String getPriceRequestPayload() const { return priceRequestPayload_; }
-    void clearPriceRequestPayload() { priceRequestPayload_ = ""; }
-
     // Dynamic price callback
-    void setDynamicPriceCallback(DynamicPriceCallback callback) { dynamicPriceCallback_ = callback; }
+    void setDynamicPriceCallback(DynamicPriceCallback callback) { dynamicPriceCallback_ = callback; priceCache_.clear(); }
     DynamicPriceCallback getDynamicPriceCallback() const { return dynamicPriceCallback_; }
 
+    // Opt-in memoization of DynamicPriceCallback results (capacity 0 disables).
+    // The price quoted for [PRICE] is reused at verification time while it is younger than ttlMs.
+    void enablePriceCache(size_t capacity = 8, uint32_t ttlMs = 120000) { priceCache_.configure(capacity, ttlMs); }
+    PriceCacheStats getPriceCacheStats() const { return priceCache_.getStats(); }
+
+    // Opt-in cache of recently paid payloads (capacity 0 disables). A resubmitted X-PAYMENT is
+    // answered with the earlier result, or PAYMENT:VERIFYING while it is still in flight,
+    // without another facilitator round trip. persist keeps paid entries across reboots (NVS).
+    void enableReplayCache(size_t capacity = 16, uint32_t ttlMs = 600000, bool persist = false) { replayCache_.configure(capacity, ttlMs, persist); }
+    PaymentReplayStats getReplayCacheStats() const { return replayCache_.getStats(); }
+    PaymentReplayCache &getReplayCache() { return replayCache_; }
+
+    // Prebuilt metadata reply, rebuilt by the setters that change it. Read it between
+    // lockMetadata() and unlockMetadata() - a setter on another task may be replacing it.
+    const String &getMetadataResponse(MetadataResponse which) const { return metadata_[which]; }
+    void lockMetadata() const;
+    void unlockMetadata() const;
+
+    // 402://{"price": ..., "payTo": ..., "network": ...} for a quoted price
+    String buildPriceResponse(const String &price) const;
+    // Same reply written into caller storage; returns its length, 0 if it does not fit
+    size_t buildPriceResponse(char *out, size_t capacity, const String &price) const;
+
+    // Price for these selections: static price, cached quote, or a fresh callback result.
+    // The callback runs under PaymentVerifyWorker::lockCallbacks(); callers must not hold it.
+    String resolvePrice(const std::vector<String> &options, const String &customContext);
+
     // OnPay callback - called when payment succeeds
     void setOnPay(OnPayCallback callback) { onPayCallback_ = callback; }
     OnPayCallback getOnPayCallback() const { return onPayCallback_; }
 
+    // Early acknowledgement: notify PAYMENT:VERIFIED as soon as /verify passes, then settle and
+    // send PAYMENT:SETTLED TX:<hash> or PAYMENT:ROLLBACK REASON:<reason>. Off by default.
+    void enableEarlyAcknowledge(bool enabled = true) { earlyAcknowledge_ = enabled; }
+    bool isEarlyAcknowledgeEnabled() const { return earlyAcknowledge_; }
+
+    // Provisional callback fired right after verification in early-acknowledge mode;
+    // onPay still fires once settlement succeeds, onRollback if it fails
+    void setOnVerified(OnPayCallback callback) { onVerifiedCallback_ = callback; }
+    OnPayCallback getOnVerifiedCallback() const { return onVerifiedCallback_; }
+    void setOnRollback(OnRollbackCallback callback) { onRollbackCallback_ = callback; }
+    OnRollbackCallback getOnRollbackCallback() const { return onRollbackCallback_; }
+
+    // Batch settlement: verified payments are persisted and settled batchSize at a time, or
+    // intervalMs after the oldest arrived. The central gets PAYMENT:COMPLETE VERIFIED:true
+    // (PAYMENT:QUEUED in early-acknowledge mode) once the payment is safely stored.
+    // facilitatorBatch sends each batch as one POST to <facilitator>/settle/batch.
+    void enableBatchSettlement(size_t batchSize = 8, uint32_t intervalMs = 60000, bool facilitatorBatch = false) { SettlementBatch::configure(batchSize, intervalMs, facilitatorBatch); }
+    void setOnBatchSettled(OnBatchSettledCallback callback) { SettlementBatch::setOnSettled(callback); }
+    void flushSettlements() { SettlementBatch::flush(); }
+    size_t getPendingSettlementCount() const { return SettlementBatch::pending(); }
+    SettlementBatchStats getSettlementBatchStats() const { return SettlementBatch::getStats(); }
+
+    // Application query commands, e.g. registerCommand("[STOCK]", onStock). The prefix must be
+    // "[NAME]" and not one of the built-in commands. Register before begin().
+    bool registerCommand(const char *prefix, CommandHandler handler);
+    CommandHandler findCommand(const char *key, size_t length) const;
+
     // BLE UUIDs
     static const char *SERVICE_UUID;
     static const char *TX_CHAR_UUID;
     static const char *RX_CHAR_UUID;
+    // Read-only metadata characteristics, indexed by MetadataResponse (value without the "XXX://" prefix).
+    // A value longer than BLE_ATT_ATTR_MAX_LEN (512) is published empty; centrals use the text command.
+    static const char *METADATA_CHAR_UUIDS[MetadataResponseCount];
 
     // Access the active instance (used by worker thread)
     static x4PayCore* getActiveInstance();
 
     // Update last payment state atomically
     void setLastPaymentState(bool paid, const String &txHash, const String &payer);
+    void setLastPaymentState(bool paid, const char *txHash, const char *payer); // assigns in place, no temporaries
 
 private:
     String device_name_;
@@ -122,6 +217,9 @@ private:
     String banner_;
     String facilitator_;
 
+    // Requirements JSON split around the price slot, built once in the constructor
+    PaymentRequirementsTemplate requirementsTemplate_;
+
     // Last payment state
     bool lastPaid_ = false;
     String lastTransactionhash_ = "";
@@ -132,25 +230,49 @@ private:
     uint32_t frequency_;                 // 0 = not set
     std::vector<String> options_;        // empty by default
     bool allowCustomContent_;            // false by default
-    String paymentPayload_;              // assembled from chunks
 
     // User-provided selection/context from client
     std::vector<String> userSelectedOptions_;
     String userCustomContext_;
 
-    // Price request payload (for [PRICE] chunks)
-    String priceRequestPayload_;
-    
     // Dynamic price callback function
     DynamicPriceCallback dynamicPriceCallback_;
     
     // OnPay callback function (called on successful payment)
     OnPayCallback onPayCallback_;
 
+    // Early-acknowledge mode and its callbacks
+    bool earlyAcknowledge_ = false;
+    OnPayCallback onVerifiedCallback_ = nullptr;
+    OnRollbackCallback onRollbackCallback_ = nullptr;
+
+    // Memoized dynamic prices (disabled until enablePriceCache)
+    PriceCache priceCache_;
+
+    // Results of recently paid payloads (disabled until enableReplayCache)
+    PaymentReplayCache replayCache_;
+
+    // Metadata replies serialized once, rebuilt on change (guarded by metadataLock_)
+    String metadata_[MetadataResponseCount];
+    SemaphoreHandle_t metadataLock_ = nullptr;
+    void rebuildMetadata();
+    void publishMetadata(); // copy the replies into the read-only characteristics
+
+    // Registered application commands, sorted by prefix for binary search
+    struct AppCommand
+    {
+        char prefix[X4PAY_COMMAND_PREFIX_BYTES + 1];
+        size_t length;
+        CommandHandler handler;
+    };
+    AppCommand commands_[X4PAY_MAX_APP_COMMANDS];
+    size_t commandCount_ = 0;
+
     NimBLEServer *pServer;
     NimBLEService *pService;
     NimBLECharacteristic *pTxCharacteristic;
     NimBLECharacteristic *pRxCharacteristic;
+    NimBLECharacteristic *pMetadataCharacteristics[MetadataResponseCount] = {};
 
     // Track the active instance for worker callbacks
     static x4PayCore* s_active;
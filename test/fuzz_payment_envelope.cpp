@@ -0,0 +1,175 @@
+// Envelope parsing fuzz: parsePaymentEnvelope / parsePriceEnvelope / nextEnvelopeOption /
+// appendUnescaped on random buffers (run under ASan/UBSan), plus an escape round trip
+#include "X402BleUtils.h"
+#include "host_test.h"
+#include <string>
+#include <vector>
+
+static const int kRandomIterations = 200000;
+static const int kRoundTripIterations = 50000;
+
+// xorshift64*, fixed seed so a failure reproduces
+static uint64_t rngState = 0x2545F4914F6CDD1Dull;
+
+static uint32_t rnd(uint32_t n)
+{
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return (uint32_t)((rngState * 0x2545F4914F6CDD1Dull) >> 33) % n;
+}
+
+static std::string randomText(size_t length, const char *alphabet)
+{
+    std::string s;
+    size_t size = strlen(alphabet);
+    for (size_t i = 0; i < length; ++i)
+        s += alphabet[rnd(size)];
+    return s;
+}
+
+// Escape as a central does: backslash and each of special get a backslash in front
+static std::string escape(const std::string &s, const char *special)
+{
+    std::string out;
+    for (char c : s)
+    {
+        if (c == '\\' || strchr(special, c))
+            out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+static std::string unescaped(const EnvelopeView &view)
+{
+    String out;
+    appendUnescaped(out, view);
+    return out.c_str();
+}
+
+static std::string str(const EnvelopeView &view)
+{
+    return std::string(view.data, view.length);
+}
+
+// Every option is non-empty, lies inside the parsed buffer, and the walk ends
+static void walkOptions(const EnvelopeView &options, const char *data, size_t length)
+{
+    size_t pos = 0;
+    size_t count = 0;
+    EnvelopeView item;
+    while (nextEnvelopeOption(options, pos, item))
+    {
+        CHECK(item.data >= data && item.data + item.length <= data + length);
+        CHECK(item.length > 0);
+        unescaped(item);
+        if (++count > length)
+        {
+            CHECK(!"nextEnvelopeOption does not advance");
+            return;
+        }
+    }
+}
+
+static void testRandomBuffers()
+{
+    const char *alphabet = "ab-\\,[]{}\" -x";
+    for (int it = 0; it < kRandomIterations; ++it)
+    {
+        // Exact-size heap copy so ASan sees any read past the end
+        std::string text = randomText(rnd(40), alphabet);
+        char *data = new char[text.size()];
+        memcpy(data, text.data(), text.size());
+        size_t length = text.size();
+
+        PaymentEnvelope envelope;
+        parsePaymentEnvelope(data, length, envelope);
+        CHECK(envelope.json.data == data && envelope.json.length <= length);
+        CHECK(envelope.context.data >= data && envelope.context.data + envelope.context.length <= data + length);
+        CHECK(envelope.options.data >= data && envelope.options.data + envelope.options.length <= data + length);
+        unescaped(envelope.context);
+        walkOptions(envelope.options, data, length);
+
+        parsePriceEnvelope(data, length, envelope);
+        CHECK_EQ(envelope.json.length, 0u);
+        unescaped(envelope.context);
+        walkOptions(envelope.options, data, length);
+        delete[] data;
+    }
+}
+
+static void testRoundTrip()
+{
+    for (int it = 0; it < kRoundTripIterations; ++it)
+    {
+        // "--" inside the JSON object must not split it
+        std::string json = "{\"a\":\"" + escape(randomText(rnd(10), "ab-{}"), "\"") + "\",\"b\":{\"c\":\"--\"}}";
+        std::string context = randomText(rnd(10), "ab-\\,x");
+        std::vector<std::string> options;
+        size_t count = rnd(4);
+        for (size_t i = 0; i < count; ++i)
+            options.push_back(randomText(1 + rnd(5), "ab-,\\]"));
+
+        std::string list = "[";
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i)
+                list += ',';
+            list += escape(options[i], ",-");
+        }
+        list += ']';
+
+        std::string tail = escape(context, "-") + "--" + list;
+        std::string payment = json + "--" + tail;
+
+        PaymentEnvelope envelope;
+        parsePaymentEnvelope(payment.data(), payment.size(), envelope);
+        CHECK(str(envelope.json) == json);
+        CHECK(unescaped(envelope.context) == context);
+        walkOptions(envelope.options, payment.data(), payment.size());
+
+        size_t pos = 0;
+        size_t i = 0;
+        EnvelopeView item;
+        while (nextEnvelopeOption(envelope.options, pos, item))
+        {
+            CHECK(i < count && unescaped(item) == options[i]);
+            ++i;
+        }
+        CHECK_EQ(i, count);
+
+        // Same tail as a [PRICE] request
+        parsePriceEnvelope(tail.data(), tail.size(), envelope);
+        CHECK(unescaped(envelope.context) == context);
+        CHECK(str(envelope.options) == list);
+    }
+}
+
+static void testUnescape()
+{
+    const char text[] = "a\\-b\\,c\\\\d\\ne C:\\x\\";
+    EnvelopeView view = {text, sizeof(text) - 1};
+    // Only \- \, \\ are escapes; other backslashes (and a trailing one) are kept
+    CHECK(unescaped(view) == "a-b,c\\d\\ne C:\\x\\");
+
+    std::string payment = "{\"p\":1}--C:\\path\\to--[x\\,y,z]";
+    PaymentEnvelope envelope;
+    parsePaymentEnvelope(payment.data(), payment.size(), envelope);
+    CHECK(unescaped(envelope.context) == "C:\\path\\to");
+    size_t pos = 0;
+    EnvelopeView item;
+    CHECK(nextEnvelopeOption(envelope.options, pos, item));
+    CHECK(unescaped(item) == "x,y");
+    CHECK(nextEnvelopeOption(envelope.options, pos, item));
+    CHECK(unescaped(item) == "z");
+    CHECK(!nextEnvelopeOption(envelope.options, pos, item));
+}
+
+int main()
+{
+    testUnescape();
+    testRoundTrip();
+    testRandomBuffers();
+    return HOST_TEST_RESULT();
+}
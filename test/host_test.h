@@ -0,0 +1,29 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <string.h>
+
+// Minimal checks for the host tests: failures are counted and main() returns HOST_TEST_RESULT()
+extern int hostTestFailures;
+
+#define CHECK(cond)                                                                        \
+    do                                                                                     \
+    {                                                                                      \
+        if (!(cond))                                                                       \
+        {                                                                                  \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);      \
+            hostTestFailures++;                                                            \
+        }                                                                                  \
+    } while (0)
+
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+#define CHECK_STR(a, b) CHECK(strcmp((a), (b)) == 0)
+
+#define HOST_TEST_RESULT() (hostTestFailures == 0 ? 0 : (fprintf(stderr, "%d check(s) failed\n", hostTestFailures), 1))
+
+// millis() on the host is a fake clock the tests move by hand
+void hostSetMillis(unsigned long ms);
+void hostAdvanceMillis(unsigned long ms);
+
+#endif // HOST_TEST_H
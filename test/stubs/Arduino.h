@@ -0,0 +1,111 @@
+#pragma once
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cctype>
+#include <new>
+#include <utility>
+#include "freertos/FreeRTOS.h"
+typedef uint8_t byte;
+class String {
+public:
+  std::string s;
+  String() {}
+  String(const char* c) : s(c ? c : "") {}
+  String(const char* c, unsigned int n) : s(c, n) {}
+  String(const String&) = default; String(String&&) = default;
+  String& operator=(const String&) = default; String& operator=(String&&) = default;
+  String& operator=(const char* c) { s = c ? c : ""; return *this; }
+  String(char c) : s(1, c) {}
+  explicit String(int v) : s(std::to_string(v)) {}
+  explicit String(unsigned int v) : s(std::to_string(v)) {}
+  explicit String(long v) : s(std::to_string(v)) {}
+  explicit String(unsigned long v) : s(std::to_string(v)) {}
+  explicit String(unsigned long long v) : s(std::to_string(v)) {}
+  explicit String(float v, unsigned char d = 2) : s(std::to_string(v)) {}
+  explicit String(double v, unsigned char d = 2) : s(std::to_string(v)) {}
+  unsigned int length() const { return s.size(); }
+  const char* c_str() const { return s.c_str(); }
+  bool reserve(unsigned int n) { s.reserve(n); return true; }
+  String& operator+=(const String& o) { s += o.s; return *this; }
+  String& operator+=(const char* o) { s += o; return *this; }
+  String& operator+=(char c) { s += c; return *this; }
+  String& operator+=(int v) { s += std::to_string(v); return *this; }
+  String& operator+=(unsigned int v) { s += std::to_string(v); return *this; }
+  String& operator+=(unsigned long v) { s += std::to_string(v); return *this; }
+  String& operator+=(long v) { s += std::to_string(v); return *this; }
+  bool concat(const char* c, unsigned int n) { s.append(c, n); return true; }
+  bool concat(const String& o) { s += o.s; return true; }
+  bool concat(const char* c) { s += c; return true; }
+  bool concat(char c) { s += c; return true; }
+  String substring(unsigned int a) const { return String(s.substr(a).c_str()); }
+  String substring(unsigned int a, unsigned int b) const { return String(s.substr(a, b - a).c_str()); }
+  int indexOf(char c, unsigned int from = 0) const { auto p = s.find(c, from); return p == std::string::npos ? -1 : (int)p; }
+  int indexOf(const String& c, unsigned int from = 0) const { auto p = s.find(c.s, from); return p == std::string::npos ? -1 : (int)p; }
+  int indexOf(const char* c, unsigned int from = 0) const { auto p = s.find(c, from); return p == std::string::npos ? -1 : (int)p; }
+  bool endsWith(const String& o) const { return s.size() >= o.s.size() && s.compare(s.size()-o.s.size(), o.s.size(), o.s) == 0; }
+  bool startsWith(const String& o) const { return s.compare(0, o.s.size(), o.s) == 0; }
+  char charAt(unsigned int i) const { return s[i]; }
+  char operator[](unsigned int i) const { return s[i]; }
+  char& operator[](unsigned int i) { return s[i]; }
+  void trim() { size_t a = s.find_first_not_of(" \t\r\n"); if (a == std::string::npos) { s.clear(); return; } s = s.substr(a, s.find_last_not_of(" \t\r\n") - a + 1); }
+  void toLowerCase() {}
+  long toInt() const { return atol(s.c_str()); }
+  bool equals(const String& o) const { return s == o.s; }
+  bool equalsIgnoreCase(const String& o) const { return s == o.s; }
+  bool operator==(const String& o) const { return s == o.s; }
+  bool operator==(const char* o) const { return s == o; }
+  bool operator!=(const String& o) const { return s != o.s; }
+  bool operator!=(const char* o) const { return s != o; }
+  bool operator<(const String& o) const { return s < o.s; }
+  void remove(unsigned int i) { s.erase(i); }
+  void remove(unsigned int i, unsigned int n) { s.erase(i, n); }
+  bool isEmpty() const { return s.empty(); }
+  void getBytes(unsigned char* b, unsigned int n, unsigned int idx=0) const {}
+  explicit operator bool() const { return true; }
+};
+inline String operator+(const String& a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, const char* b) { String r(a); r += b; return r; }
+inline String operator+(const char* a, const String& b) { String r(a); r += b; return r; }
+inline String operator+(const String& a, char b) { String r(a); r += b; return r; }
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t* b, size_t n) { size_t k=0; while(n--) k+=write(*b++); return k; }
+  size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t write(const char* s, size_t n) { return write((const uint8_t*)s, n); }
+  virtual void flush() {}
+  size_t print(const String&) { return 0; } size_t print(const char*) { return 0; }
+  size_t print(int) { return 0; } size_t print(unsigned) { return 0; } size_t print(unsigned long) { return 0; }
+  size_t print(long) { return 0; } size_t print(char) { return 0; }
+  size_t println(const String&) { return 0; } size_t println(const char*) { return 0; } size_t println() { return 0; }
+  size_t println(int) { return 0; } size_t println(unsigned) { return 0; } size_t println(unsigned long) { return 0; } size_t println(long) { return 0; }
+  size_t printf(const char*, ...) { return 0; }
+};
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual size_t readBytes(char* b, size_t n) { return 0; }
+  size_t readBytes(uint8_t* b, size_t n) { return readBytes((char*)b, n); }
+  void setTimeout(unsigned long) {}
+  String readString() { return String(); }
+};
+class HardwareSerial : public Stream {
+public:
+  size_t write(uint8_t) override { return 1; }
+  using Print::write;
+  int available() override { return 0; } int read() override { return -1; } int peek() override { return -1; }
+  void begin(unsigned long) {}
+  explicit operator bool() const { return true; }
+};
+extern HardwareSerial Serial;
+unsigned long micros(); unsigned long millis(); void delay(unsigned long); void yield();
+template<class T> T min(T a, T b) { return a < b ? a : b; }
+struct EspClass { uint32_t getFreeHeap(); uint32_t getMinFreeHeap(); uint32_t getMaxAllocHeap(); void restart(); };
+extern EspClass ESP;
+#define ESP32 1
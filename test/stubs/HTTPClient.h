@@ -0,0 +1,55 @@
+#pragma once
+#include <Arduino.h>
+#include "WiFiClient.h"
+#define HTTPC_FORCE_FOLLOW_REDIRECTS 2
+#define HTTPC_DISABLE_FOLLOW_REDIRECTS 0
+#define HTTPC_STRICT_FOLLOW_REDIRECTS 1
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTP_CODE_OK 200
+typedef int followRedirects_t;
+
+// Scripted sendRequest() results for the host tests: each call returns the next code
+// (0 once the script runs out) and is counted in sends.
+struct HostHttpScript {
+  int codes[8];
+  size_t count;
+  size_t next;
+  int sends;
+  void reset() { count = next = 0; sends = 0; }
+  void push(int code) { if (count < 8) codes[count++] = code; }
+  int take() { sends++; return next < count ? codes[next++] : 0; }
+};
+extern HostHttpScript hostHttp;
+
+class HTTPClient {
+public:
+  bool begin(String url) { return true; }
+  bool begin(WiFiClient& c, String url) { return true; }
+  bool begin(String url, const char* ca) { return true; }
+  void setFollowRedirects(int) {}
+  void setTimeout(uint16_t) {}
+  void setConnectTimeout(int32_t) {}
+  void setReuse(bool) {}
+  void collectHeaders(const char* [], const size_t) {}
+  String header(const char*) { return String(); }
+  void useHTTP10(bool = true) {}
+  void addHeader(const String&, const String&, bool = false, bool = true) {}
+  int POST(const String&) { return 0; }
+  int POST(uint8_t*, size_t) { return 0; }
+  int sendRequest(const char*, Stream*, size_t = 0) { return hostHttp.take(); }
+  int sendRequest(const char*, const String&) { return hostHttp.take(); }
+  String getString() { return String(); }
+  int writeToStream(Stream*) { return 0; }
+  WiFiClient* getStreamPtr() { return nullptr; }
+  WiFiClient& getStream() { static WiFiClient c; return c; }
+  int getSize() { return -1; }
+  bool connected() { return false; }
+  void end() {}
+  static String errorToString(int) { return String(); }
+};
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
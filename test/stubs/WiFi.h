@@ -0,0 +1,6 @@
+#pragma once
+#include "Client.h"
+#include "WiFiClient.h"
+#define WL_CONNECTED 3
+struct WiFiClass { int status(); };
+extern WiFiClass WiFi;
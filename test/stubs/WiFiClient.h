@@ -0,0 +1,36 @@
+#pragma once
+#include "Client.h"
+
+// Host double for the network: every WiFiClient talks to the scripted peer in
+// hostNetwork. With none installed connects fail, as with no route to the host.
+struct HostNetwork {
+  virtual ~HostNetwork() {}
+  virtual bool connect(const char* host, uint16_t port, int32_t timeoutMs) = 0;
+  virtual size_t write(const uint8_t* buf, size_t size) = 0;
+  virtual int available() = 0;
+  virtual int read(uint8_t* buf, size_t size) = 0;
+  virtual bool connected() = 0;
+  virtual void stop() = 0;
+};
+extern HostNetwork* hostNetwork;
+
+class WiFiClient : public Client {
+public:
+  int connect(IPAddress ip, uint16_t port) override { return 0; }
+  int connect(const char* host, uint16_t port) override { return connect(host, port, 0); }
+  virtual int connect(const char* host, uint16_t port, int32_t timeout) { return hostNetwork && hostNetwork->connect(host, port, timeout); }
+  virtual int connect(IPAddress ip, uint16_t port, int32_t timeout) { return 0; }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t size) override { return hostNetwork ? hostNetwork->write(buf, size) : 0; }
+  int available() override { return hostNetwork ? hostNetwork->available() : 0; }
+  int read() override { uint8_t c; return read(&c, 1) == 1 ? c : -1; }
+  int read(uint8_t* buf, size_t size) override { return hostNetwork ? hostNetwork->read(buf, size) : -1; }
+  int peek() override { return -1; }
+  void flush() override {}
+  void stop() override { if (hostNetwork) hostNetwork->stop(); }
+  uint8_t connected() override { return hostNetwork && hostNetwork->connected(); }
+  operator bool() override { return connected(); }
+  int fd() const { return -1; }
+  int setNoDelay(bool) { return 0; }
+  void setTimeout(uint32_t) {}
+};
@@ -0,0 +1,6 @@
+#pragma once
+#include "WiFiClient.h"
+class WiFiClientSecure : public WiFiClient {
+public:
+  void setInsecure() {} void setCACert(const char*) {} void setHandshakeTimeout(unsigned long) {}
+};
@@ -0,0 +1,58 @@
+// mbedtls double for the host tests: the session bookkeeping TlsSessionCache relies
+// on behaves, a client can be set up, and its handshake never completes (it keeps
+// asking for more data). Record I/O fails, so nothing tries real TLS.
+#include <mbedtls/ssl.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/x509_crt.h>
+#include <string.h>
+
+void mbedtls_ssl_session_init(mbedtls_ssl_session *s) { memset(s, 0, sizeof(*s)); }
+void mbedtls_ssl_session_free(mbedtls_ssl_session *s) { memset(s, 0, sizeof(*s)); }
+
+int mbedtls_ssl_set_session(mbedtls_ssl_context *ssl, const mbedtls_ssl_session *s)
+{
+    ssl->offered = *s;
+    ssl->hasOffered = 1;
+    return 0;
+}
+
+int mbedtls_ssl_get_session(const mbedtls_ssl_context *ssl, mbedtls_ssl_session *s)
+{
+    if (ssl->failGet)
+        return -1;
+    *s = ssl->negotiated;
+    return 0;
+}
+
+void mbedtls_ssl_init(mbedtls_ssl_context *ssl) { memset(ssl, 0, sizeof(*ssl)); }
+void mbedtls_ssl_free(mbedtls_ssl_context *ssl) { memset(ssl, 0, sizeof(*ssl)); }
+void mbedtls_ssl_config_init(mbedtls_ssl_config *) {}
+void mbedtls_ssl_config_free(mbedtls_ssl_config *) {}
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config *, int, int, int) { return 0; }
+void mbedtls_ssl_conf_ca_chain(mbedtls_ssl_config *, mbedtls_x509_crt *, void *) {}
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config *, int) {}
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config *, int (*)(void *, unsigned char *, size_t), void *) {}
+void mbedtls_ssl_conf_session_tickets(mbedtls_ssl_config *, int) {}
+int mbedtls_ssl_setup(mbedtls_ssl_context *, const mbedtls_ssl_config *) { return 0; }
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context *, const char *) { return 0; }
+void mbedtls_ssl_set_bio(mbedtls_ssl_context *, void *, mbedtls_ssl_send_t *, mbedtls_ssl_recv_t *, mbedtls_ssl_recv_timeout_t *) {}
+int mbedtls_ssl_handshake(mbedtls_ssl_context *) { return MBEDTLS_ERR_SSL_WANT_READ; }
+int mbedtls_ssl_handshake_step(mbedtls_ssl_context *) { return MBEDTLS_ERR_SSL_WANT_READ; }
+int mbedtls_ssl_is_handshake_over(mbedtls_ssl_context *) { return 0; }
+uint32_t mbedtls_ssl_get_verify_result(const mbedtls_ssl_context *) { return 0; }
+int mbedtls_ssl_write(mbedtls_ssl_context *, const unsigned char *, size_t) { return -1; }
+int mbedtls_ssl_read(mbedtls_ssl_context *, unsigned char *, size_t) { return -1; }
+size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context *) { return 0; }
+int mbedtls_ssl_close_notify(mbedtls_ssl_context *) { return 0; }
+
+void mbedtls_entropy_init(mbedtls_entropy_context *) {}
+void mbedtls_entropy_free(mbedtls_entropy_context *) {}
+int mbedtls_entropy_func(void *, unsigned char *, size_t) { return -1; }
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context *) {}
+void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context *) {}
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context *, int (*)(void *, unsigned char *, size_t), void *, const unsigned char *, size_t) { return 0; }
+int mbedtls_ctr_drbg_random(void *, unsigned char *, size_t) { return -1; }
+void mbedtls_x509_crt_init(mbedtls_x509_crt *) {}
+void mbedtls_x509_crt_free(mbedtls_x509_crt *) {}
+int mbedtls_x509_crt_parse(mbedtls_x509_crt *, const unsigned char *, size_t) { return -1; }
@@ -0,0 +1,56 @@
+// Definitions behind the Arduino / FreeRTOS / ESP-IDF stubs for the host tests
+#include <Arduino.h>
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <freertos/FreeRTOS.h>
+#include "../host_test.h"
+
+int hostTestFailures = 0;
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+HostNetwork *hostNetwork = nullptr;
+HostHttpScript hostHttp = {};
+
+static unsigned long hostMillis = 0;
+
+void hostSetMillis(unsigned long ms) { hostMillis = ms; }
+void hostAdvanceMillis(unsigned long ms) { hostMillis += ms; }
+
+unsigned long millis() { return hostMillis; }
+unsigned long micros() { return hostMillis * 1000; }
+void delay(unsigned long ms) { hostMillis += ms; }
+void yield() {}
+
+uint32_t EspClass::getFreeHeap() { return 200000; }
+uint32_t EspClass::getMinFreeHeap() { return 150000; }
+uint32_t EspClass::getMaxAllocHeap() { return 100000; }
+void EspClass::restart() {}
+
+int WiFiClass::status() { return WL_CONNECTED; }
+
+// Tests are single threaded: a mutex only has to be a non-null handle
+static int hostHandle;
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return &hostHandle; }
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t, UBaseType_t) { return &hostHandle; }
+SemaphoreHandle_t xSemaphoreCreateBinary() { return &hostHandle; }
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+void vSemaphoreDelete(SemaphoreHandle_t) {}
+
+QueueHandle_t xQueueCreate(UBaseType_t, UBaseType_t) { return nullptr; }
+BaseType_t xQueueSend(QueueHandle_t, const void *, TickType_t) { return pdFALSE; }
+BaseType_t xQueueReceive(QueueHandle_t, void *, TickType_t) { return pdFALSE; }
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t) { return 0; }
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *, BaseType_t) { return pdFALSE; }
+BaseType_t xTaskCreate(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *) { return pdFALSE; }
+void vTaskDelay(TickType_t ticks) { hostMillis += ticks; }
+TickType_t xTaskGetTickCount() { return (TickType_t)hostMillis; }
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 4096; }
+void vTaskDelete(TaskHandle_t) {}
+uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
+BaseType_t xTaskNotifyGive(TaskHandle_t) { return pdFALSE; }
+void portENTER_CRITICAL(portMUX_TYPE *) {}
+void portEXIT_CRITICAL(portMUX_TYPE *) {}
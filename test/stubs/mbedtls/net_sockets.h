@@ -0,0 +1,2 @@
+#pragma once
+#define MBEDTLS_ERR_NET_CONN_RESET -0x0050
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "x509_crt.h"
+#define MBEDTLS_SSL_SESSION_TICKETS
+#define MBEDTLS_ERR_SSL_WANT_READ -0x6900
+#define MBEDTLS_ERR_SSL_WANT_WRITE -0x6880
+#define MBEDTLS_SSL_IS_CLIENT 0
+#define MBEDTLS_SSL_TRANSPORT_STREAM 0
+#define MBEDTLS_SSL_PRESET_DEFAULT 0
+#define MBEDTLS_SSL_VERIFY_NONE 0
+#define MBEDTLS_SSL_VERIFY_REQUIRED 2
+#define MBEDTLS_SSL_SESSION_TICKETS_ENABLED 1
+#define MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY -0x7880
+typedef struct { unsigned char id[32]; size_t id_len; } mbedtls_ssl_session;
+// Host double: a test fills "negotiated" with what the handshake produced;
+// set_session records the offered session, get_session hands back "negotiated"
+typedef struct { mbedtls_ssl_session negotiated; mbedtls_ssl_session offered; int hasOffered; int failGet; } mbedtls_ssl_context;
+typedef struct { int x; } mbedtls_ssl_config;
+typedef int mbedtls_ssl_send_t(void*, const unsigned char*, size_t);
+typedef int mbedtls_ssl_recv_t(void*, unsigned char*, size_t);
+typedef int mbedtls_ssl_recv_timeout_t(void*, unsigned char*, size_t, uint32_t);
+void mbedtls_ssl_session_init(mbedtls_ssl_session*); void mbedtls_ssl_session_free(mbedtls_ssl_session*);
+int mbedtls_ssl_set_session(mbedtls_ssl_context*, const mbedtls_ssl_session*);
+int mbedtls_ssl_get_session(const mbedtls_ssl_context*, mbedtls_ssl_session*);
+void mbedtls_ssl_init(mbedtls_ssl_context*); void mbedtls_ssl_free(mbedtls_ssl_context*);
+void mbedtls_ssl_config_init(mbedtls_ssl_config*); void mbedtls_ssl_config_free(mbedtls_ssl_config*);
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config*, int, int, int);
+void mbedtls_ssl_conf_ca_chain(mbedtls_ssl_config*, mbedtls_x509_crt*, void*);
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config*, int);
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config*, int (*)(void*, unsigned char*, size_t), void*);
+void mbedtls_ssl_conf_session_tickets(mbedtls_ssl_config*, int);
+int mbedtls_ssl_setup(mbedtls_ssl_context*, const mbedtls_ssl_config*);
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context*, const char*);
+void mbedtls_ssl_set_bio(mbedtls_ssl_context*, void*, mbedtls_ssl_send_t*, mbedtls_ssl_recv_t*, mbedtls_ssl_recv_timeout_t*);
+int mbedtls_ssl_handshake(mbedtls_ssl_context*);
+int mbedtls_ssl_handshake_step(mbedtls_ssl_context*);
+int mbedtls_ssl_is_handshake_over(mbedtls_ssl_context*);
+uint32_t mbedtls_ssl_get_verify_result(const mbedtls_ssl_context*);
+int mbedtls_ssl_write(mbedtls_ssl_context*, const unsigned char*, size_t);
+int mbedtls_ssl_read(mbedtls_ssl_context*, unsigned char*, size_t);
+size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context*);
+int mbedtls_ssl_close_notify(mbedtls_ssl_context*);
@@ -0,0 +1,5 @@
+#pragma once
+#include <cstddef>
+typedef struct { int x; } mbedtls_x509_crt;
+void mbedtls_x509_crt_init(mbedtls_x509_crt*); void mbedtls_x509_crt_free(mbedtls_x509_crt*);
+int mbedtls_x509_crt_parse(mbedtls_x509_crt*, const unsigned char*, size_t);
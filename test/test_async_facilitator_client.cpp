@@ -0,0 +1,465 @@
+// AsyncFacilitatorRequest against a scripted facilitator: deadlines and keep-alive retry
+#include "AsyncFacilitatorClient.h"
+#include <HTTPClient.h>
+#include <string>
+#include "host_test.h"
+
+// One facilitator connection at a time. Replies become readable at replyAtMs on the
+// fake clock, at most trickle bytes per read (0 = everything available at once).
+struct MockFacilitator : HostNetwork
+{
+    bool refuse = false;
+    bool open = false;
+    int connects = 0;
+    std::string request;
+    std::string reply;
+    size_t replyPos = 0;
+    unsigned long replyAtMs = 0;
+    size_t trickle = 0;
+    // One-shot faults on the current connection, as left behind by a server that
+    // dropped an idle keep-alive connection without the client noticing yet
+    bool failNextWrite = false;
+    bool closeBeforeReply = false;
+
+    void respond(const std::string &r, unsigned long atMs = 0)
+    {
+        request.clear();
+        reply = r;
+        replyPos = 0;
+        replyAtMs = atMs;
+    }
+
+    bool connect(const char *, uint16_t, int32_t) override
+    {
+        if (refuse)
+            return false;
+        connects++;
+        open = true;
+        request.clear();
+        replyPos = 0;
+        return true;
+    }
+
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        if (!open)
+            return 0;
+        if (failNextWrite)
+        {
+            failNextWrite = false;
+            open = false;
+            return 0;
+        }
+        request.append((const char *)buf, size);
+        return size;
+    }
+
+    int available() override
+    {
+        if (!open)
+            return 0;
+        if (closeBeforeReply)
+        {
+            closeBeforeReply = false;
+            open = false;
+            return 0;
+        }
+        if (millis() < replyAtMs)
+            return 0;
+        size_t left = reply.size() - replyPos;
+        if (trickle && left > trickle)
+            left = trickle;
+        return (int)left;
+    }
+
+    int read(uint8_t *buf, size_t size) override
+    {
+        int avail = available();
+        if (avail <= 0)
+            return -1;
+        size_t n = size < (size_t)avail ? size : (size_t)avail;
+        memcpy(buf, reply.data() + replyPos, n);
+        replyPos += n;
+        return (int)n;
+    }
+
+    bool connected() override { return open; }
+    void stop() override { open = false; }
+};
+
+static const char kVerifyReply[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 36\r\n"
+    "\r\n"
+    "{\"isValid\":true,\"payer\":\"0xabc\"}    ";
+
+static const char kChunkedReply[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "10\r\n{\"isValid\":true,\r\n"
+    "10\r\n\"payer\":\"0xabc\"}\r\n"
+    "0\r\n"
+    "\r\n";
+
+static const FacilitatorDeadlines kDeadlines = {1000, 2000, 5000};
+
+static MockFacilitator *mock;
+
+static void freshPeer()
+{
+    static MockFacilitator peer;
+    peer = MockFacilitator();
+    mock = &peer;
+    hostNetwork = mock;
+    hostSetMillis(1000);
+}
+
+// Poll until the request finishes, advancing the clock stepMs between polls
+static AsyncFacilitatorRequest::State run(AsyncFacilitatorRequest &request, unsigned long stepMs = 10,
+                                          int maxPolls = 10000)
+{
+    for (int i = 0; i < maxPolls && !request.finished(); ++i)
+    {
+        request.poll();
+        if (!request.finished())
+            hostAdvanceMillis(stepMs);
+    }
+    return request.state();
+}
+
+static void testContentLengthReply()
+{
+    freshPeer();
+    mock->respond(kVerifyReply);
+
+    SegmentedBodyStream body;
+    body.append("{\"paymentPayload\":");
+    body.append("{}}");
+
+    AsyncFacilitatorRequest request;
+    CHECK(request.start("http://facilitator.test:8080/verify", body, "X-Api-Key: k\n", kDeadlines));
+    CHECK_EQ(run(request), AsyncFacilitatorRequest::Done);
+    CHECK_EQ(request.statusCode(), 200);
+    CHECK(request.response().success);
+    CHECK(request.result().isValid);
+    CHECK_STR(request.result().payer, "0xabc");
+    CHECK_EQ(mock->connects, 1);
+
+    const std::string &sent = mock->request;
+    CHECK(sent.rfind("POST /verify HTTP/1.1\r\n", 0) == 0);
+    CHECK(sent.find("Host: facilitator.test:8080\r\n") != std::string::npos);
+    CHECK(sent.find("Content-Length: 21\r\n") != std::string::npos);
+    CHECK(sent.find("X-Api-Key: k\r\n") != std::string::npos);
+    CHECK(sent.size() >= 21 && sent.compare(sent.size() - 21, 21, "{\"paymentPayload\":{}}") == 0);
+
+    // HTTP/1.1 without Connection: close keeps the connection for the next request
+    request.reset();
+    CHECK(mock->open);
+    CHECK(request.canReuse("http://facilitator.test:8080/settle"));
+    CHECK(!request.canReuse("http://other.test:8080/settle"));
+    CHECK(!request.canReuse("http://facilitator.test:80801/settle"));
+}
+
+static void testChunkedReplyInSmallReads()
+{
+    freshPeer();
+    mock->respond(kChunkedReply);
+    mock->trickle = 3;
+
+    SegmentedBodyStream body;
+    body.append("{}");
+
+    AsyncFacilitatorRequest request;
+    CHECK(request.start("http://facilitator.test/verify", body, "", kDeadlines));
+    CHECK_EQ(run(request, 1), AsyncFacilitatorRequest::Done);
+    CHECK_EQ(request.statusCode(), 200);
+    CHECK(request.result().isValid);
+    CHECK_STR(request.result().payer, "0xabc");
+}
+
+static void testConnectionRefused()
+{
+    freshPeer();
+    mock->refuse = true;
+
+    SegmentedBodyStream body;
+    body.append("{}");
+
+    AsyncFacilitatorRequest request;
+    CHECK(request.start("http://facilitator.test/verify", body, "", kDeadlines));
+    CHECK_EQ(run(request), AsyncFacilitatorRequest::Failed);
+    CHECK_EQ(request.statusCode(), HTTPC_ERROR_CONNECTION_REFUSED);
+    CHECK(!request.response().success);
+}
+
+static void testConnectDeadline()
+{
+    // TCP connects, but the host mbedtls double never finishes the TLS handshake
+    freshPeer();
+
+    SegmentedBodyStream body;
+    body.append("{}");
+
+    AsyncFacilitatorRequest request;
+    CHECK(request.start("https://facilitator.test/verify", body, "", kDeadlines));
+    unsigned long started = millis();
+    CHECK_EQ(request.poll(), AsyncFacilitatorRequest::Handshaking);
+    CHECK_EQ(run(request, 50), AsyncFacilitatorRequest::Failed);
+    CHECK_EQ(request.statusCode(), X4PAY_HTTP_ERROR_CONNECT_TIMEOUT);
+    CHECK(millis() - started > kDeadlines.connectMs);
+    CHECK(millis() - started < kDeadlines.connectMs + 100);
+    CHECK(!mock->open);
+}
+
+static void testFirstByteDeadline()
+{
+    freshPeer();
+    // The facilitator takes the request but answers too late
+    mock->respond(kVerifyReply, 1000 + 30000);
+
+    SegmentedBodyStream body;
+    body.append("{}");
+
+    AsyncFacilitatorRequest request;
+    CHECK(request.start("http://facilitator.test/verify", body, "", kDeadlines));
+
+    // Time before the request went out doesn't count against the first byte
+    hostAdvanceMillis(800);
+    CHECK_EQ(request.poll(), AsyncFacilitatorRequest::Sending);
+    CHECK_EQ(request.poll(), AsyncFacilitatorRequest::AwaitingFirstByte);
+    unsigned long sent = millis();
+
+    CHECK_EQ(run(request, 50), AsyncFacilitatorRequest::Failed);
+    CHECK_EQ(request.statusCode(), X4PAY_HTTP_ERROR_FIRST_BYTE_TIMEOUT);
+    CHECK(millis() - sent > kDeadlines.firstByteMs);
+    CHECK(millis() - sent < kDeadlines.firstByteMs + 100);
+    CHECK(!mock->open);
+}
+
+static void testTotalDeadline()
+{
+    freshPeer();
+    // First byte arrives in time, then the body trickles in slower than the total allows
+    mock->respond(kVerifyReply, 1000 + 500);
+    mock->trickle = 1;
+
+    SegmentedBodyStream body;
+    body.append("{}");
+
+    AsyncFacilitatorRequest request;
+    CHECK(request.start("http://facilitator.test/verify", body, "", kDeadlines));
+    unsigned long started = millis();
+    // A poll reads at most 8 bytes here, so the 107-byte reply needs 14 polls (7 s)
+    CHECK_EQ(run(request, 500), AsyncFacilitatorRequest::Failed);
+    CHECK_EQ(request.statusCode(), X4PAY_HTTP_ERROR_TOTAL_TIMEOUT);
+    CHECK(millis() - started > kDeadlines.totalMs);
+    CHECK(millis() - started <= kDeadlines.totalMs + 500);
+    CHECK(mock->replyPos > 0 && mock->replyPos < sizeof(kVerifyReply) - 1);
+}
+
+// Complete one request so the next start() finds a kept-alive connection
+static void warmConnection(AsyncFacilitatorRequest &request, SegmentedBodyStream &body)
+{
+    mock->respond(kVerifyReply);
+    CHECK(request.start("http://facilitator.test/verify", body, "", kDeadlines));
+    CHECK_EQ(run(request), AsyncFacilitatorRequest::Done);
+    request.reset();
+    CHECK_EQ(mock->connects, 1);
+}
+
+static void testStaleKeepAliveRetriedOnWrite()
+{
+    freshPeer();
+    SegmentedBodyStream body;
+    body.append("{}");
+
+    AsyncFacilitatorRequest request;
+    warmConnection(request, body);
+
+    // The server dropped the idle connection; the first write finds out
+    mock->respond(kVerifyReply);
+    mock->failNextWrite = true;
+    CHECK(request.start("http://facilitator.test/settle", body, "", kDeadlines));
+    CHECK(request.reusedConnection());
+    CHECK_EQ(run(request), AsyncFacilitatorRequest::Done);
+    CHECK_EQ(request.statusCode(), 200);
+    CHECK(!request.reusedConnection());
+    CHECK_EQ(mock->connects, 2);
+    // The whole request went out again on the new connection
+    CHECK(mock->request.rfind("POST /settle HTTP/1.1\r\n", 0) == 0);
+    CHECK(mock->request.compare(mock->request.size() - 2, 2, "{}") == 0);
+}
+
+static void testStaleKeepAliveRetriedOnRead()
+{
+    freshPeer();
+    SegmentedBodyStream body;
+    body.append("{}");
+
+    AsyncFacilitatorRequest request;
+    warmConnection(request, body);
+
+    // Writes went into the void; the close shows up before any response byte.
+    // A verify is idempotent, so it goes out again.
+    mock->respond(kVerifyReply);
+    mock->closeBeforeReply = true;
+    CHECK(request.start("http://facilitator.test/verify", body, "", kDeadlines, true));
+    CHECK(request.reusedConnection());
+    CHECK_EQ(run(request), AsyncFacilitatorRequest::Done);
+    CHECK_EQ(mock->connects, 2);
+    CHECK(request.result().isValid);
+}
+
+static void testSettleNotResentAfterSend()
+{
+    freshPeer();
+    SegmentedBodyStream body;
+    body.append("{}");
+
+    AsyncFacilitatorRequest request;
+    warmConnection(request, body);
+
+    // The whole settle went out before the close: the facilitator may have acted on it
+    mock->respond(kVerifyReply);
+    mock->closeBeforeReply = true;
+    CHECK(request.start("http://facilitator.test/settle", body, "", kDeadlines));
+    CHECK(request.reusedConnection());
+    CHECK_EQ(run(request), AsyncFacilitatorRequest::Failed);
+    CHECK_EQ(request.statusCode(), HTTPC_ERROR_CONNECTION_LOST);
+    CHECK_EQ(mock->connects, 1);
+    CHECK(mock->request.rfind("POST /settle HTTP/1.1\r\n", 0) == 0);
+}
+
+static void testClientRetriesOnlyVerifyOnRead()
+{
+    freshPeer();
+    SegmentedBodyStream body;
+    body.append("{}");
+    AsyncFacilitatorClient client;
+
+    // Warm a slot, then let the stale close surface on read for each endpoint
+    FacilitatorEndpoint endpoints[2] = {FacilitatorVerify, FacilitatorSettle};
+    for (int e = 0; e < 2; ++e)
+    {
+        mock->respond(kVerifyReply);
+        int slot = client.start(endpoints[e], "http://facilitator.test/x", body);
+        for (int i = 0; i < 100 && !client.request(slot).finished(); ++i)
+            client.poll();
+        CHECK_EQ(client.request(slot).state(), AsyncFacilitatorRequest::Done);
+        client.release(slot);
+
+        int connects = mock->connects;
+        mock->respond(kVerifyReply);
+        mock->closeBeforeReply = true;
+        slot = client.start(endpoints[e], "http://facilitator.test/x", body);
+        CHECK(client.request(slot).reusedConnection());
+        for (int i = 0; i < 100 && !client.request(slot).finished(); ++i)
+            client.poll();
+        bool verify = endpoints[e] == FacilitatorVerify;
+        CHECK_EQ(client.request(slot).state(),
+                 verify ? AsyncFacilitatorRequest::Done : AsyncFacilitatorRequest::Failed);
+        CHECK_EQ(mock->connects, connects + (verify ? 1 : 0));
+        client.release(slot);
+    }
+}
+
+static void testNoRetryAfterResponseBytes()
+{
+    freshPeer();
+    SegmentedBodyStream body;
+    body.append("{}");
+
+    AsyncFacilitatorRequest request;
+    warmConnection(request, body);
+
+    // Part of a response arrived, so the facilitator saw the request - never resend it
+    mock->respond(std::string(kVerifyReply, 20));
+    CHECK(request.start("http://facilitator.test/settle", body, "", kDeadlines));
+    CHECK(request.reusedConnection());
+    for (int i = 0; i < 10 && mock->replyPos < mock->reply.size(); ++i)
+        request.poll();
+    mock->open = false;
+    CHECK_EQ(run(request), AsyncFacilitatorRequest::Failed);
+    CHECK_EQ(request.statusCode(), HTTPC_ERROR_CONNECTION_LOST);
+    CHECK_EQ(mock->connects, 1);
+}
+
+static void testFreshConnectionNotRetried()
+{
+    freshPeer();
+    mock->closeBeforeReply = true;
+
+    SegmentedBodyStream body;
+    body.append("{}");
+
+    AsyncFacilitatorRequest request;
+    CHECK(request.start("http://facilitator.test/verify", body, "", kDeadlines));
+    CHECK_EQ(run(request), AsyncFacilitatorRequest::Failed);
+    CHECK_EQ(request.statusCode(), HTTPC_ERROR_CONNECTION_LOST);
+    CHECK_EQ(mock->connects, 1);
+}
+
+static void testIdleConnectionNotReused()
+{
+    freshPeer();
+    SegmentedBodyStream body;
+    body.append("{}");
+
+    AsyncFacilitatorRequest request;
+    warmConnection(request, body);
+
+    hostAdvanceMillis(X4PAY_FACILITATOR_IDLE_TIMEOUT_MS + 1);
+    CHECK(!request.canReuse("http://facilitator.test/settle"));
+    mock->respond(kVerifyReply);
+    CHECK(request.start("http://facilitator.test/settle", body, "", kDeadlines));
+    CHECK(!request.reusedConnection());
+    CHECK_EQ(run(request), AsyncFacilitatorRequest::Done);
+    CHECK_EQ(mock->connects, 2);
+}
+
+static void testClientDeadlinesPerEndpoint()
+{
+    freshPeer();
+    mock->respond(kVerifyReply, 1000 + 30000);
+
+    SegmentedBodyStream body;
+    body.append("{}");
+
+    AsyncFacilitatorClient client;
+    FacilitatorDeadlines settle = {1000, 300, 5000};
+    client.setDeadlines(FacilitatorSettle, settle);
+
+    int slot = client.start(FacilitatorSettle, "http://facilitator.test/settle", body);
+    CHECK(slot >= 0);
+    CHECK_EQ(client.inFlight(), 1u);
+    for (int i = 0; i < 100 && !client.request(slot).finished(); ++i)
+    {
+        client.poll();
+        hostAdvanceMillis(10);
+    }
+    CHECK_EQ(client.request(slot).statusCode(), X4PAY_HTTP_ERROR_FIRST_BYTE_TIMEOUT);
+    client.release(slot);
+    CHECK_EQ(client.inFlight(), 0u);
+}
+
+int main()
+{
+    testContentLengthReply();
+    testChunkedReplyInSmallReads();
+    testConnectionRefused();
+    testConnectDeadline();
+    testFirstByteDeadline();
+    testTotalDeadline();
+    testStaleKeepAliveRetriedOnWrite();
+    testStaleKeepAliveRetriedOnRead();
+    testSettleNotResentAfterSend();
+    testClientRetriesOnlyVerifyOnRead();
+    testNoRetryAfterResponseBytes();
+    testFreshConnectionNotRetried();
+    testIdleConnectionNotReused();
+    testClientDeadlinesPerEndpoint();
+    hostNetwork = nullptr;
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,82 @@
+// FacilitatorClient: when a request on a kept-alive connection is retried
+#include "FacilitatorClient.h"
+#include "host_test.h"
+
+// Keeps every connection open, so a successful request leaves one to reuse
+struct OpenNetwork : HostNetwork
+{
+    bool connect(const char *, uint16_t, int32_t) override { return true; }
+    size_t write(const uint8_t *, size_t size) override { return size; }
+    int available() override { return 0; }
+    int read(uint8_t *, size_t) override { return -1; }
+    bool connected() override { return true; }
+    void stop() override {}
+};
+
+static OpenNetwork network;
+
+static const char kUrl[] = "http://facilitator.test/settle";
+
+// Leave the client with a kept-alive connection to kUrl's origin
+static void warm(FacilitatorClient &client)
+{
+    hostHttp.reset();
+    hostHttp.push(200);
+    CHECK_EQ(client.post(kUrl, String("{}")).statusCode, 200);
+}
+
+static void testSendErrorsRetried()
+{
+    const int codes[] = {HTTPC_ERROR_CONNECTION_REFUSED, HTTPC_ERROR_SEND_HEADER_FAILED,
+                         HTTPC_ERROR_SEND_PAYLOAD_FAILED, HTTPC_ERROR_NOT_CONNECTED};
+    for (int code : codes)
+    {
+        FacilitatorClient client;
+        warm(client);
+
+        // The request never fully went out: one retry on a fresh connection
+        hostHttp.reset();
+        hostHttp.push(code);
+        hostHttp.push(200);
+        CHECK_EQ(client.post(kUrl, String("{}")).statusCode, 200);
+        CHECK_EQ(hostHttp.sends, 2);
+        CHECK_EQ(client.getStats().reconnects, 1u);
+    }
+}
+
+static void testLostResponseNotRetried()
+{
+    FacilitatorClient client;
+    warm(client);
+
+    // Lost while waiting for the reply: the facilitator may have settled already
+    hostHttp.reset();
+    hostHttp.push(HTTPC_ERROR_CONNECTION_LOST);
+    hostHttp.push(200);
+    HttpResponse response = client.post(kUrl, String("{}"));
+    CHECK_EQ(response.statusCode, HTTPC_ERROR_CONNECTION_LOST);
+    CHECK(!response.success);
+    CHECK_EQ(hostHttp.sends, 1);
+    CHECK_EQ(client.getStats().reconnects, 0u);
+}
+
+static void testFreshConnectionNotRetried()
+{
+    FacilitatorClient client;
+
+    hostHttp.reset();
+    hostHttp.push(HTTPC_ERROR_SEND_HEADER_FAILED);
+    hostHttp.push(200);
+    CHECK_EQ(client.post(kUrl, String("{}")).statusCode, HTTPC_ERROR_SEND_HEADER_FAILED);
+    CHECK_EQ(hostHttp.sends, 1);
+}
+
+int main()
+{
+    hostNetwork = &network;
+    testSendErrorsRetried();
+    testLostResponseNotRetried();
+    testFreshConnectionNotRetried();
+    hostNetwork = nullptr;
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,392 @@
+// FacilitatorResponseParser against canned facilitator /verify and /settle replies
+#include "FacilitatorResponseParser.h"
+#include "host_test.h"
+#include <string>
+
+static const char kTx[] = "0x8f3a2b1c0d9e8f7a6b5c4d3e2f1a0b9c8d7e6f5a4b3c2d1e0f9a8b7c6d5e4f3a";
+static const char kPayer[] = "0x857b06519E91e3A54538791bDbb0E22373e36b66";
+
+static const char kVerifyValid[] =
+    "{\"isValid\":true,\"payer\":\"0x857b06519E91e3A54538791bDbb0E22373e36b66\"}";
+
+static const char kVerifyInvalidPretty[] =
+    "{\r\n"
+    "  \"isValid\" : false ,\r\n"
+    "\t\"invalidReason\"\t:\t\"insufficient_funds\",\r\n"
+    "  \"payer\": \"0x857b06519E91e3A54538791bDbb0E22373e36b66\"\r\n"
+    "}\r\n";
+
+static const char kSettleSuccess[] =
+    "{\"success\":true,\"errorReason\":null,"
+    "\"transaction\":\"0x8f3a2b1c0d9e8f7a6b5c4d3e2f1a0b9c8d7e6f5a4b3c2d1e0f9a8b7c6d5e4f3a\","
+    "\"network\":\"base-sepolia\",\"payer\":\"0x857b06519E91e3A54538791bDbb0E22373e36b66\"}";
+
+// Members of nested objects and arrays must not leak into the top-level result
+static const char kSettleNested[] =
+    "{\"receipt\":{\"success\":false,\"transaction\":\"0xdead\",\"logs\":[{\"network\":\"x\"},[1,2,{}]]},"
+    "\"success\":true,"
+    "\"meta\":{\"inner\":{\"payer\":\"0xnested\",\"errorReason\":\"nested\"}},"
+    "\"transaction\":\"0x8f3a2b1c0d9e8f7a6b5c4d3e2f1a0b9c8d7e6f5a4b3c2d1e0f9a8b7c6d5e4f3a\","
+    "\"network\":\"base\"}";
+
+static const char kSettleFailedEscaped[] =
+    "{\"success\":false,"
+    "\"errorReason\":\"said \\\"no\\\" \\\\ path\\/to\\n\\tend\","
+    "\"transaction\":\"\",\"network\":\"base\"}";
+
+static FacilitatorResult parseWhole(const char *body, bool *ok = nullptr)
+{
+    FacilitatorResult result;
+    bool parsed = FacilitatorResponseParser::parse(body, strlen(body), result);
+    if (ok)
+        *ok = parsed;
+    return result;
+}
+
+static bool sameResult(const FacilitatorResult &a, const FacilitatorResult &b)
+{
+    return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static void testVerifyReplies()
+{
+    bool ok = false;
+    FacilitatorResult r = parseWhole(kVerifyValid, &ok);
+    CHECK(ok);
+    CHECK(r.hasIsValid && r.isValid);
+    CHECK(!r.hasSuccess);
+    CHECK_STR(r.payer, kPayer);
+    CHECK_STR(r.invalidReason, "");
+
+    r = parseWhole(kVerifyInvalidPretty, &ok);
+    CHECK(ok);
+    CHECK(r.hasIsValid && !r.isValid);
+    CHECK_STR(r.invalidReason, "insufficient_funds");
+    CHECK_STR(r.payer, kPayer);
+    CHECK(!r.truncated && !r.malformed);
+}
+
+static void testSettleReplies()
+{
+    bool ok = false;
+    FacilitatorResult r = parseWhole(kSettleSuccess, &ok);
+    CHECK(ok);
+    CHECK(r.hasSuccess && r.success);
+    CHECK_STR(r.transaction, kTx);
+    CHECK_STR(r.network, "base-sepolia");
+    CHECK_STR(r.payer, kPayer);
+    CHECK_STR(r.errorReason, ""); // null is not a string
+}
+
+static void testWhitespaceVariants()
+{
+    const char *variants[] = {
+        "{\"success\":true,\"transaction\":\"0xab\"}",
+        "{ \"success\" : true , \"transaction\" : \"0xab\" }",
+        "\n\n{\n\"success\"\n:\ntrue\n,\n\"transaction\"\n:\n\"0xab\"\n}\n",
+        "\t{\t\"success\"\t:\ttrue\t,\t\"transaction\"\t:\t\"0xab\"\t}\t",
+        "{\r\n    \"success\": true,\r\n    \"transaction\": \"0xab\"\r\n}",
+        "   {\"success\":true   ,\"transaction\":\"0xab\"   }   ",
+    };
+    for (const char *body : variants)
+    {
+        bool ok = false;
+        FacilitatorResult r = parseWhole(body, &ok);
+        CHECK(ok);
+        CHECK(r.hasSuccess && r.success);
+        CHECK_STR(r.transaction, "0xab");
+    }
+}
+
+static void testNestedObjects()
+{
+    bool ok = false;
+    FacilitatorResult r = parseWhole(kSettleNested, &ok);
+    CHECK(ok);
+    CHECK(r.hasSuccess && r.success);
+    CHECK_STR(r.transaction, kTx);
+    CHECK_STR(r.network, "base");
+    CHECK_STR(r.payer, "");
+    CHECK_STR(r.errorReason, "");
+
+    // Only a nested "success" - the top level never said anything
+    r = parseWhole("{\"data\":{\"success\":true,\"transaction\":\"0x1\"}}", &ok);
+    CHECK(ok);
+    CHECK(!r.hasSuccess);
+    CHECK_STR(r.transaction, "");
+
+    // A root array is valid JSON but carries no members
+    r = parseWhole("[{\"success\":true}]", &ok);
+    CHECK(ok);
+    CHECK(!r.hasSuccess);
+}
+
+static void testEscapedStrings()
+{
+    bool ok = false;
+    FacilitatorResult r = parseWhole(kSettleFailedEscaped, &ok);
+    CHECK(ok);
+    CHECK(r.hasSuccess && !r.success);
+    CHECK_STR(r.errorReason, "said \"no\" \\ path/to\n\tend");
+    CHECK_STR(r.transaction, "");
+
+    // Escaped quotes and braces inside skipped values don't disturb nesting
+    r = parseWhole("{\"note\":\"}{\\\"success\\\":true\",\"success\":false}", &ok);
+    CHECK(ok);
+    CHECK(r.hasSuccess && !r.success);
+}
+
+static void testUnicodeEscapes()
+{
+    bool ok = false;
+    FacilitatorResult r = parseWhole("{\"succ\\u0065ss\":true,\"network\":\"b\\u0061se\","
+                                     "\"errorReason\":\"caf\\u00e9 \\u20AC \\ud83d\\ude00\"}", &ok);
+    CHECK(ok);
+    CHECK(r.hasSuccess && r.success); // escaped key still matches
+    CHECK_STR(r.network, "base");
+    CHECK_STR(r.errorReason, "caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80");
+
+    // Unpaired surrogates become U+FFFD
+    r = parseWhole("{\"errorReason\":\"a\\ud83db\\ude00c\\ud83d\"}", &ok);
+    CHECK(ok);
+    CHECK_STR(r.errorReason, "a\xEF\xBF\xBD" "b\xEF\xBF\xBD" "c\xEF\xBF\xBD");
+
+    // A multi-byte character that doesn't fit whole is dropped, not cut in half
+    std::string body = "{\"network\":\"" + std::string(30, 'n') + "\\u00e9tail\"}";
+    r = parseWhole(body.c_str(), &ok);
+    CHECK(ok);
+    CHECK(r.truncated);
+    CHECK_STR(r.network, std::string(30, 'n').c_str());
+
+    r = parseWhole("{\"network\":\"\\u00zz\"}", &ok);
+    CHECK(!ok);
+}
+
+// Every body must give the same result however the transport slices it
+static void checkSplits(const char *body)
+{
+    FacilitatorResult whole = parseWhole(body);
+    size_t len = strlen(body);
+
+    for (size_t cut = 0; cut <= len; ++cut)
+    {
+        FacilitatorResponseParser parser;
+        parser.feed(body, cut);
+        parser.feed(body + cut, len - cut);
+        parser.finish();
+        CHECK(sameResult(parser.result(), whole));
+    }
+
+    FacilitatorResponseParser bytewise;
+    for (size_t i = 0; i < len; ++i)
+        bytewise.feed(body + i, 1);
+    bytewise.finish();
+    CHECK(sameResult(bytewise.result(), whole));
+
+    // Three-way splits over a coarse grid
+    for (size_t a = 0; a <= len; a += 3)
+    {
+        for (size_t b = a; b <= len; b += 7)
+        {
+            FacilitatorResponseParser parser;
+            parser.feed(body, a);
+            parser.feed(body + a, b - a);
+            parser.feed(body + b, len - b);
+            parser.finish();
+            CHECK(sameResult(parser.result(), whole));
+        }
+    }
+}
+
+static void testValuesSplitAcrossSlices()
+{
+    checkSplits(kVerifyValid);
+    checkSplits(kVerifyInvalidPretty);
+    checkSplits(kSettleSuccess);
+    checkSplits(kSettleNested);
+    checkSplits(kSettleFailedEscaped);
+
+    // Literal split at the end of the body: finish() flushes it
+    FacilitatorResponseParser parser;
+    parser.feed("{\"isValid\":tr", 13);
+    parser.feed("ue}", 3);
+    CHECK(parser.finish());
+    CHECK(parser.result().hasIsValid && parser.result().isValid);
+}
+
+static void testOversizedFields()
+{
+    // Longer than the 80-byte transaction buffer
+    std::string longTx = "0x" + std::string(200, 'a');
+    std::string body = "{\"success\":true,\"transaction\":\"" + longTx + "\",\"network\":\"base\"}";
+    bool ok = false;
+    FacilitatorResult r = parseWhole(body.c_str(), &ok);
+    CHECK(ok);
+    CHECK(r.truncated);
+    CHECK_EQ(strlen(r.transaction), sizeof(r.transaction) - 1);
+    CHECK(strncmp(r.transaction, longTx.c_str(), sizeof(r.transaction) - 1) == 0);
+    CHECK_STR(r.network, "base"); // parsing carries on after the truncated field
+
+    // Exactly fits: no truncation
+    std::string fits(sizeof(r.network) - 1, 'n');
+    body = "{\"network\":\"" + fits + "\"}";
+    r = parseWhole(body.c_str(), &ok);
+    CHECK(ok);
+    CHECK(!r.truncated);
+    CHECK_STR(r.network, fits.c_str());
+
+    // Oversized unknown members are skipped without a buffer
+    std::string blob(4096, 'x');
+    body = "{\"blob\":\"" + blob + "\",\"" + blob + "\":1,\"success\":true}";
+    r = parseWhole(body.c_str(), &ok);
+    CHECK(ok);
+    CHECK(!r.truncated);
+    CHECK(r.hasSuccess && r.success);
+
+    // A long key that starts with a known one is not mistaken for it
+    r = parseWhole("{\"successfulSettlementCount\":false,\"success\":true}", &ok);
+    CHECK(ok);
+    CHECK(r.hasSuccess && r.success);
+
+    // Oversized literal
+    r = parseWhole("{\"amount\":123456789012345678901234567890,\"success\":true}", &ok);
+    CHECK(ok);
+    CHECK(r.hasSuccess && r.success);
+}
+
+static void testMalformed()
+{
+    const char *bodies[] = {
+        "",
+        "   ",
+        "{\"success\":true",
+        "{\"success\":true}}",
+        "{\"transaction\":\"0xab",
+        "<html>502 Bad Gateway</html>",
+        "{\"success\":true,\"x\":@}",
+        "true", // replies are always objects
+    };
+    for (const char *body : bodies)
+    {
+        bool ok = true;
+        FacilitatorResult r = parseWhole(body, &ok);
+        CHECK(!ok);
+        CHECK(r.malformed);
+    }
+
+    // Nesting deeper than the parser tracks
+    std::string deep = "{\"a\":" + std::string(40, '[') + std::string(40, ']') + "}";
+    bool ok = true;
+    parseWhole(deep.c_str(), &ok);
+    CHECK(!ok);
+}
+
+static void testReset()
+{
+    FacilitatorResponseParser parser;
+    parser.feed(kSettleSuccess, strlen(kSettleSuccess));
+    CHECK(parser.finish());
+    parser.reset();
+    parser.feed(kVerifyValid, strlen(kVerifyValid));
+    CHECK(parser.finish());
+    CHECK(!parser.result().hasSuccess);
+    CHECK_STR(parser.result().transaction, "");
+    CHECK(parser.result().hasIsValid);
+}
+
+// Batch reply walked item by item, as SettlementBatch does
+struct WalkedItems
+{
+    FacilitatorResult items[8];
+    size_t indices[8];
+    size_t count;
+};
+
+static void collectItem(void *context, size_t index, const FacilitatorResult &item)
+{
+    WalkedItems *walked = (WalkedItems *)context;
+    if (walked->count < 8)
+    {
+        walked->indices[walked->count] = index;
+        walked->items[walked->count++] = item;
+    }
+}
+
+static const char kBatchReply[] =
+    "{\"success\":false,\"results\":[\n"
+    "  {\"success\":true,\"transaction\":\"0x01\",\"meta\":{\"transaction\":\"0xnested\"},\"network\":\"base\"},\n"
+    "  null,\n"
+    "  {\"success\":false,\"errorReason\":\"say \\\"]}\\\"\",\"list\":[{\"success\":true}]},\n"
+    "  [\"x\"],\n"
+    "  {\"success\":true,\"transaction\":\"0x05\",\"payer\":\"\\u00e9\"}\n"
+    "],\"network\":\"top\",\"other\":[{\"success\":true}]}";
+
+static void checkBatchWalk(const WalkedItems &walked)
+{
+    CHECK_EQ(walked.count, 5u);
+    for (size_t i = 0; i < walked.count; ++i)
+        CHECK_EQ(walked.indices[i], i);
+
+    CHECK(walked.items[0].hasSuccess && walked.items[0].success);
+    CHECK_STR(walked.items[0].transaction, "0x01");
+    CHECK_STR(walked.items[0].network, "base");
+    CHECK(!walked.items[1].hasSuccess);
+    CHECK(walked.items[2].hasSuccess && !walked.items[2].success);
+    CHECK_STR(walked.items[2].errorReason, "say \"]}\"");
+    CHECK(!walked.items[3].hasSuccess);
+    CHECK(walked.items[4].success);
+    CHECK_STR(walked.items[4].transaction, "0x05");
+    CHECK_STR(walked.items[4].payer, "\xc3\xa9");
+}
+
+static void testWalkItems()
+{
+    WalkedItems walked = {};
+    FacilitatorResponseParser parser;
+    parser.walkItems("results", collectItem, &walked);
+    parser.feed(kBatchReply, strlen(kBatchReply));
+    CHECK(parser.finish());
+    checkBatchWalk(walked);
+
+    // Top-level members still land in result() and are not mixed with the items
+    CHECK(parser.result().hasSuccess && !parser.result().success);
+    CHECK_STR(parser.result().network, "top");
+    CHECK_STR(parser.result().transaction, "");
+
+    // Byte by byte, and again after reset() - the walk stays configured
+    walked = WalkedItems();
+    parser.reset();
+    for (const char *p = kBatchReply; *p; ++p)
+        parser.feed(p, 1);
+    CHECK(parser.finish());
+    checkBatchWalk(walked);
+
+    // A reply cut inside an item delivers only the items that closed
+    walked = WalkedItems();
+    parser.reset();
+    const char *cut = strstr(kBatchReply, "{\"success\":true,\"transaction\":\"0x05");
+    parser.feed(kBatchReply, cut - kBatchReply + 10);
+    CHECK(!parser.finish());
+    CHECK_EQ(walked.count, 4u);
+
+    // Without a walk the array is skipped like any other nested value
+    FacilitatorResult plain = parseWhole(kBatchReply);
+    CHECK_STR(plain.network, "top");
+    CHECK_STR(plain.transaction, "");
+}
+
+int main()
+{
+    testVerifyReplies();
+    testSettleReplies();
+    testWhitespaceVariants();
+    testNestedObjects();
+    testEscapedStrings();
+    testUnicodeEscapes();
+    testValuesSplitAcrossSlices();
+    testOversizedFields();
+    testMalformed();
+    testReset();
+    testWalkItems();
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,36 @@
+// Facilitator URL building into caller storage
+#include "paymentutils.h"
+#include "host_test.h"
+
+static void testJoinsWithOneSlash()
+{
+    char url[X4PAY_FACILITATOR_URL_BYTES];
+    CHECK_EQ(buildFacilitatorUrl(url, sizeof(url), "https://x402.org/facilitator", "verify"), strlen(url));
+    CHECK_STR(url, "https://x402.org/facilitator/verify");
+
+    buildFacilitatorUrl(url, sizeof(url), "https://x402.org/facilitator/", "settle/batch");
+    CHECK_STR(url, "https://x402.org/facilitator/settle/batch");
+
+    // Same result as the String version
+    String joined = buildFacilitatorUrl(String("http://localhost:3000"), String("settle"));
+    buildFacilitatorUrl(url, sizeof(url), "http://localhost:3000", "settle");
+    CHECK_STR(url, joined.c_str());
+}
+
+static void testCapacity()
+{
+    // "http://a/" + "verify" = 15 characters + NUL
+    char url[16];
+    CHECK_EQ(buildFacilitatorUrl(url, sizeof(url), "http://a", "verify"), 15u);
+    CHECK_STR(url, "http://a/verify");
+
+    CHECK_EQ(buildFacilitatorUrl(url, 15, "http://a", "verify"), 0u);
+    CHECK_EQ(buildFacilitatorUrl(nullptr, 0, "http://a", "verify"), 0u);
+}
+
+int main()
+{
+    testJoinsWithOneSlash();
+    testCapacity();
+    return HOST_TEST_RESULT();
+}
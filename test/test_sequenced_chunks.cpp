@@ -0,0 +1,104 @@
+// assembleSequencedChunk: framed request assembly and its size limit
+#include "X402BleUtils.h"
+#include "host_test.h"
+#include <string>
+
+static const size_t kMax = 64;
+
+static BleFrame chunk(uint8_t sequence, uint8_t flags, const std::string &payload)
+{
+    BleFrame frame = {OpPayment, sequence, flags, (const uint8_t *)payload.data(), (uint16_t)payload.size()};
+    return frame;
+}
+
+// START payload with the 2-byte little-endian total in front (protocol 2)
+static std::string declared(uint16_t total, const std::string &data)
+{
+    std::string out;
+    out += (char)(total & 0xFF);
+    out += (char)(total >> 8);
+    return out + data;
+}
+
+static void testDeclaredTotal()
+{
+    PayloadBuffer buffer;
+    buffer.setLimit(kMax);
+    BleChunkAssembly assembly = {};
+
+    std::string start = declared(10, "hello");
+    std::string end = "world";
+    CHECK_EQ(assembleSequencedChunk(chunk(1, FrameStart, start), true, kMax, buffer, assembly), ChunkPending);
+    CHECK_EQ(assembleSequencedChunk(chunk(2, FrameEnd, end), true, kMax, buffer, assembly), ChunkComplete);
+    CHECK_STR(buffer.c_str(), "helloworld");
+}
+
+static void testOversizedDeclaredTotal()
+{
+    PayloadBuffer buffer;
+    BleChunkAssembly assembly = {};
+
+    // A central declaring ~64 KiB must not get a buffer that size - even without a limit set
+    std::string start = declared(0xFFFF, "x");
+    CHECK_EQ(assembleSequencedChunk(chunk(1, FrameStart, start), true, kMax, buffer, assembly), ChunkTooLarge);
+    CHECK(buffer.capacity() <= kMax + 1);
+    CHECK(!assembly.active);
+
+    std::string next = "y";
+    CHECK_EQ(assembleSequencedChunk(chunk(2, FrameEnd, next), true, kMax, buffer, assembly), ChunkNoStart);
+
+    // Exactly the limit is fine
+    std::string exact = declared(kMax, std::string(kMax, 'a'));
+    CHECK_EQ(assembleSequencedChunk(chunk(3, FrameStart | FrameEnd, exact), true, kMax, buffer, assembly),
+             ChunkComplete);
+    CHECK_EQ(buffer.length(), kMax);
+
+    std::string over = declared(kMax + 1, "a");
+    CHECK_EQ(assembleSequencedChunk(chunk(4, FrameStart, over), true, kMax, buffer, assembly), ChunkTooLarge);
+    CHECK_EQ(buffer.length(), 0u);
+}
+
+static void testUndeclaredGrowthStopsAtLimit()
+{
+    PayloadBuffer buffer;
+    BleChunkAssembly assembly = {};
+
+    // Protocol 1 declares no total; appends past the limit drop the request
+    std::string piece(20, 'p');
+    CHECK_EQ(assembleSequencedChunk(chunk(1, FrameStart, piece), false, kMax, buffer, assembly), ChunkPending);
+    CHECK_EQ(assembleSequencedChunk(chunk(2, 0, piece), false, kMax, buffer, assembly), ChunkPending);
+    CHECK_EQ(assembleSequencedChunk(chunk(3, 0, piece), false, kMax, buffer, assembly), ChunkPending);
+    CHECK_EQ(assembleSequencedChunk(chunk(4, 0, piece), false, kMax, buffer, assembly), ChunkTooLarge);
+    CHECK_EQ(buffer.length(), 0u);
+    CHECK(buffer.capacity() <= kMax + 1);
+}
+
+static void testBufferLimit()
+{
+    // Heap buffers of a session refuse to grow past their limit (text-command path)
+    PayloadBuffer buffer;
+    buffer.setLimit(8);
+    CHECK(!buffer.reserve(9));
+    CHECK(buffer.append("12345", 5));
+    CHECK(buffer.append("678", 3));
+    CHECK(!buffer.append("9", 1));
+    CHECK(buffer.overflowed());
+    CHECK(buffer.capacity() <= 9);
+
+    // The START reserve is refused, the chunk itself still fits
+    CHECK(!assemblePaymentChunk("X-PAYMENT:START1234", buffer));
+    CHECK(!buffer.overflowed());
+    CHECK(assemblePaymentChunk("X-PAYMENT:END5678", buffer));
+    CHECK_STR(buffer.c_str(), "12345678");
+    CHECK(!assemblePaymentChunk("X-PAYMENT9", buffer));
+    CHECK(buffer.overflowed());
+}
+
+int main()
+{
+    testDeclaredTotal();
+    testOversizedDeclaredTotal();
+    testUndeclaredGrowthStopsAtLimit();
+    testBufferLimit();
+    return HOST_TEST_RESULT();
+}
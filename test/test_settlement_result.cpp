@@ -0,0 +1,288 @@
+// Property tests: settlementResultFrom must read the same settlement out of any
+// equivalent formatting of a /settle reply - spacing, key order, extra nesting,
+// escapes - however the body is sliced on the way in.
+#include "X402Aurdino.h"
+#include "FacilitatorResponseParser.h"
+#include "httputils.h"
+#include "host_test.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+
+static const int kIterations = 3000;
+
+// xorshift64*, fixed seed so a failure reproduces
+static uint64_t rngState = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rnd(uint32_t n)
+{
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return (uint32_t)((rngState * 0x2545F4914F6CDD1Dull) >> 33) % n;
+}
+
+struct Settlement
+{
+    bool success;
+    std::string transaction;
+    std::string network;
+    std::string payer;
+    std::string errorReason; // UTF-8
+};
+
+static std::string hexString(size_t digits)
+{
+    static const char hex[] = "0123456789abcdefABCDEF";
+    std::string s = "0x";
+    for (size_t i = 0; i < digits; ++i)
+        s += hex[rnd(sizeof(hex) - 1)];
+    return s;
+}
+
+static Settlement randomSettlement()
+{
+    static const char *networks[] = {"base", "base-sepolia", "polygon-amoy", "sei-testnet", "iotex"};
+    static const char *reasons[] = {"insufficient_funds", "invalid_scheme", "said \"no\"", "back\\slash",
+                                    "caf\xC3\xA9", "\xE2\x82\xAC 5", "smile \xF0\x9F\x98\x80", "tab\there"};
+    Settlement s;
+    s.success = rnd(2) == 0;
+    s.transaction = (s.success || rnd(2)) ? hexString(64) : "";
+    s.network = networks[rnd(5)];
+    s.payer = hexString(40);
+    s.errorReason = s.success ? "" : reasons[rnd(8)];
+    return s;
+}
+
+static std::string ws()
+{
+    static const char *pieces[] = {"", "", "", " ", "  ", "\t", "\n", "\r\n", " \n\t "};
+    return pieces[rnd(9)];
+}
+
+// Next UTF-8 character of s starting at i, as a code point
+static uint32_t decodeUtf8(const std::string &s, size_t &i)
+{
+    unsigned char c = (unsigned char)s[i++];
+    if (c < 0x80)
+        return c;
+    int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : 1;
+    uint32_t cp = c & (0x3F >> extra);
+    while (extra-- > 0)
+        cp = (cp << 6) | ((unsigned char)s[i++] & 0x3F);
+    return cp;
+}
+
+static std::string unicodeEscape(uint32_t unit)
+{
+    char buf[8];
+    snprintf(buf, sizeof(buf), rnd(2) ? "\\u%04x" : "\\u%04X", (unsigned)unit);
+    return buf;
+}
+
+// JSON string literal for s, escaping characters at random in every legal way
+static std::string quote(const std::string &s)
+{
+    std::string out = "\"";
+    size_t i = 0;
+    while (i < s.size())
+    {
+        uint32_t cp = decodeUtf8(s, i);
+        bool mustEscape = cp == '"' || cp == '\\' || cp < 0x20;
+        if (!mustEscape && rnd(4) != 0)
+        {
+            if (cp < 0x80)
+                out += (char)cp;
+            else
+            {
+                // Raw UTF-8 passes straight through
+                size_t start = i - (cp >= 0x10000 ? 4 : cp >= 0x800 ? 3 : 2);
+                out += s.substr(start, i - start);
+            }
+            continue;
+        }
+        if (cp >= 0x10000)
+        {
+            uint32_t v = cp - 0x10000;
+            out += unicodeEscape(0xD800 + (v >> 10));
+            out += unicodeEscape(0xDC00 + (v & 0x3FF));
+        }
+        else if (cp == '"' && rnd(2))
+            out += "\\\"";
+        else if (cp == '\\' && rnd(2))
+            out += "\\\\";
+        else if (cp == '\n' && rnd(2))
+            out += "\\n";
+        else if (cp == '\t' && rnd(2))
+            out += "\\t";
+        else if (cp == '/' && rnd(2))
+            out += "\\/";
+        else
+            out += unicodeEscape(cp);
+    }
+    return out + "\"";
+}
+
+// Values that must be ignored: nested copies of the real keys with wrong values
+static std::string decoyValue(int depth)
+{
+    switch (depth > 2 ? rnd(3) : rnd(6))
+    {
+    case 0:
+        return rnd(2) ? "null" : "12345";
+    case 1:
+        return quote("{\"success\":true}");
+    case 2:
+        return rnd(2) ? "true" : "false";
+    case 3:
+        return "{" + ws() + quote("success") + ws() + ":" + ws() + "true" + ws() + "," + ws() +
+               quote("transaction") + ":" + quote("0xdecoy") + "," + quote("inner") + ":" + decoyValue(depth + 1) + "}";
+    case 4:
+        return "[" + ws() + decoyValue(depth + 1) + ws() + "," + ws() + "{" + quote("payer") + ":" + quote("0xdecoy") + "}" + "]";
+    default:
+        return "{" + ws() + "}";
+    }
+}
+
+static std::string render(const Settlement &s)
+{
+    std::vector<std::string> members;
+    members.push_back(quote("success") + ws() + ":" + ws() + (s.success ? "true" : "false"));
+    if (!s.transaction.empty() || rnd(2))
+        members.push_back(quote("transaction") + ws() + ":" + ws() + quote(s.transaction));
+    members.push_back(quote("network") + ws() + ":" + ws() + quote(s.network));
+    members.push_back(quote("payer") + ws() + ":" + ws() + quote(s.payer));
+    if (!s.errorReason.empty())
+        members.push_back(quote("errorReason") + ws() + ":" + ws() + quote(s.errorReason));
+    else if (rnd(2))
+        members.push_back(quote("errorReason") + ws() + ":" + ws() + "null");
+
+    static const char *extraKeys[] = {"receipt", "extensions", "meta", "succes", "successful", "transactions"};
+    for (uint32_t n = rnd(4); n > 0; --n)
+        members.push_back(quote(extraKeys[rnd(6)]) + ws() + ":" + ws() + decoyValue(0));
+
+    // Reorder keys
+    for (size_t i = members.size(); i > 1; --i)
+        std::swap(members[i - 1], members[rnd((uint32_t)i)]);
+
+    std::string body = ws() + "{" + ws();
+    for (size_t i = 0; i < members.size(); ++i)
+    {
+        if (i)
+            body += ws() + "," + ws();
+        body += members[i];
+    }
+    return body + ws() + "}" + ws();
+}
+
+static FacilitatorResult feedSliced(const std::string &body)
+{
+    FacilitatorResponseParser parser;
+    size_t pos = 0;
+    while (pos < body.size())
+    {
+        size_t n = 1 + rnd(rnd(2) ? 4 : 64);
+        n = std::min(n, body.size() - pos);
+        parser.feed(body.data() + pos, n);
+        pos += n;
+    }
+    parser.finish();
+    return parser.result();
+}
+
+static void testFormattingVariations()
+{
+    HttpResponse ok;
+    ok.success = true;
+    ok.statusCode = 200;
+
+    for (int i = 0; i < kIterations; ++i)
+    {
+        Settlement expected = randomSettlement();
+        std::string body = render(expected);
+
+        FacilitatorResult parsed = feedSliced(body);
+        CHECK(!parsed.malformed);
+        CHECK(!parsed.truncated);
+
+        SettlementResult result = settlementResultFrom(ok, parsed);
+        bool settled = expected.success && !expected.transaction.empty();
+        CHECK_EQ(result.success, settled);
+        CHECK_EQ(result.statusCode, 200);
+        CHECK_STR(result.transaction, expected.transaction.c_str());
+        CHECK_STR(result.network, expected.network.c_str());
+        CHECK_STR(result.payer, expected.payer.c_str());
+        CHECK_STR(result.errorReason, expected.errorReason.c_str());
+
+        if (hostTestFailures)
+        {
+            fprintf(stderr, "iteration %d body: %s\n", i, body.c_str());
+            return;
+        }
+    }
+}
+
+// Whatever the body says, a failed request or non-200 status is never a settlement
+static void testTransportFailureWins()
+{
+    static const int codes[] = {-1, -11, 201, 400, 500, 502};
+    for (int i = 0; i < 200; ++i)
+    {
+        Settlement expected = randomSettlement();
+        expected.success = true;
+        expected.transaction = hexString(64);
+        FacilitatorResult parsed = feedSliced(render(expected));
+
+        HttpResponse response;
+        response.statusCode = codes[rnd(6)];
+        response.success = response.statusCode >= 200 && response.statusCode < 300;
+        SettlementResult result = settlementResultFrom(response, parsed);
+        CHECK(!result.success);
+        CHECK_EQ(result.statusCode, response.statusCode);
+    }
+
+    HttpResponse failed;
+    failed.success = false;
+    failed.statusCode = -1;
+    FacilitatorResult empty;
+    empty.clear();
+    CHECK_STR(settlementResultFrom(failed, empty).errorReason, "request_failed");
+
+    HttpResponse ok;
+    ok.success = true;
+    ok.statusCode = 200;
+    FacilitatorResult malformed;
+    FacilitatorResponseParser::parse("{\"success\":tr", 13, malformed);
+    CHECK_STR(settlementResultFrom(ok, malformed).errorReason, "malformed_response");
+}
+
+// The String conversion kept for callers of the old String-returning settlePayment
+static void testStringCompatibility()
+{
+    HttpResponse ok;
+    ok.success = true;
+    ok.statusCode = 200;
+
+    FacilitatorResult parsed;
+    const char body[] = "{\"success\":true,\"transaction\":\"0xab\",\"network\":\"base\",\"payer\":\"0xcd\"}";
+    FacilitatorResponseParser::parse(body, strlen(body), parsed);
+    String reply = settlementResultFrom(ok, parsed);
+    CHECK_STR(reply.c_str(), body);
+
+    // Round trip: the compatibility JSON parses back to the same settlement
+    FacilitatorResult again;
+    CHECK(FacilitatorResponseParser::parse(reply.c_str(), reply.length(), again));
+    CHECK_STR(again.transaction, "0xab");
+
+    FacilitatorResponseParser::parse("{\"success\":false}", 17, parsed);
+    String failed = settlementResultFrom(ok, parsed);
+    CHECK_EQ(failed.length(), 0u);
+}
+
+int main()
+{
+    testFormattingVariations();
+    testTransportFailureWins();
+    testStringCompatibility();
+    return HOST_TEST_RESULT();
+}
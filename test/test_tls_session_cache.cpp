@@ -0,0 +1,168 @@
+// TlsSessionCache: hit/miss accounting, LRU replacement and invalidation
+#include "TlsSessionCache.h"
+#include "host_test.h"
+
+// A handshake whose server hands out session id `id`
+static mbedtls_ssl_context handshake(unsigned char id)
+{
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_init(&ssl);
+    memset(ssl.negotiated.id, id, sizeof(ssl.negotiated.id));
+    ssl.negotiated.id_len = sizeof(ssl.negotiated.id);
+    return ssl;
+}
+
+// Connect to host as ResumableTlsClient does: offer, handshake, store
+static bool connect(TlsSessionCache &cache, const char *host, unsigned char serverId, bool *offeredOut = nullptr)
+{
+    mbedtls_ssl_context ssl = handshake(serverId);
+    bool offered = cache.offer(host, &ssl);
+    if (offeredOut)
+        *offeredOut = offered;
+    return cache.store(host, &ssl, offered);
+}
+
+static void testMissThenHit()
+{
+    TlsSessionCache cache;
+    bool offered = true;
+
+    CHECK(!connect(cache, "a.example", 0x11, &offered));
+    CHECK(!offered);
+
+    // Server accepts the offered session and echoes its id
+    CHECK(connect(cache, "a.example", 0x11, &offered));
+    CHECK(offered);
+
+    TlsSessionCacheStats stats = cache.getStats();
+    CHECK_EQ(stats.hits, 1u);
+    CHECK_EQ(stats.misses, 1u);
+    CHECK_EQ(stats.stores, 2u);
+    CHECK_EQ(stats.evictions, 0u);
+}
+
+static void testOfferCarriesSavedSession()
+{
+    TlsSessionCache cache;
+    connect(cache, "a.example", 0x22);
+
+    mbedtls_ssl_context ssl = handshake(0x00);
+    CHECK(cache.offer("a.example", &ssl));
+    CHECK(ssl.hasOffered);
+    CHECK_EQ(ssl.offered.id_len, sizeof(ssl.offered.id));
+    CHECK_EQ(ssl.offered.id[0], 0x22);
+}
+
+static void testRefusedResumptionIsMissAndReplacesSession()
+{
+    TlsSessionCache cache;
+    connect(cache, "a.example", 0x11);
+
+    // Server starts a new session instead of resuming
+    CHECK(!connect(cache, "a.example", 0x33));
+    CHECK_EQ(cache.getStats().misses, 2u);
+    CHECK_EQ(cache.getStats().hits, 0u);
+
+    // The new session is what gets resumed next time
+    CHECK(connect(cache, "a.example", 0x33));
+    CHECK_EQ(cache.getStats().hits, 1u);
+}
+
+static void testMatchingIdWithoutOfferIsMiss()
+{
+    TlsSessionCache cache;
+    connect(cache, "a.example", 0x11);
+
+    mbedtls_ssl_context ssl = handshake(0x11);
+    CHECK(!cache.store("a.example", &ssl, false));
+    CHECK_EQ(cache.getStats().hits, 0u);
+}
+
+static void testLeastRecentlyUsedHostIsEvicted()
+{
+    TlsSessionCache cache;
+    connect(cache, "a.example", 0x0a);
+    connect(cache, "b.example", 0x0b);
+    CHECK_EQ(cache.getStats().evictions, 0u);
+
+    // Touch a, so b is now the least recently used
+    mbedtls_ssl_context ssl = handshake(0x00);
+    CHECK(cache.offer("a.example", &ssl));
+
+    connect(cache, "c.example", 0x0c);
+    CHECK_EQ(cache.getStats().evictions, 1u);
+
+    CHECK(cache.offer("a.example", &ssl));
+    CHECK(cache.offer("c.example", &ssl));
+    CHECK(!cache.offer("b.example", &ssl));
+}
+
+static void testSizeLimit()
+{
+    TlsSessionCache cache;
+    char host[16];
+    for (int i = 0; i < X4PAY_TLS_SESSION_CACHE_SIZE + 3; ++i)
+    {
+        snprintf(host, sizeof(host), "h%d.example", i);
+        connect(cache, host, (unsigned char)(i + 1));
+    }
+    CHECK_EQ(cache.getStats().evictions, 3u);
+
+    // Only the newest X4PAY_TLS_SESSION_CACHE_SIZE hosts are left
+    int cached = 0;
+    for (int i = 0; i < X4PAY_TLS_SESSION_CACHE_SIZE + 3; ++i)
+    {
+        snprintf(host, sizeof(host), "h%d.example", i);
+        mbedtls_ssl_context ssl = handshake(0x00);
+        if (cache.offer(host, &ssl))
+        {
+            cached++;
+            CHECK(i >= 3);
+        }
+    }
+    CHECK_EQ(cached, X4PAY_TLS_SESSION_CACHE_SIZE);
+}
+
+static void testInvalidateAndClear()
+{
+    TlsSessionCache cache;
+    connect(cache, "a.example", 0x0a);
+    connect(cache, "b.example", 0x0b);
+
+    mbedtls_ssl_context ssl = handshake(0x00);
+    cache.invalidate("a.example");
+    CHECK(!cache.offer("a.example", &ssl));
+    CHECK(cache.offer("b.example", &ssl));
+
+    cache.clear();
+    CHECK(!cache.offer("b.example", &ssl));
+
+    // Freed slots are reused without counting an eviction
+    connect(cache, "c.example", 0x0c);
+    connect(cache, "d.example", 0x0d);
+    CHECK_EQ(cache.getStats().evictions, 0u);
+}
+
+static void testFailedSessionExportIsNotStored()
+{
+    TlsSessionCache cache;
+    mbedtls_ssl_context ssl = handshake(0x11);
+    ssl.failGet = 1;
+    CHECK(!cache.store("a.example", &ssl, false));
+    CHECK_EQ(cache.getStats().stores, 0u);
+    CHECK_EQ(cache.getStats().misses, 0u);
+    CHECK(!cache.offer("a.example", &ssl));
+}
+
+int main()
+{
+    testMissThenHit();
+    testOfferCarriesSavedSession();
+    testRefusedResumptionIsMissAndReplacesSession();
+    testMatchingIdWithoutOfferIsMiss();
+    testLeastRecentlyUsedHostIsEvicted();
+    testSizeLimit();
+    testInvalidateAndClear();
+    testFailedSessionExportIsNotStored();
+    return HOST_TEST_RESULT();
+}
@@ -0,0 +1,98 @@
+#!/bin/sh
+# Manual harness: checks a device's TLS session resumption against a local
+# openssl s_server. It is not run by ctest; the host tests build against an
+# mbedtls double, so ResumableTlsClient / TlsSessionCache are only exercised
+# here when a real device connects.
+#
+# The server runs TLS 1.2 with a session cache, which is what TlsSessionCache
+# resumes from. After two connects from the client the server's own
+# "session cache hits" counter must have gone up: the second handshake was a
+# resumption and not a new key exchange.
+#
+#   test/tls_resumption.sh --self-test   openssl s_client connects twice (checks the harness
+#                                        itself, not the library)
+#   test/tls_resumption.sh               waits for a device: point its facilitator at the
+#                                        printed URL and trigger two payments; the device's
+#                                        getTlsSessionStats().hits should then read 1
+#
+# PORT (default 8443) and WAIT_SECONDS (default 120) can be set in the environment.
+set -eu
+
+PORT="${PORT:-8443}"
+WAIT_SECONDS="${WAIT_SECONDS:-120}"
+WORK="$(mktemp -d)"
+SERVER_PID=""
+
+cleanup()
+{
+    [ -n "$SERVER_PID" ] && kill "$SERVER_PID" 2>/dev/null || true
+    rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj "/CN=x4pay-facilitator" \
+    -keyout "$WORK/key.pem" -out "$WORK/cert.pem" >/dev/null 2>&1
+
+# -www answers every request with a status page that includes the cache counters
+openssl s_server -accept "$PORT" -cert "$WORK/cert.pem" -key "$WORK/key.pem" \
+    -tls1_2 -www -quiet >"$WORK/server.log" 2>&1 &
+SERVER_PID=$!
+sleep 1
+
+# Hits so far; fetching the page is itself one more full handshake
+cacheHits()
+{
+    printf 'GET / HTTP/1.0\r\n\r\n' |
+        openssl s_client -connect "127.0.0.1:$PORT" -tls1_2 -quiet 2>/dev/null |
+        sed -n 's/^ *\([0-9][0-9]*\) session cache hits.*/\1/p'
+}
+
+# Connects accepted so far, read the same way
+acceptedConnects()
+{
+    printf 'GET / HTTP/1.0\r\n\r\n' |
+        openssl s_client -connect "127.0.0.1:$PORT" -tls1_2 -quiet 2>/dev/null |
+        sed -n 's/^ *\([0-9][0-9]*\) server accepts that finished.*/\1/p'
+}
+
+before="$(cacheHits)"
+if [ -z "$before" ]; then
+    echo "FAIL: no stats page from openssl s_server on port $PORT" >&2
+    exit 1
+fi
+
+if [ "${1:-}" = "--self-test" ]; then
+    # -sess_out/-sess_in do what TlsSessionCache does: keep the session and offer it again
+    printf '' | openssl s_client -connect "127.0.0.1:$PORT" -tls1_2 \
+        -sess_out "$WORK/session.pem" >/dev/null 2>&1
+    printf '' | openssl s_client -connect "127.0.0.1:$PORT" -tls1_2 \
+        -sess_in "$WORK/session.pem" >"$WORK/client.log" 2>&1
+    if ! grep -q '^Reused' "$WORK/client.log"; then
+        echo "FAIL: openssl s_client did not report a reused session" >&2
+        exit 1
+    fi
+else
+    echo "Point the facilitator at https://<this host>:$PORT/ and run two payments"
+    echo "(waiting up to ${WAIT_SECONDS}s for two connects)"
+    start="$(acceptedConnects)"
+    polls=0
+    waited=0
+    while [ "$waited" -lt "$WAIT_SECONDS" ]; do
+        sleep 2
+        waited=$((waited + 2))
+        now="$(acceptedConnects)"
+        polls=$((polls + 1))
+        # Every poll is a connect of its own; the rest came from the device
+        if [ $((now - start - polls)) -ge 2 ]; then
+            break
+        fi
+    done
+fi
+
+after="$(cacheHits)"
+if [ "$after" -gt "$before" ]; then
+    echo "PASS: second connect resumed the session (server cache hits $before -> $after)"
+    exit 0
+fi
+echo "FAIL: no resumption seen (server cache hits stayed at $before)" >&2
+exit 1